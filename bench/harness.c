@@ -0,0 +1,326 @@
+// Benchmark suite timing lexing, parsing and evaluation separately
+//
+// gcc -O2 -I../src -o harness harness.c ../src/{lexer,intern,ast,parser,symtab,optimizer,compiler,vm,jit,emitc,trace,profile,interpreter,output,stringval,array,dict}.c -lm
+// ./harness [--repeats N] [--size small|medium|large|all] [--workload NAME] [--tree-walk] [--jit] [--no-optimize]
+//
+// Results are printed as JSON. Operations count binary operators and assignments as written in
+// the source, so the numbers compare across engines. Evaluation includes optimizing and compiling.
+#include "interpreter.h"
+#include "optimizer.h"
+#include "jit.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct
+{
+    char *text;
+    size_t length;
+    size_t capacity;
+    uint64_t operations; // Expected operations once evaluated
+} Source;
+
+typedef struct
+{
+    const char *name;
+    void (*generate)(Source *source, uint32_t scale);
+} Workload;
+
+typedef struct
+{
+    const char *name;
+    uint32_t scale;
+} Size;
+
+typedef struct
+{
+    double mean;
+    double stddev;
+    double min;
+    double max;
+} Stats;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void append(Source *source, const char *format, ...)
+{
+    va_list args;
+    if (source->capacity - source->length < 256)
+    {
+        source->capacity = source->capacity == 0 ? 1 << 16 : source->capacity * 2;
+        source->text = realloc(source->text, source->capacity);
+        if (source->text == NULL)
+        {
+            printf("Bench Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    va_start(args, format);
+    source->length += (size_t)vsnprintf(source->text + source->length, 256, format, args);
+    va_end(args);
+}
+
+// Long straight-line arithmetic over 64 variables
+static void generateStraight(Source *source, uint32_t scale)
+{
+    for (int v = 0; v < 64; v++)
+    {
+        append(source, "int v%d = %d;\n", v, v);
+    }
+    for (uint32_t k = 0; k < scale; k++)
+    {
+        append(source, "v%u = (v%u * 3 + %u) %% 1009 - 2;\n", k % 64, (k + 63) % 64, k % 1000);
+    }
+    source->operations = 64 + (uint64_t)scale * 5;
+}
+
+// for loops around while loops, 100 inner iterations per outer one
+static void generateLoops(Source *source, uint32_t scale)
+{
+    uint32_t outer = scale / 100 > 0 ? scale / 100 : 1;
+    append(source, "int s = 0;\nint i = 0;\nint j = 0;\n");
+    append(source, "for (i = 0; i < %u; i = i + 1) {\n", outer);
+    append(source, "    j = 0;\n");
+    append(source, "    while (j < 100) {\n");
+    append(source, "        s = (s + i * j) %% 65536;\n");
+    append(source, "        j = j + 1;\n");
+    append(source, "    }\n}\n");
+    // 3 declarations, init, conditions, increments, j = 0, inner conditions and bodies
+    source->operations = 3 + 1 + (outer + 1) + 2 * (uint64_t)outer + outer + 101 * (uint64_t)outer + 600 * (uint64_t)outer;
+}
+
+// Many distinct names, written once and read once
+static void generateVariables(Source *source, uint32_t scale)
+{
+    append(source, "int total = 0;\n");
+    for (uint32_t k = 0; k < scale; k++)
+    {
+        append(source, "int var_%u = %u %% 97;\n", k, k);
+    }
+    for (uint32_t k = 0; k < scale; k++)
+    {
+        append(source, "total = total + var_%u;\n", k);
+    }
+    source->operations = 1 + 4 * (uint64_t)scale;
+}
+
+// Expressions 64 operators deep, alternately nested to the left and to the right
+static void generateDeep(Source *source, uint32_t scale)
+{
+    const uint32_t depth = 64;
+    uint32_t lines = scale / depth > 0 ? scale / depth : 1;
+    append(source, "int x = 3;\nint d = 0;\n");
+    for (uint32_t line = 0; line < lines; line++)
+    {
+        append(source, "d = ");
+        if (line % 2 == 0)
+        {
+            for (uint32_t k = 0; k < depth; k++)
+            {
+                append(source, "(");
+            }
+            append(source, "x");
+            for (uint32_t k = 0; k < depth; k++)
+            {
+                append(source, " %c x)", k % 2 ? '-' : '+');
+            }
+        }
+        else
+        {
+            for (uint32_t k = 0; k < depth; k++)
+            {
+                append(source, "x %c (", k % 2 ? '-' : '+');
+            }
+            append(source, "x");
+            for (uint32_t k = 0; k < depth; k++)
+            {
+                append(source, ")");
+            }
+        }
+        append(source, ";\n");
+    }
+    source->operations = 2 + (uint64_t)lines * (depth + 1);
+}
+
+static const Workload workloads[] = {
+    {"straight", generateStraight},
+    {"loops", generateLoops},
+    {"variables", generateVariables},
+    {"deep", generateDeep},
+};
+
+static const Size sizes[] = {
+    {"small", 10000},
+    {"medium", 100000},
+    {"large", 1000000},
+};
+
+#define COUNT(array) (sizeof(array) / sizeof(array[0]))
+
+static Stats computeStats(const double *samples, int count)
+{
+    Stats stats = {0, 0, samples[0], samples[0]};
+    for (int i = 0; i < count; i++)
+    {
+        stats.mean += samples[i];
+        stats.min = samples[i] < stats.min ? samples[i] : stats.min;
+        stats.max = samples[i] > stats.max ? samples[i] : stats.max;
+    }
+    stats.mean /= count;
+    for (int i = 0; i < count; i++)
+    {
+        stats.stddev += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+    }
+    stats.stddev = count > 1 ? sqrt(stats.stddev / (count - 1)) : 0;
+    return stats;
+}
+
+static void printPhase(const char *name, const double *samples, int count, uint64_t units, const char *unit, int last)
+{
+    Stats stats = computeStats(samples, count);
+    printf("      \"%s\": {\"mean_s\": %.6f, \"stddev_s\": %.6f, \"min_s\": %.6f, \"max_s\": %.6f, \"%s_per_s\": %.0f}%s\n",
+           name, stats.mean, stats.stddev, stats.min, stats.max, unit, units / stats.mean, last ? "" : ",");
+}
+
+static int visitCount(NodeRef node, void *context)
+{
+    (void)node;
+    (*(uint64_t *)context)++;
+    return 0;
+}
+
+// Time every phase of one generated program, the workloads never print
+static void runBenchmark(const Workload *workload, const Size *size, int repeats, int first)
+{
+    Source source = {0};
+    workload->generate(&source, size->scale);
+
+    double *lexTimes = malloc(repeats * sizeof(double));
+    double *parseTimes = malloc(repeats * sizeof(double));
+    double *evalTimes = malloc(repeats * sizeof(double));
+    uint64_t tokens = 0;
+    uint64_t nodes = 0;
+
+    for (int r = 0; r < repeats; r++)
+    {
+        double start = now();
+        setInputBuffer(source.text, source.length);
+        tokens = 0;
+        while (getNextToken().type != Eof)
+        {
+            tokens++;
+        }
+        lexTimes[r] = now() - start;
+
+        start = now();
+        setInputBuffer(source.text, source.length);
+        NodeRef program = parseProgram();
+        parseTimes[r] = now() - start;
+
+        nodes = 0;
+        forEachNode(program, visitCount, &nodes);
+
+        start = now();
+        evaluateProgram(program);
+        evalTimes[r] = now() - start;
+
+        freeAST();
+        freeSymbolTable();
+    }
+
+    printf("%s    {\n", first ? "" : ",\n");
+    printf("      \"workload\": \"%s\", \"size\": \"%s\", \"bytes\": %zu, \"tokens\": %llu, \"nodes\": %llu, \"operations\": %llu,\n",
+           workload->name, size->name, source.length, (unsigned long long)tokens, (unsigned long long)nodes,
+           (unsigned long long)source.operations);
+    printPhase("lex", lexTimes, repeats, tokens, "tokens", 0);
+    printPhase("parse", parseTimes, repeats, nodes, "nodes", 0);
+    printPhase("eval", evalTimes, repeats, source.operations, "operations", 1);
+    printf("    }");
+    fflush(stdout);
+
+    free(lexTimes);
+    free(parseTimes);
+    free(evalTimes);
+    free(source.text);
+}
+
+int main(int argc, char *argv[])
+{
+    int repeats = 5;
+    const char *sizeName = "medium";
+    const char *workloadName = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc)
+        {
+            repeats = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            sizeName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--workload") == 0 && i + 1 < argc)
+        {
+            workloadName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tree-walk") == 0)
+        {
+            useTreeWalker = 1;
+        }
+        else if (strcmp(argv[i], "--jit") == 0)
+        {
+            useJit = 1;
+        }
+        else if (strcmp(argv[i], "--no-optimize") == 0)
+        {
+            useOptimizer = 0;
+        }
+        else
+        {
+            printf("Usage: %s [--repeats N] [--size small|medium|large|all] [--workload NAME] [--tree-walk] [--jit] [--no-optimize]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (repeats < 1)
+    {
+        repeats = 1;
+    }
+
+    // The phases are called one by one, so the interpreter stays bound for the whole run
+    Interpreter *interpreter = createInterpreter(stdout);
+    interp = interpreter;
+
+    printf("{\n  \"engine\": \"%s\", \"optimizer\": %s, \"repeats\": %d,\n  \"results\": [\n",
+           useTreeWalker ? "tree-walk" : useJit ? "jit" : "vm", useOptimizer ? "true" : "false", repeats);
+
+    int first = 1;
+    for (size_t w = 0; w < COUNT(workloads); w++)
+    {
+        if (workloadName != NULL && strcmp(workloadName, workloads[w].name) != 0)
+        {
+            continue;
+        }
+        for (size_t s = 0; s < COUNT(sizes); s++)
+        {
+            if (strcmp(sizeName, "all") != 0 && strcmp(sizeName, sizes[s].name) != 0)
+            {
+                continue;
+            }
+            runBenchmark(&workloads[w], &sizes[s], repeats, first);
+            first = 0;
+        }
+    }
+
+    printf("\n  ]\n}\n");
+    destroyInterpreter(interpreter);
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Lexer throughput benchmark
+//
+// gcc -O2 -I../src -o lexbench lexbench.c ../src/{lexer,intern,ast,parser,symtab,optimizer,compiler,vm,jit,emitc,trace,profile,interpreter,output,stringval,array,dict}.c
+// ./lexbench [megabytes] [repeats]
+#include "interpreter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Statements mixing every token kind, comments and indentation
+static const char *samples[] = {
+    "int counter_%d = %d * (value + 42) %% 7;\n",
+    "    // Comment line explaining the next statement %d\n",
+    "if (total_%d >= %d) {\n        print(total);\n    } else if (x != 3) {\n        x = x - 1;\n    }\n",
+    "for (i = 0; i < %d; i = i + 1) {\n        sum = sum + i / 2;\n    }\n",
+    "while (count_%d > %d) {\n        count = count - 1;\n    }\n",
+    "char name_%d = 'some text %d';\n",
+};
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Build a source of about size bytes
+static char *generateSource(size_t size, size_t *length)
+{
+    char *source = malloc(size + 256);
+    size_t used = 0;
+    int i = 0;
+    while (used < size)
+    {
+        const char *sample = samples[i % (sizeof(samples) / sizeof(samples[0]))];
+        used += (size_t)snprintf(source + used, 256, sample, i % 1000, i);
+        i++;
+    }
+    *length = used;
+    return source;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t megabytes = argc > 1 ? (size_t)atoi(argv[1]) : 64;
+    int repeats = argc > 2 ? atoi(argv[2]) : 5;
+
+    Interpreter *interpreter = createInterpreter(stdout);
+    interp = interpreter;
+
+    size_t length;
+    char *source = generateSource(megabytes << 20, &length);
+    double best = 0;
+    long tokens = 0;
+
+    for (int r = 0; r < repeats; r++)
+    {
+        double start = now();
+        setInputBuffer(source, length);
+        tokens = 0;
+        while (getNextToken().type != Eof)
+        {
+            tokens++;
+        }
+        double elapsed = now() - start;
+        if (best == 0 || elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+
+    printf("input: %.1f MB, tokens: %ld\n", length / 1e6, tokens);
+    printf("best of %d: %.3f s, %.1f MB/s, %.1f Mtokens/s\n",
+           repeats, best, length / 1e6 / best, tokens / 1e6 / best);
+
+    free(source);
+    destroyInterpreter(interpreter);
+    return 0;
+}
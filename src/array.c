@@ -0,0 +1,533 @@
+#include "array.h"
+#include "interpreter.h"
+#include "output.h"
+#include "symtab.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Items start on a cache line, so every vector load of the kernels is aligned
+#define ARRAY_ALIGNMENT 64
+
+static void *allocItems(uint32_t capacity)
+{
+    void *items = NULL;
+    if (posix_memalign(&items, ARRAY_ALIGNMENT, (size_t)(capacity == 0 ? 1 : capacity) * sizeof(int32_t)) != 0)
+    {
+        reportError("Runtime Error: Out of memory\n");
+        failInterpreter();
+    }
+    return items;
+}
+
+// Make room for capacity items, the old items are kept
+static void reserveItems(IntArray *array, uint32_t capacity)
+{
+    if (capacity <= array->capacity)
+    {
+        return;
+    }
+    int32_t *items = allocItems(capacity);
+    if (array->length > 0)
+    {
+        memcpy(items, array->items, array->length * sizeof(int32_t));
+    }
+    free(array->items);
+    array->items = items;
+    array->capacity = capacity;
+}
+
+void freeArray(IntArray *array)
+{
+    free(array->items);
+    array->items = NULL;
+    array->length = 0;
+    array->capacity = 0;
+}
+
+ArrayBuiltin builtinNamed(InternId name)
+{
+    static const char *names[] = {
+        [BUILTIN_LEN] = "len",
+        [BUILTIN_SUM] = "sum",
+        [BUILTIN_MIN] = "min",
+        [BUILTIN_MAX] = "max",
+        [BUILTIN_PUSH] = "push",
+        [BUILTIN_ADD] = "add",
+        [BUILTIN_SCALE] = "scale",
+        [BUILTIN_HAS] = "has",
+        [BUILTIN_FILL] = "fill",
+        [BUILTIN_REMOVE] = "remove",
+        [BUILTIN_RESERVE] = "reserve",
+    };
+    const char *text = internedText(name);
+    for (int builtin = BUILTIN_LEN; builtin <= BUILTIN_RESERVE; builtin++)
+    {
+        if (strcmp(names[builtin], text) == 0)
+        {
+            return (ArrayBuiltin)builtin;
+        }
+    }
+    return BUILTIN_NONE;
+}
+
+int builtinIsExpression(ArrayBuiltin builtin)
+{
+    return builtin >= BUILTIN_LEN && builtin <= BUILTIN_HAS;
+}
+
+// has and remove take a key after the dict
+int builtinTakesKey(ArrayBuiltin builtin)
+{
+    return builtin == BUILTIN_HAS || builtin == BUILTIN_REMOVE;
+}
+
+// Int arguments after the array, add takes a second array and has and remove a key instead
+int builtinArguments(ArrayBuiltin builtin)
+{
+    switch (builtin)
+    {
+    case BUILTIN_PUSH:
+    case BUILTIN_SCALE:
+    case BUILTIN_RESERVE:
+        return 1;
+    case BUILTIN_FILL:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+// Kernels, whole vectors while they fit and a scalar tail.
+// Sums and products wrap like the interpreter's arithmetic.
+
+static int32_t sumItems(const int32_t *items, uint32_t length)
+{
+    uint32_t i = 0;
+    uint32_t total = 0;
+#if defined(__AVX2__)
+    __m256i lanes = _mm256_setzero_si256();
+    for (; i + 8 <= length; i += 8)
+    {
+        lanes = _mm256_add_epi32(lanes, _mm256_load_si256((const __m256i *)(items + i)));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(lanes), _mm256_extracti128_si256(lanes, 1));
+#elif defined(__SSE2__)
+    __m128i half = _mm_setzero_si128();
+    for (; i + 4 <= length; i += 4)
+    {
+        half = _mm_add_epi32(half, _mm_load_si128((const __m128i *)(items + i)));
+    }
+#endif
+#if defined(__SSE2__)
+    uint32_t parts[4];
+    _mm_storeu_si128((__m128i *)parts, half);
+    total = parts[0] + parts[1] + parts[2] + parts[3];
+#endif
+    for (; i < length; i++)
+    {
+        total += (uint32_t)items[i];
+    }
+    return (int32_t)total;
+}
+
+#if defined(__SSE2__) && !defined(__SSE4_1__)
+// pminsd and pmaxsd arrived with SSE4.1
+static inline __m128i _mm_min_epi32(__m128i a, __m128i b)
+{
+    __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+}
+
+static inline __m128i _mm_max_epi32(__m128i a, __m128i b)
+{
+    __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+}
+#endif
+
+// Smallest item, or the largest when largest is set, length > 0
+static int32_t extremeItem(const int32_t *items, uint32_t length, int largest)
+{
+    uint32_t i = 0;
+    int32_t best = items[0];
+#if defined(__AVX2__)
+    if (length >= 8)
+    {
+        __m256i lanes = _mm256_load_si256((const __m256i *)items);
+        for (i = 8; i + 8 <= length; i += 8)
+        {
+            __m256i block = _mm256_load_si256((const __m256i *)(items + i));
+            lanes = largest ? _mm256_max_epi32(lanes, block) : _mm256_min_epi32(lanes, block);
+        }
+        int32_t parts[8];
+        _mm256_storeu_si256((__m256i *)parts, lanes);
+        for (int lane = 0; lane < 8; lane++)
+        {
+            best = (largest ? parts[lane] > best : parts[lane] < best) ? parts[lane] : best;
+        }
+    }
+#elif defined(__SSE2__)
+    if (length >= 4)
+    {
+        __m128i lanes = _mm_load_si128((const __m128i *)items);
+        for (i = 4; i + 4 <= length; i += 4)
+        {
+            __m128i block = _mm_load_si128((const __m128i *)(items + i));
+            lanes = largest ? _mm_max_epi32(lanes, block) : _mm_min_epi32(lanes, block);
+        }
+        int32_t parts[4];
+        _mm_storeu_si128((__m128i *)parts, lanes);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            best = (largest ? parts[lane] > best : parts[lane] < best) ? parts[lane] : best;
+        }
+    }
+#endif
+    for (; i < length; i++)
+    {
+        best = (largest ? items[i] > best : items[i] < best) ? items[i] : best;
+    }
+    return best;
+}
+
+static void addItems(int32_t *target, const int32_t *source, uint32_t length)
+{
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= length; i += 8)
+    {
+        __m256i sum = _mm256_add_epi32(_mm256_load_si256((const __m256i *)(target + i)),
+                                       _mm256_load_si256((const __m256i *)(source + i)));
+        _mm256_store_si256((__m256i *)(target + i), sum);
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= length; i += 4)
+    {
+        __m128i sum = _mm_add_epi32(_mm_load_si128((const __m128i *)(target + i)),
+                                    _mm_load_si128((const __m128i *)(source + i)));
+        _mm_store_si128((__m128i *)(target + i), sum);
+    }
+#endif
+    for (; i < length; i++)
+    {
+        target[i] = (int32_t)((uint32_t)target[i] + (uint32_t)source[i]);
+    }
+}
+
+static void scaleItems(int32_t *items, uint32_t length, int32_t factor)
+{
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    __m256i factors = _mm256_set1_epi32(factor);
+    for (; i + 8 <= length; i += 8)
+    {
+        __m256i block = _mm256_load_si256((const __m256i *)(items + i));
+        _mm256_store_si256((__m256i *)(items + i), _mm256_mullo_epi32(block, factors));
+    }
+#elif defined(__SSE2__)
+    // Without pmulld the even and odd lanes are multiplied as 64 bits and the low halves kept
+    __m128i factors = _mm_set1_epi32(factor);
+    for (; i + 4 <= length; i += 4)
+    {
+        __m128i block = _mm_load_si128((const __m128i *)(items + i));
+        __m128i even = _mm_mul_epu32(block, factors);
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(block, 32), _mm_srli_epi64(factors, 32));
+        __m128i low = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                         _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+        _mm_store_si128((__m128i *)(items + i), low);
+    }
+#endif
+    for (; i < length; i++)
+    {
+        items[i] = (int32_t)((uint32_t)items[i] * (uint32_t)factor);
+    }
+}
+
+static void fillItems(int32_t *items, uint32_t length, int32_t value)
+{
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    __m256i values = _mm256_set1_epi32(value);
+    for (; i + 8 <= length; i += 8)
+    {
+        _mm256_store_si256((__m256i *)(items + i), values);
+    }
+#elif defined(__SSE2__)
+    __m128i values = _mm_set1_epi32(value);
+    for (; i + 4 <= length; i += 4)
+    {
+        _mm_store_si128((__m128i *)(items + i), values);
+    }
+#endif
+    for (; i < length; i++)
+    {
+        items[i] = value;
+    }
+}
+
+// Array or dict variable of the bound interpreter, the pointer is valid until the next variable is defined
+static SymbolTableEntry *lookupContainer(InternId name)
+{
+    SymbolTableEntry *entry = lookupSymbolHashed(internedText(name), internedHash(name));
+    if (entry == NULL)
+    {
+        reportError("Runtime Error: Undefined variable '%s'\n", internedText(name));
+        failInterpreter();
+    }
+    if (entry->type != TYPE_ARRAY && entry->type != TYPE_DICT)
+    {
+        reportError("Type Error: Variable '%s' is not an array or a dict\n", internedText(name));
+        failInterpreter();
+    }
+    return entry;
+}
+
+static SymbolTableEntry *lookupTyped(InternId name, VariableType type)
+{
+    SymbolTableEntry *entry = lookupContainer(name);
+    if (entry->type != type)
+    {
+        reportError("Type Error: Variable '%s' is not %s\n", internedText(name), type == TYPE_ARRAY ? "an array" : "a dict");
+        failInterpreter();
+    }
+    return entry;
+}
+
+static IntArray *lookupArray(InternId name)
+{
+    return &lookupTyped(name, TYPE_ARRAY)->arrayValue;
+}
+
+static uint32_t checkIndex(InternId name, const IntArray *array, const DictKey *key)
+{
+    if (key->kind != DICT_INT_KEY)
+    {
+        reportError("Type Error: Index of array '%s' is not an int\n", internedText(name));
+        failInterpreter();
+    }
+    if (key->intKey < 0 || (uint32_t)key->intKey >= array->length)
+    {
+        reportError("Runtime Error: Index %d out of bounds for array '%s' of length %u\n", key->intKey,
+                    internedText(name), array->length);
+        failInterpreter();
+    }
+    return (uint32_t)key->intKey;
+}
+
+int32_t readElement(InternId name, const DictKey *key)
+{
+    SymbolTableEntry *entry = lookupContainer(name);
+    if (entry->type == TYPE_ARRAY)
+    {
+        return entry->arrayValue.items[checkIndex(name, &entry->arrayValue, key)];
+    }
+    int32_t *value = findDictValue(entry->dictValue, key);
+    if (value == NULL)
+    {
+        if (key->kind == DICT_INT_KEY)
+        {
+            reportError("Runtime Error: Key %d not found in dict '%s'\n", key->intKey, internedText(name));
+        }
+        else
+        {
+            reportError("Runtime Error: Key '%.*s' not found in dict '%s'\n", (int)key->length, key->text,
+                        internedText(name));
+        }
+        failInterpreter();
+    }
+    return *value;
+}
+
+// A dict gets the key when it is missing
+void writeElement(InternId name, const DictKey *key, int32_t value)
+{
+    SymbolTableEntry *entry = lookupContainer(name);
+    if (entry->type == TYPE_ARRAY)
+    {
+        entry->arrayValue.items[checkIndex(name, &entry->arrayValue, key)] = value;
+    }
+    else
+    {
+        *insertDictKey(entry->dictValue, key) = value;
+    }
+}
+
+// Give variable the element or key at position and move past it, 0 at the end.
+// Positions index the entries, so keys added or removed while looping do not break the walk.
+int nextElement(InternId container, InternId variable, uint32_t *position)
+{
+    SymbolTableEntry *entry = lookupContainer(container);
+    if (entry->type == TYPE_ARRAY)
+    {
+        if (*position >= entry->arrayValue.length)
+        {
+            return 0;
+        }
+        int32_t value = entry->arrayValue.items[(*position)++];
+        assignVariableIntHashed(internedText(variable), internedHash(variable), TYPE_INT, value);
+        return 1;
+    }
+
+    const DictEntry *found = nextDictEntry(entry->dictValue, position);
+    if (found == NULL)
+    {
+        return 0;
+    }
+    if (found->kind == DICT_INT_KEY)
+    {
+        assignVariableIntHashed(internedText(variable), internedHash(variable), TYPE_INT, found->intKey);
+    }
+    else
+    {
+        // Defining the variable may move the symbol table, not the dict
+        StringValue key;
+        shareString(&key, &found->stringKey);
+        assignVariableValueHashed(internedText(variable), internedHash(variable), &key);
+    }
+    return 1;
+}
+
+// key is only read by has
+int32_t callArrayBuiltin(ArrayBuiltin builtin, InternId name, const DictKey *key)
+{
+    if (builtin == BUILTIN_LEN)
+    {
+        SymbolTableEntry *entry = lookupContainer(name);
+        return entry->type == TYPE_ARRAY ? (int32_t)entry->arrayValue.length : (int32_t)entry->dictValue->count;
+    }
+    if (builtin == BUILTIN_HAS)
+    {
+        return findDictValue(lookupTyped(name, TYPE_DICT)->dictValue, key) != NULL;
+    }
+
+    IntArray *array = lookupArray(name);
+    switch (builtin)
+    {
+    case BUILTIN_SUM:
+        return sumItems(array->items, array->length);
+    default:
+        if (array->length == 0)
+        {
+            reportError("Runtime Error: Cannot take the %s of the empty array '%s'\n", builtin == BUILTIN_MIN ? "min" : "max",
+                        internedText(name));
+            failInterpreter();
+        }
+        return extremeItem(array->items, array->length, builtin == BUILTIN_MAX);
+    }
+}
+
+// The arguments were evaluated in order, builtinArguments tells how many. key is only read by remove.
+void runArrayBuiltin(ArrayBuiltin builtin, InternId name, InternId other, const DictKey *key,
+                     const int32_t *arguments)
+{
+    if (builtin == BUILTIN_REMOVE)
+    {
+        removeDictKey(lookupTyped(name, TYPE_DICT)->dictValue, key);
+        return;
+    }
+    if (builtin == BUILTIN_RESERVE)
+    {
+        SymbolTableEntry *entry = lookupContainer(name);
+        if (arguments[0] < 0)
+        {
+            reportError("Runtime Error: Negative size %d reserved for '%s'\n", arguments[0], internedText(name));
+            failInterpreter();
+        }
+        if (entry->type == TYPE_ARRAY)
+        {
+            reserveItems(&entry->arrayValue, (uint32_t)arguments[0]);
+        }
+        else
+        {
+            reserveDict(entry->dictValue, (uint32_t)arguments[0]);
+        }
+        return;
+    }
+
+    IntArray *array = lookupArray(name);
+    switch (builtin)
+    {
+    case BUILTIN_PUSH:
+        // Doubling keeps the copies to a constant number per item
+        if (array->length == array->capacity)
+        {
+            if (array->capacity >= INT32_MAX / 2)
+            {
+                reportError("Runtime Error: Array '%s' is too large\n", internedText(name));
+                failInterpreter();
+            }
+            reserveItems(array, array->capacity < 16 ? 16 : array->capacity * 2);
+        }
+        array->items[array->length++] = arguments[0];
+        break;
+
+    case BUILTIN_ADD:
+    {
+        IntArray *source = lookupArray(other);
+        array = lookupArray(name);
+        if (source->length != array->length)
+        {
+            reportError("Runtime Error: Cannot add array '%s' of length %u to '%s' of length %u\n",
+                        internedText(other), source->length, internedText(name), array->length);
+            failInterpreter();
+        }
+        addItems(array->items, source->items, array->length);
+        break;
+    }
+
+    case BUILTIN_SCALE:
+        scaleItems(array->items, array->length, arguments[0]);
+        break;
+
+    case BUILTIN_FILL:
+        if (arguments[1] < 0)
+        {
+            reportError("Runtime Error: Negative length %d for array '%s'\n", arguments[1], internedText(name));
+            failInterpreter();
+        }
+        array->length = 0;
+        reserveItems(array, (uint32_t)arguments[1]);
+        array->length = (uint32_t)arguments[1];
+        fillItems(array->items, array->length, arguments[0]);
+        break;
+
+    default:
+        break;
+    }
+}
+
+// Array literal, the values are copied
+void assignArrayElements(InternId name, const int32_t *values, uint32_t count)
+{
+    IntArray array = {allocItems(count), count, count};
+    if (count > 0)
+    {
+        memcpy(array.items, values, count * sizeof(int32_t));
+    }
+    assignVariableArrayHashed(internedText(name), internedHash(name), &array);
+}
+
+// Arrays are values, the copy does not change with the source
+void assignArrayCopy(InternId name, InternId source)
+{
+    IntArray *original = lookupArray(source);
+    assignArrayElements(name, original->items, original->length);
+}
+
+// [1, 2, 3] without the newline
+void writeArray(const IntArray *array)
+{
+    writeText("[", 1);
+    for (uint32_t i = 0; i < array->length; i++)
+    {
+        if (i > 0)
+        {
+            writeText(", ", 2);
+        }
+        writeInt(array->items[i]);
+    }
+    writeText("]", 1);
+}
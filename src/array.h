@@ -0,0 +1,52 @@
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include "dict.h"
+#include "intern.h"
+#include <stdint.h>
+
+// Value of an array variable, items are aligned for the vector kernels
+typedef struct
+{
+    int32_t *items;
+    uint32_t length;
+    uint32_t capacity;
+} IntArray;
+
+// Functions taking an array or a dict, stored in the nodes that call them
+typedef enum
+{
+    BUILTIN_NONE,
+    BUILTIN_LEN, // len(a), sum(a), min(a), max(a) and has(d, key) are int expressions
+    BUILTIN_SUM,
+    BUILTIN_MIN,
+    BUILTIN_MAX,
+    BUILTIN_HAS,
+    BUILTIN_PUSH,    // push(a, value) appends
+    BUILTIN_ADD,     // add(a, b) adds b to a element by element
+    BUILTIN_SCALE,   // scale(a, factor) multiplies every element
+    BUILTIN_FILL,    // fill(a, value, count) makes a count copies of value
+    BUILTIN_REMOVE,  // remove(d, key) deletes a key
+    BUILTIN_RESERVE, // reserve(a, count) makes room for count elements or keys
+} ArrayBuiltin;
+
+// Array functions
+ArrayBuiltin builtinNamed(InternId name);
+int builtinIsExpression(ArrayBuiltin builtin);
+int builtinArguments(ArrayBuiltin builtin);
+int builtinTakesKey(ArrayBuiltin builtin);
+void freeArray(IntArray *array);
+
+// Operations on the array and dict variables of the bound interpreter, errors fail the script.
+// An array takes int keys as indexes.
+int32_t readElement(InternId name, const DictKey *key);
+void writeElement(InternId name, const DictKey *key, int32_t value);
+int nextElement(InternId container, InternId variable, uint32_t *position);
+int32_t callArrayBuiltin(ArrayBuiltin builtin, InternId name, const DictKey *key);
+void runArrayBuiltin(ArrayBuiltin builtin, InternId name, InternId other, const DictKey *key,
+                     const int32_t *arguments);
+void assignArrayElements(InternId name, const int32_t *values, uint32_t count);
+void assignArrayCopy(InternId name, InternId source);
+void writeArray(const IntArray *array);
+
+#endif
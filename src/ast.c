@@ -0,0 +1,217 @@
+#include "ast.h"
+#include "interpreter.h"
+#include "output.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Arena kept between programs so the interactive mode reuses its memory
+#define ARENA_KEEP_WORDS (1u << 16)
+
+// 64M entries, 256 MB per stack
+uint32_t workStackLimit = 1u << 26;
+
+// Reserve a cleared record of size bytes and return its reference
+NodeRef allocNode(ASTNodeType nodeType, size_t size)
+{
+    ASTArena *arena = &interp->arena;
+    uint32_t words = (uint32_t)((size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+
+    if (arena->count == 0)
+    {
+        arena->count = 1; // Word 0 stands for NULL_NODE
+    }
+    if (arena->count + words > arena->capacity)
+    {
+        uint32_t capacity = arena->capacity == 0 ? 1024 : arena->capacity;
+        while (arena->count + words > capacity)
+        {
+            capacity *= 2;
+        }
+        arena->words = realloc(arena->words, capacity * sizeof(uint32_t));
+        if (arena->words == NULL)
+        {
+            reportError("Parser Error: Out of memory\n");
+            failInterpreter();
+        }
+        arena->capacity = capacity;
+    }
+
+    NodeRef ref = arena->count;
+    arena->count += words;
+    memset(arena->words + ref, 0, words * sizeof(uint32_t));
+    NODE(ref, NodeHeader)->nodeType = nodeType;
+    return ref;
+}
+
+// Free every node at once, but the functions kept by the interactive mode
+void freeAST()
+{
+    ASTArena *arena = &interp->arena;
+    arena->count = interp->keptWords;
+    if (arena->count == 0 && arena->capacity > ARENA_KEEP_WORDS)
+    {
+        free(arena->words);
+        arena->words = NULL;
+        arena->capacity = 0;
+    }
+}
+
+void pushWork(WorkStack *stack, uint32_t item)
+{
+    if (stack->count == stack->capacity)
+    {
+        if (stack->capacity >= workStackLimit)
+        {
+            reportError("Runtime Error: Program nested deeper than %u levels, see --stack-limit\n", workStackLimit);
+            failInterpreter();
+        }
+        uint32_t capacity = stack->capacity == 0 ? 256 : stack->capacity * 2;
+        if (capacity > workStackLimit)
+        {
+            capacity = workStackLimit;
+        }
+        stack->items = realloc(stack->items, capacity * sizeof(uint32_t));
+        if (stack->items == NULL)
+        {
+            reportError("Runtime Error: Out of memory\n");
+            failInterpreter();
+        }
+        stack->capacity = capacity;
+    }
+    stack->items[stack->count++] = item;
+}
+
+void freeWorkStack(WorkStack *stack)
+{
+    free(stack->items);
+    stack->items = NULL;
+    stack->count = 0;
+    stack->capacity = 0;
+}
+
+// Visit every node reachable from root, statement lists included, parents before children.
+// Stops at the first visit returning non zero and returns that value.
+int forEachNode(NodeRef root, int (*visit)(NodeRef node, void *context), void *context)
+{
+    WorkStack stack = {0};
+    int result = 0;
+
+    if (root != NULL_NODE)
+    {
+        pushWork(&stack, root);
+    }
+    while (stack.count > 0 && result == 0)
+    {
+        NodeRef node = POP_WORK(&stack);
+        result = visit(node, context);
+
+        // The last child of a statement is the next statement of its list
+        NodeRef children[5] = {NULL_NODE};
+        switch (NODE_TYPE(node))
+        {
+        case BinaryOpNode:
+            children[0] = NODE(node, BinaryOpRecord)->left;
+            children[1] = NODE(node, BinaryOpRecord)->right;
+            break;
+        case AssignmentNode:
+            children[0] = NODE(node, AssignmentRecord)->value;
+            children[4] = NEXT_NODE(node);
+            break;
+        case PrintNode:
+            children[0] = NODE(node, PrintRecord)->argument;
+            children[4] = NEXT_NODE(node);
+            break;
+        case FlushNode:
+            children[4] = NEXT_NODE(node);
+            break;
+        case ArrayLiteralNode:
+        {
+            // Any number of elements, pushed here so the first one is visited first
+            ArrayLiteralRecord *record = NODE(node, ArrayLiteralRecord);
+            for (uint32_t i = record->count; i > 0; i--)
+            {
+                pushWork(&stack, record->elements[i - 1]);
+            }
+            break;
+        }
+        case IndexNode:
+            children[0] = NODE(node, IndexRecord)->index;
+            break;
+        case ArrayCallNode:
+            children[0] = NODE(node, ArrayCallRecord)->key;
+            break;
+        case IndexAssignNode:
+            children[0] = NODE(node, IndexAssignRecord)->index;
+            children[1] = NODE(node, IndexAssignRecord)->value;
+            children[4] = NEXT_NODE(node);
+            break;
+        case ArrayOpNode:
+            children[0] = NODE(node, ArrayOpRecord)->first;
+            children[1] = NODE(node, ArrayOpRecord)->second;
+            children[4] = NEXT_NODE(node);
+            break;
+        case IfNode:
+            children[0] = NODE(node, IfRecord)->condition;
+            children[1] = NODE(node, IfRecord)->thenBranch;
+            children[2] = NODE(node, IfRecord)->elseBranch;
+            children[4] = NEXT_NODE(node);
+            break;
+        case ForNode:
+            children[0] = NODE(node, ForRecord)->init;
+            children[1] = NODE(node, ForRecord)->condition;
+            children[2] = NODE(node, ForRecord)->increment;
+            children[3] = NODE(node, ForRecord)->body;
+            children[4] = NEXT_NODE(node);
+            break;
+        case WhileNode:
+            children[0] = NODE(node, WhileRecord)->condition;
+            children[1] = NODE(node, WhileRecord)->body;
+            children[4] = NEXT_NODE(node);
+            break;
+        case ForEachNode:
+            children[0] = NODE(node, ForEachRecord)->body;
+            children[4] = NEXT_NODE(node);
+            break;
+        case FunctionNode:
+            children[0] = NODE(node, FunctionRecord)->body;
+            children[4] = NEXT_NODE(node);
+            break;
+        case ReturnNode:
+            children[0] = NODE(node, ReturnRecord)->value;
+            children[4] = NEXT_NODE(node);
+            break;
+        case CallNode:
+        {
+            // The arguments in order, then the next statement. The callee is not a child.
+            CallRecord *record = NODE(node, CallRecord);
+            if (record->next != NULL_NODE)
+            {
+                pushWork(&stack, record->next);
+            }
+            for (uint32_t i = record->count; i > 0; i--)
+            {
+                pushWork(&stack, record->arguments[i - 1]);
+            }
+            break;
+        }
+        case LocalAssignNode:
+            children[0] = NODE(node, LocalAssignRecord)->value;
+            children[4] = NEXT_NODE(node);
+            break;
+        default:
+            break;
+        }
+
+        for (int i = 4; i >= 0; i--)
+        {
+            if (children[i] != NULL_NODE)
+            {
+                pushWork(&stack, children[i]);
+            }
+        }
+    }
+
+    freeWorkStack(&stack);
+    return result;
+}
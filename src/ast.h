@@ -0,0 +1,271 @@
+#ifndef AST_H
+#define AST_H
+
+#include "intern.h"
+#include <stdint.h>
+
+// Types of AST nodes
+typedef enum
+{
+    NumberNode,
+    IdentifierNode,
+    BinaryOpNode,
+    AssignmentNode,
+    PrintNode,
+    IfNode,
+    ForNode,
+    WhileNode,
+    BlockNode,
+    CharLiteralNode,
+    FlushNode,
+    ArrayLiteralNode,
+    IndexNode,
+    ArrayCallNode,
+    IndexAssignNode,
+    ArrayOpNode,
+    DictLiteralNode,
+    ForEachNode,
+    FunctionNode,
+    ReturnNode,
+    CallNode,
+    LocalNode,
+    LocalAssignNode,
+} ASTNodeType;
+
+// Nodes are referenced by their word offset in the arena, 0 is never a node
+typedef uint32_t NodeRef;
+#define NULL_NODE 0
+
+// First word of every record
+typedef struct
+{
+    uint8_t nodeType;  // ASTNodeType
+    uint8_t tokenType; // For operators
+    uint8_t varType;   // For assignments
+    uint8_t flags;
+} NodeHeader;
+
+// Records, one layout per node type
+
+typedef struct
+{
+    NodeHeader header;
+    int32_t value;
+} NumberRecord;
+
+typedef struct
+{
+    NodeHeader header;
+    InternId name;
+} IdentifierRecord;
+
+// Literal text is stored inline, padded to a whole word
+typedef struct
+{
+    NodeHeader header;
+    uint32_t length;
+    uint32_t hash; // hashBytes of the text, for dict keys
+    char text[];
+} CharLiteralRecord;
+
+typedef struct
+{
+    NodeHeader header;
+    NodeRef left;
+    NodeRef right;
+} BinaryOpRecord;
+
+// [e1, e2, ...], the element expressions follow the record
+typedef struct
+{
+    NodeHeader header;
+    uint32_t count;
+    NodeRef elements[];
+} ArrayLiteralRecord;
+
+// name[index]
+typedef struct
+{
+    NodeHeader header;
+    InternId name;
+    NodeRef index;
+} IndexRecord;
+
+// len(name), sum(name), min(name), max(name) or has(name, key)
+typedef struct
+{
+    NodeHeader header;
+    uint32_t builtin; // ArrayBuiltin
+    InternId name;
+    NodeRef key; // has only
+} ArrayCallRecord;
+
+// Int variable of the running function, read from its frame
+typedef struct
+{
+    NodeHeader header;
+    uint32_t slot;
+} LocalRecord;
+
+// Statements start with the link to the next statement of their block
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+} StatementRecord;
+
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+    InternId name;
+    NodeRef value;
+} AssignmentRecord;
+
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+    NodeRef argument;
+} PrintRecord;
+
+// Assignment to a slot of the running function
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+    uint32_t slot;
+    NodeRef value;
+} LocalAssignRecord;
+
+// name[index] = value;
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+    InternId name;
+    NodeRef index;
+    NodeRef value;
+} IndexAssignRecord;
+
+// push, add, scale, fill, remove or reserve on the array or dict name. add takes the
+// identifier of the second array in first, remove its key, the others their int arguments in order.
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+    uint32_t builtin; // ArrayBuiltin
+    InternId name;
+    NodeRef first;
+    NodeRef second;
+} ArrayOpRecord;
+
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+    NodeRef condition;
+    NodeRef thenBranch;
+    NodeRef elseBranch;
+} IfRecord;
+
+// for (i = a; i < n; i = i + k) with n not assigned in the body, see markCountedLoop
+#define FOR_COUNTED 1
+#define FOR_OBSERVED 2 // The body reads the induction variable
+
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+    NodeRef init;
+    NodeRef condition;
+    NodeRef increment;
+    NodeRef body;
+    int32_t step; // Added to the induction variable by counted loops
+} ForRecord;
+
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+    NodeRef condition;
+    NodeRef body;
+} WhileRecord;
+
+// for (variable in container), the elements of an array or the keys of a dict
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+    InternId variable;
+    InternId container;
+    NodeRef body;
+} ForEachRecord;
+
+// function name(parameters) { body }. The parameters are the first slots of the frame,
+// the other int variables assigned in the body follow them.
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+    InternId name;
+    uint32_t parameterCount;
+    uint32_t localCount; // Slots of a frame, parameters included
+    NodeRef body;
+} FunctionRecord;
+
+// return value; returns 0 without a value. A call as the value is a tail call.
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+    NodeRef value;
+} ReturnRecord;
+
+// Call of a user function, next is only used when the call is a statement
+typedef struct
+{
+    NodeHeader header;
+    NodeRef next;
+    NodeRef function; // FunctionNode declared before the call
+    uint32_t count;
+    NodeRef arguments[];
+} CallRecord;
+
+// Contiguous storage for every node of a program
+typedef struct
+{
+    uint32_t *words;
+    uint32_t count;
+    uint32_t capacity;
+} ASTArena;
+
+// Heap stack used instead of recursion to walk trees of any depth
+typedef struct
+{
+    uint32_t *items;
+    uint32_t count;
+    uint32_t capacity;
+} WorkStack;
+
+// Largest number of entries a work stack may hold, set with --stack-limit
+extern uint32_t workStackLimit;
+
+// Arena functions
+NodeRef allocNode(ASTNodeType nodeType, size_t size);
+void freeAST();
+
+// Tree walking functions
+void pushWork(WorkStack *stack, uint32_t item);
+void freeWorkStack(WorkStack *stack);
+int forEachNode(NodeRef root, int (*visit)(NodeRef node, void *context), void *context);
+
+#define POP_WORK(stack) ((stack)->items[--(stack)->count])
+#define TOP_WORK(stack) ((stack)->items[(stack)->count - 1])
+
+// Access a record of the bound interpreter's arena, the pointer is only valid until the next allocNode call
+#define NODE(ref, Type) ((Type *)(interp->arena.words + (ref)))
+#define NODE_TYPE(ref) (NODE(ref, NodeHeader)->nodeType)
+#define NEXT_NODE(ref) (NODE(ref, StatementRecord)->next)
+
+#endif
@@ -0,0 +1,217 @@
+#include "batch.h"
+#include "cache.h"
+#include "interpreter.h"
+#include "source.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One script, its output waits in memory until every script before it is printed
+typedef struct
+{
+    const char *fileName;
+    char *output;
+    size_t outputLength;
+    int failed;
+    int done;
+} BatchJob;
+
+typedef struct Batch Batch;
+
+// Jobs of one thread, the owner takes them from the head and the other threads steal from the tail
+typedef struct
+{
+    Batch *batch;
+    int index;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int *jobs;
+    int head;
+    int tail;
+} Worker;
+
+struct Batch
+{
+    BatchJob *jobs;
+    Worker *workers;
+    int workerCount;
+    pthread_mutex_t doneLock; // Guards the done flags
+    pthread_cond_t jobDone;
+};
+
+static void *allocOrDie(void *pointer)
+{
+    if (pointer == NULL)
+    {
+        printf("Batch Error: Out of memory\n");
+        exit(1);
+    }
+    return pointer;
+}
+
+// Next job of the worker's own deque, -1 when it is empty
+static int takeJob(Worker *worker)
+{
+    int job = -1;
+    pthread_mutex_lock(&worker->lock);
+    if (worker->head < worker->tail)
+    {
+        job = worker->jobs[worker->head++];
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return job;
+}
+
+// Last job of another worker, -1 when every deque is empty.
+// Jobs are never added, so an empty pass means the batch is drained.
+static int stealJob(Worker *thief)
+{
+    Batch *batch = thief->batch;
+    for (int i = 1; i < batch->workerCount; i++)
+    {
+        Worker *victim = &batch->workers[(thief->index + i) % batch->workerCount];
+        int job = -1;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail)
+        {
+            job = victim->jobs[--victim->tail];
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (job >= 0)
+        {
+            return job;
+        }
+    }
+    return -1;
+}
+
+// Run one script with its own interpreter, the output goes to a memory stream
+static void runJob(BatchJob *job)
+{
+    FILE *out = open_memstream(&job->output, &job->outputLength);
+    if (out == NULL)
+    {
+        job->output = NULL;
+        job->failed = 1;
+        return;
+    }
+
+    SourceBuffer source;
+    if (loadSourceFile(job->fileName, &source) != 0)
+    {
+        fprintf(out, "Input Error: Cannot read '%s'\n", job->fileName);
+        job->failed = 1;
+    }
+    else
+    {
+        Interpreter *interpreter = createInterpreter(out);
+        job->failed = useCache ? runCachedScript(interpreter, job->fileName, source.data, source.length)
+                               : runScript(interpreter, source.data, source.length);
+        destroyInterpreter(interpreter);
+        releaseSource(&source);
+    }
+    fclose(out);
+}
+
+static void *runWorker(void *argument)
+{
+    Worker *worker = argument;
+    Batch *batch = worker->batch;
+    int job;
+
+    while ((job = takeJob(worker)) >= 0 || (job = stealJob(worker)) >= 0)
+    {
+        runJob(&batch->jobs[job]);
+        pthread_mutex_lock(&batch->doneLock);
+        batch->jobs[job].done = 1;
+        pthread_cond_signal(&batch->jobDone);
+        pthread_mutex_unlock(&batch->doneLock);
+    }
+    return NULL;
+}
+
+int runBatch(char **fileNames, int fileCount, int threadCount)
+{
+    if (threadCount > fileCount)
+    {
+        threadCount = fileCount;
+    }
+    if (threadCount < 1)
+    {
+        threadCount = 1;
+    }
+
+    Batch batch;
+    batch.jobs = allocOrDie(calloc(fileCount > 0 ? fileCount : 1, sizeof(BatchJob)));
+    batch.workers = allocOrDie(calloc(threadCount, sizeof(Worker)));
+    batch.workerCount = threadCount;
+    pthread_mutex_init(&batch.doneLock, NULL);
+    pthread_cond_init(&batch.jobDone, NULL);
+
+    // Dealt round robin, so the first scripts finish first and printing can start early
+    for (int i = 0; i < fileCount; i++)
+    {
+        batch.jobs[i].fileName = fileNames[i];
+    }
+    for (int w = 0; w < threadCount; w++)
+    {
+        Worker *worker = &batch.workers[w];
+        worker->batch = &batch;
+        worker->index = w;
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->jobs = allocOrDie(malloc((fileCount / threadCount + 1) * sizeof(int)));
+        for (int i = w; i < fileCount; i += threadCount)
+        {
+            worker->jobs[worker->tail++] = i;
+        }
+    }
+    for (int w = 0; w < threadCount; w++)
+    {
+        if (pthread_create(&batch.workers[w].thread, NULL, runWorker, &batch.workers[w]) != 0)
+        {
+            printf("Batch Error: Cannot start thread %d\n", w);
+            exit(1);
+        }
+    }
+
+    // Print each output as soon as the scripts before it are printed
+    int failures = 0;
+    for (int i = 0; i < fileCount; i++)
+    {
+        BatchJob *job = &batch.jobs[i];
+        pthread_mutex_lock(&batch.doneLock);
+        while (!job->done)
+        {
+            pthread_cond_wait(&batch.jobDone, &batch.doneLock);
+        }
+        pthread_mutex_unlock(&batch.doneLock);
+
+        printf("==> %s <==\n", job->fileName);
+        if (job->output != NULL)
+        {
+            fwrite(job->output, 1, job->outputLength, stdout);
+            free(job->output);
+        }
+        fflush(stdout);
+        failures += job->failed;
+    }
+
+    // Threads may still look into the other deques until they all stopped
+    for (int w = 0; w < threadCount; w++)
+    {
+        pthread_join(batch.workers[w].thread, NULL);
+    }
+    for (int w = 0; w < threadCount; w++)
+    {
+        pthread_mutex_destroy(&batch.workers[w].lock);
+        free(batch.workers[w].jobs);
+    }
+    pthread_mutex_destroy(&batch.doneLock);
+    pthread_cond_destroy(&batch.jobDone);
+    free(batch.workers);
+    free(batch.jobs);
+
+    fprintf(stderr, "Batch: %d scripts on %d threads, %d failed\n", fileCount, threadCount, failures);
+    return failures > 0;
+}
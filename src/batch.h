@@ -0,0 +1,8 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Run independent scripts on threadCount threads, set with --batch FILE... and --threads N.
+// Each output is captured and printed in the order of the files, 1 when any script failed.
+int runBatch(char **fileNames, int fileCount, int threadCount);
+
+#endif
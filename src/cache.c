@@ -0,0 +1,244 @@
+#include "cache.h"
+#include "output.h"
+#include "optimizer.h"
+#include "profile.h"
+#include "emitc.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int useCache = 0;
+const char *cacheDirectory = NULL;
+
+// "INTC" in a little endian file, a machine of the other byte order reads something else
+#define CACHE_MAGIC 0x43544E49u
+
+// Bumped whenever the header or a node record changes, older files are then parsed again
+#define CACHE_VERSION 6
+
+// Start of a cache file. It is followed by wordCount arena words, then the length of each
+// interned name and the names themselves, null terminated in id order. Nodes refer to each
+// other by arena offset, so the file is used in place wherever it is mapped.
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t sourceLength;
+    uint64_t checksum; // Hash of everything after the header
+    uint32_t optimized; // useOptimizer when the file was written
+    uint32_t root;
+    uint32_t wordCount;
+    uint32_t nameCount;
+    uint32_t charCount;
+    uint32_t reserved;
+} CacheHeader;
+
+// A script being run through the cache
+typedef struct
+{
+    const char *buffer;
+    size_t length;
+    uint64_t hash;
+    char path[PATH_MAX];
+    CacheHeader *header; // Mapped file, NULL when the script is parsed
+    size_t mappedSize;
+} CachedScript;
+
+// FNV-1a over 4 byte units. Pieces whose length is a multiple of 4 can be hashed one after
+// the other and give the hash of the whole, the bytes left at the end are mixed one by one.
+static uint64_t hashUnits(uint64_t hash, const void *data, size_t length)
+{
+    const unsigned char *bytes = data;
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4)
+    {
+        uint32_t unit;
+        memcpy(&unit, bytes + i, 4);
+        hash = (hash ^ unit) * 1099511628211ull;
+    }
+    for (; i < length; i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+#define HASH_START 14695981039346656037ull
+
+// File of a script, named after its content in the cache directory
+static int cachePath(CachedScript *script, const char *fileName)
+{
+    int written;
+    if (cacheDirectory != NULL)
+    {
+        if (mkdir(cacheDirectory, 0777) != 0 && errno != EEXIST)
+        {
+            return 1;
+        }
+        written = snprintf(script->path, sizeof(script->path), "%s/%016llx.cache", cacheDirectory,
+                           (unsigned long long)script->hash);
+    }
+    else
+    {
+        written = snprintf(script->path, sizeof(script->path), "%s.cache", fileName);
+    }
+    return written < 0 || (size_t)written >= sizeof(script->path);
+}
+
+// Map the cache file, NULL when it is missing or was written for another source or version.
+// Pages are private, the engines may relink statements while they run.
+static CacheHeader *mapCache(CachedScript *script)
+{
+    int fd = open(script->path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CacheHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)info.st_size;
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    CacheHeader *header = memory;
+    uint64_t payload = (uint64_t)header->wordCount * 4 + (uint64_t)header->nameCount * 4 + header->charCount;
+    if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+        header->sourceHash != script->hash || header->sourceLength != script->length ||
+        header->optimized != (uint32_t)useOptimizer || header->root >= header->wordCount ||
+        payload != size - sizeof(CacheHeader) ||
+        hashUnits(HASH_START, header + 1, size - sizeof(CacheHeader)) != header->checksum)
+    {
+        munmap(memory, size);
+        return NULL;
+    }
+    script->mappedSize = size;
+    return header;
+}
+
+// Write the program and the names next to a temporary name, then rename it over the old file.
+// A cache that can not be written is only a slower start.
+static void storeCache(CachedScript *script, NodeRef root)
+{
+    char temporary[PATH_MAX + 8];
+    snprintf(temporary, sizeof(temporary), "%s.XXXXXX", script->path);
+    int fd = mkstemp(temporary);
+    if (fd < 0)
+    {
+        return;
+    }
+    fchmod(fd, 0644);
+    FILE *file = fdopen(fd, "wb");
+    if (file == NULL)
+    {
+        close(fd);
+        remove(temporary);
+        return;
+    }
+
+    const ASTArena *arena = &interp->arena;
+    const Interner *names = &interp->interner;
+    CacheHeader header = {0};
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.sourceHash = script->hash;
+    header.sourceLength = script->length;
+    header.optimized = (uint32_t)useOptimizer;
+    header.root = root;
+    header.wordCount = arena->count;
+    header.nameCount = names->count;
+    header.charCount = names->charCount;
+    header.checksum = hashUnits(HASH_START, arena->words, arena->count * 4);
+    header.checksum = hashUnits(header.checksum, names->lengths, names->count * 4);
+    header.checksum = hashUnits(header.checksum, names->chars, names->charCount);
+
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1 ||
+                 fwrite(arena->words, 4, arena->count, file) != arena->count ||
+                 fwrite(names->lengths, 4, names->count, file) != names->count ||
+                 fwrite(names->chars, 1, names->charCount, file) != names->charCount;
+    if (fclose(file) != 0 || failed || rename(temporary, script->path) != 0)
+    {
+        remove(temporary);
+    }
+}
+
+// The names are interned in file order, so the ids stored in the nodes stay valid
+static void runMapped(void *context)
+{
+    CachedScript *script = context;
+    const CacheHeader *header = script->header;
+    const uint32_t *lengths = (const uint32_t *)(header + 1) + header->wordCount;
+    const char *text = (const char *)(lengths + header->nameCount);
+
+    for (uint32_t id = 0; id < header->nameCount; id++)
+    {
+        if (internString(text, lengths[id]) != id)
+        {
+            reportError("Cache Error: Invalid names in %s\n", script->path);
+            failInterpreter();
+        }
+        text += lengths[id] + 1;
+    }
+    setInputBuffer(script->buffer, script->length);
+    executeProgram(header->root);
+}
+
+static void runParsed(void *context)
+{
+    CachedScript *script = context;
+    uint32_t removed;
+
+    setInputBuffer(script->buffer, script->length);
+    NodeRef root = parseProgram();
+    if (useOptimizer)
+    {
+        root = optimizeProgram(root, &removed);
+    }
+    storeCache(script, root);
+    executeProgram(root);
+    freeAST();
+}
+
+// Run a script file like runScript, without parsing it when its cache file is still valid
+int runCachedScript(Interpreter *interpreter, const char *fileName, const char *buffer, size_t length)
+{
+    // Statement positions, streaming and C output all need the parser
+    if (useProfiler || streamStatements || emitCFile != NULL || compileOutput != NULL)
+    {
+        return runScript(interpreter, buffer, length);
+    }
+
+    CachedScript script = {buffer, length, hashUnits(HASH_START, buffer, length), {0}, NULL, 0};
+    if (cachePath(&script, fileName) != 0)
+    {
+        return runScript(interpreter, buffer, length);
+    }
+
+    // Stored ids only match an interpreter that has not interned anything yet
+    if (interpreter->interner.count == 0 && (script.header = mapCache(&script)) != NULL)
+    {
+        // The mapped nodes are lent to the interpreter for the run, like a compiled program
+        ASTArena scratch = interpreter->arena;
+        interpreter->arena.words = (uint32_t *)(script.header + 1);
+        interpreter->arena.count = script.header->wordCount;
+        interpreter->arena.capacity = script.header->wordCount;
+        int failed = guardInterpreter(interpreter, runMapped, &script);
+        interpreter->arena = scratch;
+        munmap(script.header, script.mappedSize);
+        return failed;
+    }
+    return guardInterpreter(interpreter, runParsed, &script);
+}
@@ -0,0 +1,14 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "interpreter.h"
+
+// Keep the parsed program of each script file on disk, set with --cache (next to the script)
+// or --cache-dir DIR (files named by the hash of the source)
+extern int useCache;
+extern const char *cacheDirectory;
+
+// Cache functions
+int runCachedScript(Interpreter *interpreter, const char *fileName, const char *buffer, size_t length);
+
+#endif
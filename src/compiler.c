@@ -0,0 +1,922 @@
+#include "compiler.h"
+#include "interpreter.h"
+#include "output.h"
+#include "array.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Function prototypes
+static void compileStatement(Chunk *chunk, NodeRef node, int *depth);
+static void compileBlock(Chunk *chunk, NodeRef node, int *depth);
+static void compileExpression(Chunk *chunk, NodeRef node, int *depth);
+
+void initChunk(Chunk *chunk)
+{
+    memset(chunk, 0, sizeof(Chunk));
+}
+
+// Empty the chunk but keep its buffers for the next compilation
+void resetChunk(Chunk *chunk)
+{
+    chunk->count = 0;
+    chunk->stringCount = 0;
+    chunk->maxStack = 0;
+    chunk->slotCount = 0;
+}
+
+void freeChunk(Chunk *chunk)
+{
+    free(chunk->code);
+    free(chunk->strings);
+    initChunk(chunk);
+}
+
+const char *opCodeToString(OpCode op)
+{
+    switch (op)
+    {
+    case OP_CONST:
+        return "CONST";
+    case OP_LOAD:
+        return "LOAD";
+    case OP_STORE_INT:
+        return "STORE_INT";
+    case OP_STORE_STRING:
+        return "STORE_STRING";
+    case OP_ADD:
+        return "ADD";
+    case OP_SUB:
+        return "SUB";
+    case OP_MUL:
+        return "MUL";
+    case OP_DIV:
+        return "DIV";
+    case OP_MOD:
+        return "MOD";
+    case OP_LT:
+        return "LT";
+    case OP_LE:
+        return "LE";
+    case OP_GT:
+        return "GT";
+    case OP_GE:
+        return "GE";
+    case OP_NE:
+        return "NE";
+    case OP_JUMP:
+        return "JUMP";
+    case OP_JUMP_IF_FALSE:
+        return "JUMP_IF_FALSE";
+    case OP_PRINT:
+        return "PRINT";
+    case OP_PRINT_INT:
+        return "PRINT_INT";
+    case OP_PRINT_STRING:
+        return "PRINT_STRING";
+    case OP_FLUSH:
+        return "FLUSH";
+    case OP_STORE_CONCAT:
+        return "STORE_CONCAT";
+    case OP_PRINT_CONCAT:
+        return "PRINT_CONCAT";
+    case OP_LOAD_SLOT:
+        return "LOAD_SLOT";
+    case OP_FOR_ENTER:
+        return "FOR_ENTER";
+    case OP_FOR_STEP:
+        return "FOR_STEP";
+    case OP_LOAD_INDEX:
+        return "LOAD_INDEX";
+    case OP_STORE_INDEX:
+        return "STORE_INDEX";
+    case OP_ARRAY_CALL:
+        return "ARRAY_CALL";
+    case OP_ARRAY_OP:
+        return "ARRAY_OP";
+    case OP_STORE_ARRAY:
+        return "STORE_ARRAY";
+    case OP_COPY_ARRAY:
+        return "COPY_ARRAY";
+    case OP_LOAD_KEYED:
+        return "LOAD_KEYED";
+    case OP_STORE_KEYED:
+        return "STORE_KEYED";
+    case OP_STORE_DICT:
+        return "STORE_DICT";
+    case OP_COPY_DICT:
+        return "COPY_DICT";
+    case OP_EACH:
+        return "EACH";
+    case OP_LOAD_LOCAL:
+        return "LOAD_LOCAL";
+    case OP_STORE_LOCAL:
+        return "STORE_LOCAL";
+    case OP_POP:
+        return "POP";
+    case OP_CALL:
+        return "CALL";
+    case OP_TAIL_CALL:
+        return "TAIL_CALL";
+    case OP_RETURN:
+        return "RETURN";
+    case OP_HALT:
+        return "HALT";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+// Number of operand words following an opcode
+int opCodeOperands(OpCode op)
+{
+    switch (op)
+    {
+    case OP_FOR_STEP:
+    case OP_ARRAY_OP:
+    case OP_CALL:
+    case OP_TAIL_CALL:
+        return 4;
+    case OP_FOR_ENTER:
+    case OP_ARRAY_CALL:
+    case OP_EACH:
+        return 3;
+    case OP_STORE_STRING:
+    case OP_STORE_CONCAT:
+    case OP_STORE_ARRAY:
+    case OP_COPY_ARRAY:
+    case OP_LOAD_KEYED:
+    case OP_STORE_KEYED:
+    case OP_COPY_DICT:
+        return 2;
+    case OP_CONST:
+    case OP_LOAD:
+    case OP_STORE_INT:
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_PRINT:
+    case OP_PRINT_STRING:
+    case OP_PRINT_CONCAT:
+    case OP_LOAD_SLOT:
+    case OP_LOAD_INDEX:
+    case OP_STORE_INDEX:
+    case OP_STORE_DICT:
+    case OP_LOAD_LOCAL:
+    case OP_STORE_LOCAL:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Induction variables of the counted loops being compiled live in interp->loopSlots, innermost last
+
+// Stack slot holding the induction variable name, -1 when it lives in the symbol table
+static int loopSlot(InternId name)
+{
+    for (int i = interp->loopSlotCount - 1; i >= 0; i--)
+    {
+        if (interp->loopSlots[i].name == name)
+        {
+            return interp->loopSlots[i].slot;
+        }
+    }
+    return -1;
+}
+
+// Key the VM resolves from the tree: a string or a variable outside the loop slots
+static int isNamedKey(NodeRef node)
+{
+    return NODE_TYPE(node) == CharLiteralNode || IS_CONCATENATION(node) ||
+           (NODE_TYPE(node) == IdentifierNode && loopSlot(NODE(node, IdentifierRecord)->name) < 0);
+}
+
+// Append one word (opcode or operand) and return its position
+static int emit(Chunk *chunk, int32_t word)
+{
+    if (chunk->count == chunk->capacity)
+    {
+        chunk->capacity = chunk->capacity == 0 ? 256 : chunk->capacity * 2;
+        chunk->code = realloc(chunk->code, chunk->capacity * sizeof(int32_t));
+        if (chunk->code == NULL)
+        {
+            reportError("Compiler Error: Out of memory\n");
+            failInterpreter();
+        }
+    }
+    chunk->code[chunk->count] = word;
+    return chunk->count++;
+}
+
+// Emit a jump with a placeholder target and return the operand position
+static int emitJump(Chunk *chunk, OpCode op)
+{
+    emit(chunk, op);
+    return emit(chunk, -1);
+}
+
+static void patchJump(Chunk *chunk, int operand, int target)
+{
+    chunk->code[operand] = target;
+}
+
+static int stringIndex(Chunk *chunk, const char *value)
+{
+    if (chunk->stringCount == chunk->stringCapacity)
+    {
+        chunk->stringCapacity = chunk->stringCapacity == 0 ? 16 : chunk->stringCapacity * 2;
+        chunk->strings = realloc(chunk->strings, chunk->stringCapacity * sizeof(const char *));
+        if (chunk->strings == NULL)
+        {
+            reportError("Compiler Error: Out of memory\n");
+            failInterpreter();
+        }
+    }
+    chunk->strings[chunk->stringCount] = value;
+    return chunk->stringCount++;
+}
+
+// Track the operand stack depth so the VM can size its stack once
+static void push(Chunk *chunk, int *depth)
+{
+    (*depth)++;
+    if (*depth > chunk->maxStack)
+    {
+        chunk->maxStack = *depth;
+    }
+}
+
+// The entry and frame size of the callee are patched by compileFunctions once its body is compiled
+static void emitCall(Chunk *chunk, OpCode op, NodeRef node)
+{
+    CallRecord *call = NODE(node, CallRecord);
+    emit(chunk, op);
+    pushWork(&interp->pendingCalls, (uint32_t)emit(chunk, -1));
+    pushWork(&interp->pendingCalls, call->function);
+    emit(chunk, (int32_t)call->count);
+    emit(chunk, (int32_t)NODE(call->function, FunctionRecord)->localCount);
+    emit(chunk, -1);
+}
+
+static OpCode binaryOpCode(TokenType type)
+{
+    switch (type)
+    {
+    case Add:
+        return OP_ADD;
+    case Sub:
+        return OP_SUB;
+    case Mul:
+        return OP_MUL;
+    case Div:
+        return OP_DIV;
+    case Mod:
+        return OP_MOD;
+    case Lt:
+        return OP_LT;
+    case Le:
+        return OP_LE;
+    case Gt:
+        return OP_GT;
+    case Ge:
+        return OP_GE;
+    case Ne:
+        return OP_NE;
+    default:
+        reportError("Compiler Error: Unknown binary operator '%d'\n", type);
+        failInterpreter();
+    }
+}
+
+// Pending nodes of compileExpression go to interp->compileStack, an operator or an element
+// sits under a NULL_NODE marker until its operands are emitted
+// Emit a leaf, or schedule the operands of a binary operator or the index of an element
+static void compileOperand(Chunk *chunk, NodeRef node, int *depth)
+{
+    switch (NODE_TYPE(node))
+    {
+    case NumberNode:
+        emit(chunk, OP_CONST);
+        emit(chunk, NODE(node, NumberRecord)->value);
+        push(chunk, depth);
+        break;
+
+    case CharLiteralNode:
+        emit(chunk, OP_CONST);
+        emit(chunk, NODE(node, CharLiteralRecord)->text[0]);
+        push(chunk, depth);
+        break;
+
+    case IdentifierNode:
+    {
+        InternId name = NODE(node, IdentifierRecord)->name;
+        int slot = loopSlot(name);
+        emit(chunk, slot >= 0 ? OP_LOAD_SLOT : OP_LOAD);
+        emit(chunk, slot >= 0 ? slot : (int32_t)name);
+        push(chunk, depth);
+        break;
+    }
+
+    case ArrayCallNode:
+    {
+        NodeRef key = NODE(node, ArrayCallRecord)->key;
+        if (key != NULL_NODE && !isNamedKey(key))
+        {
+            pushWork(&interp->compileStack, node);
+            pushWork(&interp->compileStack, NULL_NODE);
+            pushWork(&interp->compileStack, key);
+            break;
+        }
+        emit(chunk, OP_ARRAY_CALL);
+        emit(chunk, NODE(node, ArrayCallRecord)->builtin);
+        emit(chunk, NODE(node, ArrayCallRecord)->name);
+        emit(chunk, key);
+        push(chunk, depth);
+        break;
+    }
+
+    case IndexNode:
+        if (isNamedKey(NODE(node, IndexRecord)->index))
+        {
+            emit(chunk, OP_LOAD_KEYED);
+            emit(chunk, NODE(node, IndexRecord)->name);
+            emit(chunk, NODE(node, IndexRecord)->index);
+            push(chunk, depth);
+            break;
+        }
+        pushWork(&interp->compileStack, node);
+        pushWork(&interp->compileStack, NULL_NODE);
+        pushWork(&interp->compileStack, NODE(node, IndexRecord)->index);
+        break;
+
+    case BinaryOpNode:
+        pushWork(&interp->compileStack, node);
+        pushWork(&interp->compileStack, NULL_NODE);
+        pushWork(&interp->compileStack, NODE(node, BinaryOpRecord)->right);
+        pushWork(&interp->compileStack, NODE(node, BinaryOpRecord)->left);
+        break;
+
+    case LocalNode:
+        emit(chunk, OP_LOAD_LOCAL);
+        emit(chunk, (int32_t)NODE(node, LocalRecord)->slot);
+        push(chunk, depth);
+        break;
+
+    case CallNode:
+    {
+        // Arguments are pushed in source order
+        CallRecord *record = NODE(node, CallRecord);
+        pushWork(&interp->compileStack, node);
+        pushWork(&interp->compileStack, NULL_NODE);
+        for (uint32_t i = record->count; i > 0; i--)
+        {
+            pushWork(&interp->compileStack, record->arguments[i - 1]);
+        }
+        break;
+    }
+
+    default:
+        reportError("Compiler Error: Unexpected node type '%d' in expression\n", NODE_TYPE(node));
+        failInterpreter();
+    }
+}
+
+static void compileExpression(Chunk *chunk, NodeRef root, int *depth)
+{
+    uint32_t base = interp->compileStack.count;
+    pushWork(&interp->compileStack, root);
+
+    while (interp->compileStack.count > base)
+    {
+        NodeRef node = POP_WORK(&interp->compileStack);
+        if (node == NULL_NODE)
+        {
+            node = POP_WORK(&interp->compileStack);
+            if (NODE_TYPE(node) == IndexNode)
+            {
+                emit(chunk, OP_LOAD_INDEX);
+                emit(chunk, NODE(node, IndexRecord)->name);
+                continue;
+            }
+            if (NODE_TYPE(node) == ArrayCallNode)
+            {
+                emit(chunk, OP_ARRAY_CALL);
+                emit(chunk, NODE(node, ArrayCallRecord)->builtin);
+                emit(chunk, NODE(node, ArrayCallRecord)->name);
+                emit(chunk, NULL_NODE);
+                continue;
+            }
+            if (NODE_TYPE(node) == CallNode)
+            {
+                emitCall(chunk, OP_CALL, node);
+                *depth -= (int)NODE(node, CallRecord)->count;
+                push(chunk, depth);
+                continue;
+            }
+            emit(chunk, binaryOpCode(NODE(node, BinaryOpRecord)->header.tokenType));
+            (*depth)--;
+            continue;
+        }
+        compileOperand(chunk, node, depth);
+    }
+}
+
+static void compileAssignment(Chunk *chunk, NodeRef node, int *depth)
+{
+    if (NODE_TYPE(node) == LocalAssignNode)
+    {
+        compileExpression(chunk, NODE(node, LocalAssignRecord)->value, depth);
+        emit(chunk, OP_STORE_LOCAL);
+        emit(chunk, (int32_t)NODE(node, LocalAssignRecord)->slot);
+        (*depth)--;
+        return;
+    }
+
+    AssignmentRecord *record = NODE(node, AssignmentRecord);
+    InternId name = record->name;
+
+    if (record->header.varType == TYPE_CHAR)
+    {
+        if (NODE_TYPE(record->value) == CharLiteralNode)
+        {
+            emit(chunk, OP_STORE_STRING);
+            emit(chunk, name);
+            emit(chunk, stringIndex(chunk, NODE(record->value, CharLiteralRecord)->text));
+        }
+        else
+        {
+            // Joined from the tree, errors are reported when reached like the tree-walker does
+            emit(chunk, OP_STORE_CONCAT);
+            emit(chunk, name);
+            emit(chunk, record->value);
+        }
+        return;
+    }
+
+    if (record->header.varType == TYPE_ARRAY)
+    {
+        if (NODE_TYPE(record->value) == ArrayLiteralNode)
+        {
+            uint32_t count = NODE(record->value, ArrayLiteralRecord)->count;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                compileExpression(chunk, NODE(record->value, ArrayLiteralRecord)->elements[i], depth);
+            }
+            emit(chunk, OP_STORE_ARRAY);
+            emit(chunk, name);
+            emit(chunk, (int32_t)count);
+            *depth -= (int)count;
+        }
+        else
+        {
+            emit(chunk, OP_COPY_ARRAY);
+            emit(chunk, name);
+            emit(chunk, NODE(record->value, IdentifierRecord)->name);
+        }
+        return;
+    }
+
+    if (record->header.varType == TYPE_DICT)
+    {
+        if (NODE_TYPE(record->value) == DictLiteralNode)
+        {
+            emit(chunk, OP_STORE_DICT);
+            emit(chunk, name);
+        }
+        else
+        {
+            emit(chunk, OP_COPY_DICT);
+            emit(chunk, name);
+            emit(chunk, NODE(record->value, IdentifierRecord)->name);
+        }
+        return;
+    }
+
+    compileExpression(chunk, record->value, depth);
+    emit(chunk, OP_STORE_INT);
+    emit(chunk, name);
+    (*depth)--;
+}
+
+// What is left to emit once a block is compiled waits on the compile stack under the expressions,
+// a frame is its words with its kind on top
+typedef enum
+{
+    COMPILE_LIST,    // next statement
+    COMPILE_ELSE,    // else branch, jump over the then branch
+    COMPILE_END_IF,  // jump over the else branch
+    COMPILE_LOOP,    // loop start, exit jump, values popped at the exit
+    COMPILE_FOR,     // increment, loop start, exit jump
+    COMPILE_COUNTED, // loop node, loop start, exit jump
+} CompileKind;
+
+static void pushCompile(uint32_t word)
+{
+    pushWork(&interp->compileStack, word);
+}
+
+// The statements of a block are compiled next, then the frame under them is finished
+static void beginBody(NodeRef body)
+{
+    pushCompile(body);
+    pushCompile(COMPILE_LIST);
+}
+
+// i and its bound stay on the operand stack, the body reads i with OP_LOAD_SLOT
+// and the symbol table is only written when the loop exits
+static void compileCountedLoop(Chunk *chunk, NodeRef node, int *depth)
+{
+    ForRecord *record = NODE(node, ForRecord);
+    AssignmentRecord *init = NODE(record->init, AssignmentRecord);
+    BinaryOpRecord *condition = NODE(record->condition, BinaryOpRecord);
+    OpCode compare = binaryOpCode(condition->header.tokenType);
+    InternId name = init->name;
+    int slot = *depth;
+
+    compileExpression(chunk, init->value, depth);
+    compileExpression(chunk, condition->right, depth);
+    emit(chunk, OP_FOR_ENTER);
+    emit(chunk, compare);
+    emit(chunk, name);
+    int exitJump = emit(chunk, -1);
+
+    interp->loopSlots[interp->loopSlotCount].name = name;
+    interp->loopSlots[interp->loopSlotCount].slot = slot;
+    interp->loopSlotCount++;
+    pushCompile(node);
+    pushCompile((uint32_t)chunk->count);
+    pushCompile((uint32_t)exitJump);
+    pushCompile(COMPILE_COUNTED);
+    beginBody(record->body);
+}
+
+static void endCountedLoop(Chunk *chunk, NodeRef node, int loopStart, int exitJump, int *depth)
+{
+    ForRecord *record = NODE(node, ForRecord);
+    interp->loopSlotCount--;
+    emit(chunk, OP_FOR_STEP);
+    emit(chunk, binaryOpCode(NODE(record->condition, BinaryOpRecord)->header.tokenType));
+    emit(chunk, NODE(record->init, AssignmentRecord)->name);
+    emit(chunk, record->step);
+    emit(chunk, loopStart);
+    patchJump(chunk, exitJump, chunk->count);
+    *depth -= 2;
+}
+
+// The end of a loop whose body was compiled
+static void endLoop(Chunk *chunk, int loopStart, int exitJump)
+{
+    emit(chunk, OP_JUMP);
+    emit(chunk, loopStart);
+    patchJump(chunk, exitJump, chunk->count);
+}
+
+static void compileStatement(Chunk *chunk, NodeRef node, int *depth)
+{
+    switch (NODE_TYPE(node))
+    {
+    case AssignmentNode:
+    case LocalAssignNode:
+        compileAssignment(chunk, node, depth);
+        break;
+
+    case PrintNode:
+    {
+        NodeRef argument = NODE(node, PrintRecord)->argument;
+        if (NODE_TYPE(argument) == IdentifierNode && loopSlot(NODE(argument, IdentifierRecord)->name) < 0)
+        {
+            emit(chunk, OP_PRINT);
+            emit(chunk, NODE(argument, IdentifierRecord)->name);
+        }
+        else if (NODE_TYPE(argument) == CharLiteralNode)
+        {
+            emit(chunk, OP_PRINT_STRING);
+            emit(chunk, stringIndex(chunk, NODE(argument, CharLiteralRecord)->text));
+        }
+        else if (IS_CONCATENATION(argument))
+        {
+            // Joined from the tree like a string assignment
+            emit(chunk, OP_PRINT_CONCAT);
+            emit(chunk, argument);
+        }
+        else
+        {
+            compileExpression(chunk, argument, depth);
+            emit(chunk, OP_PRINT_INT);
+            (*depth)--;
+        }
+        break;
+    }
+
+    case FlushNode:
+        emit(chunk, OP_FLUSH);
+        break;
+
+    case IndexAssignNode:
+    {
+        IndexAssignRecord *record = NODE(node, IndexAssignRecord);
+        if (isNamedKey(record->index))
+        {
+            compileExpression(chunk, record->value, depth);
+            emit(chunk, OP_STORE_KEYED);
+            emit(chunk, record->name);
+            emit(chunk, record->index);
+            (*depth)--;
+            break;
+        }
+        compileExpression(chunk, record->index, depth);
+        compileExpression(chunk, record->value, depth);
+        emit(chunk, OP_STORE_INDEX);
+        emit(chunk, record->name);
+        *depth -= 2;
+        break;
+    }
+
+    case ArrayOpNode:
+    {
+        ArrayOpRecord *record = NODE(node, ArrayOpRecord);
+        int arguments = builtinArguments(record->builtin);
+        InternId other = 0;
+        NodeRef key = NULL_NODE;
+        if (record->builtin == BUILTIN_ADD)
+        {
+            other = NODE(record->first, IdentifierRecord)->name;
+        }
+        else if (record->builtin == BUILTIN_REMOVE)
+        {
+            if (isNamedKey(record->first))
+            {
+                key = record->first;
+            }
+            else
+            {
+                compileExpression(chunk, record->first, depth);
+                arguments = 1;
+            }
+        }
+        else
+        {
+            for (int i = 0; i < arguments; i++)
+            {
+                compileExpression(chunk, i == 0 ? record->first : record->second, depth);
+            }
+        }
+        emit(chunk, OP_ARRAY_OP);
+        emit(chunk, record->builtin);
+        emit(chunk, record->name);
+        emit(chunk, other);
+        emit(chunk, key);
+        *depth -= arguments;
+        break;
+    }
+
+    case IfNode:
+    {
+        IfRecord *record = NODE(node, IfRecord);
+        compileExpression(chunk, record->condition, depth);
+        int elseJump = emitJump(chunk, OP_JUMP_IF_FALSE);
+        (*depth)--;
+        pushCompile(record->elseBranch);
+        pushCompile((uint32_t)elseJump);
+        pushCompile(COMPILE_ELSE);
+        beginBody(record->thenBranch);
+        break;
+    }
+
+    case ForNode:
+    {
+        ForRecord *record = NODE(node, ForRecord);
+        if ((record->header.flags & FOR_COUNTED) && interp->loopSlotCount < MAX_LOOP_SLOTS)
+        {
+            compileCountedLoop(chunk, node, depth);
+            break;
+        }
+        compileAssignment(chunk, record->init, depth);
+        int loopStart = chunk->count;
+        compileExpression(chunk, record->condition, depth);
+        int exitJump = emitJump(chunk, OP_JUMP_IF_FALSE);
+        (*depth)--;
+        pushCompile(record->increment);
+        pushCompile((uint32_t)loopStart);
+        pushCompile((uint32_t)exitJump);
+        pushCompile(COMPILE_FOR);
+        beginBody(record->body);
+        break;
+    }
+
+    case WhileNode:
+    {
+        WhileRecord *record = NODE(node, WhileRecord);
+        int loopStart = chunk->count;
+        compileExpression(chunk, record->condition, depth);
+        int exitJump = emitJump(chunk, OP_JUMP_IF_FALSE);
+        (*depth)--;
+        pushCompile((uint32_t)loopStart);
+        pushCompile((uint32_t)exitJump);
+        pushCompile(0);
+        pushCompile(COMPILE_LOOP);
+        beginBody(record->body);
+        break;
+    }
+
+    case ForEachNode:
+    {
+        // The position stays on the operand stack while the body runs
+        ForEachRecord *record = NODE(node, ForEachRecord);
+        emit(chunk, OP_CONST);
+        emit(chunk, 0);
+        push(chunk, depth);
+        int loopStart = emit(chunk, OP_EACH);
+        emit(chunk, record->container);
+        emit(chunk, record->variable);
+        int exitJump = emit(chunk, -1);
+        pushCompile((uint32_t)loopStart);
+        pushCompile((uint32_t)exitJump);
+        pushCompile(1);
+        pushCompile(COMPILE_LOOP);
+        beginBody(record->body);
+        break;
+    }
+
+    case FunctionNode:
+        // The body is compiled after OP_HALT by compileFunctions, when a call needs it
+        break;
+
+    case CallNode:
+        compileExpression(chunk, node, depth);
+        emit(chunk, OP_POP);
+        (*depth)--;
+        break;
+
+    case ReturnNode:
+    {
+        NodeRef value = NODE(node, ReturnRecord)->value;
+        if (value == NULL_NODE)
+        {
+            emit(chunk, OP_CONST);
+            emit(chunk, 0);
+            push(chunk, depth);
+        }
+        else if (NODE_TYPE(value) == CallNode)
+        {
+            // The arguments are moved over the running frame, nothing is left to return to
+            CallRecord *call = NODE(value, CallRecord);
+            for (uint32_t i = 0; i < call->count; i++)
+            {
+                compileExpression(chunk, call->arguments[i], depth);
+            }
+            emitCall(chunk, OP_TAIL_CALL, value);
+            *depth -= (int)call->count;
+            break;
+        }
+        else
+        {
+            compileExpression(chunk, value, depth);
+        }
+        emit(chunk, OP_RETURN);
+        (*depth)--;
+        break;
+    }
+
+    default:
+        reportError("Compiler Error: Unexpected node type '%d' in statement\n", NODE_TYPE(node));
+        failInterpreter();
+    }
+}
+
+// A statement list with the blocks nested in it, without recursion
+static void compileBlock(Chunk *chunk, NodeRef node, int *depth)
+{
+    WorkStack *work = &interp->compileStack;
+    uint32_t base = work->count;
+    beginBody(node);
+
+    while (work->count > base)
+    {
+        switch ((CompileKind)POP_WORK(work))
+        {
+        case COMPILE_LIST:
+            node = POP_WORK(work);
+            if (node != NULL_NODE)
+            {
+                beginBody(NEXT_NODE(node));
+                compileStatement(chunk, node, depth);
+            }
+            break;
+
+        case COMPILE_ELSE:
+        {
+            int elseJump = (int)POP_WORK(work);
+            NodeRef elseBranch = POP_WORK(work);
+            if (elseBranch == NULL_NODE)
+            {
+                patchJump(chunk, elseJump, chunk->count);
+                break;
+            }
+            int endJump = emitJump(chunk, OP_JUMP);
+            patchJump(chunk, elseJump, chunk->count);
+            pushCompile((uint32_t)endJump);
+            pushCompile(COMPILE_END_IF);
+            beginBody(elseBranch);
+            break;
+        }
+
+        case COMPILE_END_IF:
+            patchJump(chunk, (int)POP_WORK(work), chunk->count);
+            break;
+
+        case COMPILE_LOOP:
+        {
+            // The position of a loop over an array or a dict is popped at the exit
+            int popped = (int)POP_WORK(work);
+            int exitJump = (int)POP_WORK(work);
+            int loopStart = (int)POP_WORK(work);
+            endLoop(chunk, loopStart, exitJump);
+            *depth -= popped;
+            break;
+        }
+
+        case COMPILE_FOR:
+        {
+            int exitJump = (int)POP_WORK(work);
+            int loopStart = (int)POP_WORK(work);
+            compileAssignment(chunk, POP_WORK(work), depth);
+            endLoop(chunk, loopStart, exitJump);
+            break;
+        }
+
+        case COMPILE_COUNTED:
+        {
+            int exitJump = (int)POP_WORK(work);
+            int loopStart = (int)POP_WORK(work);
+            endCountedLoop(chunk, POP_WORK(work), loopStart, exitJump, depth);
+            break;
+        }
+        }
+    }
+}
+
+// Compile the body of each called function after the program, once, and patch the calls to it.
+// Bodies add their own calls to the list while it is walked.
+static void compileFunctions(Chunk *chunk)
+{
+    WorkStack *compiled = &interp->compiledFunctions;
+    WorkStack *pending = &interp->pendingCalls;
+    for (uint32_t i = 0; i < pending->count; i += 2)
+    {
+        int operand = (int)pending->items[i];
+        NodeRef function = pending->items[i + 1];
+        uint32_t found = 0;
+        while (found < compiled->count && compiled->items[found] != function)
+        {
+            found += 3;
+        }
+        if (found == compiled->count)
+        {
+            // The frame holds the return address, the caller frame, the slots and the operand stack
+            FunctionRecord *record = NODE(function, FunctionRecord);
+            int outerStack = chunk->maxStack;
+            int depth = 0;
+            int entry = chunk->count;
+            chunk->maxStack = 0;
+            compileBlock(chunk, record->body, &depth);
+            emit(chunk, OP_CONST);
+            emit(chunk, 0);
+            push(chunk, &depth);
+            emit(chunk, OP_RETURN);
+            pushWork(compiled, function);
+            pushWork(compiled, (uint32_t)entry);
+            pushWork(compiled, (uint32_t)(2 + record->localCount + chunk->maxStack));
+            chunk->maxStack = outerStack;
+        }
+        chunk->code[operand] = (int32_t)compiled->items[found + 1];
+        chunk->code[operand + 3] = (int32_t)compiled->items[found + 2];
+    }
+}
+
+// Lower a statement list into linear bytecode ending with OP_HALT, the functions it calls follow
+void compileProgram(NodeRef program, Chunk *chunk)
+{
+    int slots = (int)topLevelSlots(program);
+    if (slots > chunk->slotCount)
+    {
+        chunk->slotCount = slots;
+    }
+    int depth = chunk->slotCount;
+    chunk->maxStack = depth;
+    interp->compiledFunctions.count = 0;
+    interp->pendingCalls.count = 0;
+    compileBlock(chunk, program, &depth);
+    emit(chunk, OP_HALT);
+    compileFunctions(chunk);
+
+    TRACE(TRACE_COMPILER, TRACE_INFO, EV_COMPILE_END, chunk->count, chunk->maxStack, 0);
+    if (TRACE_ENABLED(TRACE_COMPILER, TRACE_DETAIL))
+    {
+        for (int pc = 0; pc < chunk->count; pc += 1 + opCodeOperands(chunk->code[pc]))
+        {
+            int32_t operand = opCodeOperands(chunk->code[pc]) > 0 ? chunk->code[pc + 1] : 0;
+            traceRecord(TRACE_COMPILER, TRACE_DETAIL, EV_COMPILE_OP, pc, chunk->code[pc], operand);
+        }
+    }
+}
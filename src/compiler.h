@@ -0,0 +1,87 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "parser.h"
+#include <stdint.h>
+
+// Bytecode instructions, each opcode is followed by its operands in the code array
+typedef enum
+{
+    OP_CONST,         // Push an integer constant (operand: value)
+    OP_LOAD,          // Push an int variable (operand: interned name)
+    OP_STORE_INT,     // Pop a value into an int variable (operand: interned name)
+    OP_STORE_STRING,  // Store a string constant (operands: interned name, string index)
+    OP_ADD,           // Binary operators pop two values and push the result
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_NE,
+    OP_JUMP,          // Unconditional jump (operand: absolute target)
+    OP_JUMP_IF_FALSE, // Pop a value and jump if it is zero (operand: absolute target)
+    OP_PRINT,         // Print a variable (operand: interned name)
+    OP_PRINT_INT,     // Pop and print an integer
+    OP_PRINT_STRING,  // Print a string constant (operand: string index)
+    OP_FLUSH,         // Write the buffered output
+    OP_STORE_CONCAT,  // Store a string expression, see assignStringExpression (operands: interned name, node)
+    OP_PRINT_CONCAT,  // Print a string expression, see joinStringExpression (operand: node)
+    OP_LOAD_SLOT,     // Push an operand stack slot (operand: slot)
+    OP_FOR_ENTER,     // Counted loop with [i, bound] on the stack, leave it if the comparison fails
+                      // (operands: comparison opcode, interned name, exit target)
+    OP_FOR_STEP,      // Add the step to i and jump back while the comparison holds
+                      // (operands: comparison opcode, interned name, step, loop target)
+    OP_LOAD_INDEX,    // Replace the index on top of the stack by the element (operand: interned name)
+    OP_STORE_INDEX,   // Pop a value and an index into an element (operand: interned name)
+    OP_ARRAY_CALL,    // Push len, sum, min, max or has, an int key of has is popped first
+                      // (operands: builtin, interned name, key node or NULL_NODE)
+    OP_ARRAY_OP,      // Pop the int arguments of push, scale, fill or reserve, the int key of remove, or run add
+                      // (operands: builtin, interned name, second array of add, key node of remove or NULL_NODE)
+    OP_STORE_ARRAY,   // Pop count elements into an array variable (operands: interned name, count)
+    OP_COPY_ARRAY,    // Copy an array variable (operands: interned name, source name)
+    OP_LOAD_KEYED,    // Push the element at a literal or variable key (operands: interned name, key node)
+    OP_STORE_KEYED,   // Pop a value into the element at a literal or variable key (operands: interned name, key node)
+    OP_STORE_DICT,    // Store an empty dict (operand: interned name)
+    OP_COPY_DICT,     // Copy a dict variable (operands: interned name, source name)
+    OP_EACH,          // Give the variable the next element or key, the position is on top of the stack.
+                      // At the end pop it and jump (operands: container name, variable name, exit target)
+    OP_LOAD_LOCAL,    // Push a slot of the running function (operand: slot)
+    OP_STORE_LOCAL,   // Pop a value into a slot of the running function (operand: slot)
+    OP_POP,           // Drop the value on top of the stack
+    OP_CALL,          // Turn the arguments on top of the stack into the first slots of a new frame
+                      // (operands: entry, argument count, slot count, frame size)
+    OP_TAIL_CALL,     // Replace the running frame by a call (operands: entry, argument count, slot count, frame size)
+    OP_RETURN,        // Pop the result, drop the frame and push the result for the caller
+    OP_HALT,          // End of program
+    OP_COUNT
+} OpCode;
+
+// Compiled program
+typedef struct
+{
+    int32_t *code; // Instructions and operands
+    int count;
+    int capacity;
+
+    // String constants, they point into the AST arena
+    const char **strings;
+    int stringCount;
+    int stringCapacity;
+
+    int maxStack;  // Deepest operand stack needed to run the chunk
+    int slotCount; // Variables of the top level blocks, the operand stack starts above them.
+                   // Set before compileProgram when the chunk runs only a part of the program.
+} Chunk;
+
+// Compiler functions
+void initChunk(Chunk *chunk);
+void resetChunk(Chunk *chunk);
+void freeChunk(Chunk *chunk);
+void compileProgram(NodeRef program, Chunk *chunk);
+const char *opCodeToString(OpCode op);
+int opCodeOperands(OpCode op);
+
+#endif
@@ -0,0 +1,355 @@
+#include "dict.h"
+#include "interpreter.h"
+#include "output.h"
+#include "symtab.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DICT_MIN_CAPACITY 8
+
+static void *allocOrDie(void *pointer)
+{
+    if (pointer == NULL)
+    {
+        reportError("Runtime Error: Out of memory\n");
+        failInterpreter();
+    }
+    return pointer;
+}
+
+static inline int keyMatches(const DictEntry *entry, const DictKey *key)
+{
+    if (entry->kind != key->kind)
+    {
+        return 0;
+    }
+    if (key->kind == DICT_INT_KEY)
+    {
+        return entry->intKey == key->intKey;
+    }
+    return entry->stringKey.length == key->length &&
+           memcmp(stringText(&entry->stringKey), key->text, key->length) == 0;
+}
+
+// Slot holding key, or the empty slot where it would be inserted
+static inline DictSlot *findSlot(const Dict *dict, const DictKey *key)
+{
+    uint32_t slot = key->hash & dict->slotMask;
+    while (1)
+    {
+        DictSlot *candidate = &dict->slots[slot];
+        if (candidate->index == 0 ||
+            (candidate->hash == key->hash && keyMatches(&dict->entries[candidate->index - 1], key)))
+        {
+            return candidate;
+        }
+        slot = (slot + 1) & dict->slotMask;
+    }
+}
+
+// Index the entry at position index - 1 in slots known not to hold it
+static inline void placeSlot(DictSlot *slots, uint32_t mask, uint32_t hash, uint32_t index)
+{
+    uint32_t slot = hash & mask;
+    while (slots[slot].index != 0)
+    {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot].hash = hash;
+    slots[slot].index = index;
+}
+
+// Move the live entries to an array of capacity entries and index them again.
+// Removed entries are dropped here, the others keep their order.
+static void resizeDict(Dict *dict, uint32_t capacity)
+{
+    if (capacity < DICT_MIN_CAPACITY)
+    {
+        capacity = DICT_MIN_CAPACITY;
+    }
+    if (capacity > UINT32_MAX / 4)
+    {
+        reportError("Runtime Error: Dict too large\n");
+        failInterpreter();
+    }
+    uint32_t slotCount = DICT_MIN_CAPACITY * 2;
+    while (slotCount < capacity * 2)
+    {
+        slotCount *= 2;
+    }
+    DictEntry *entries = allocOrDie(malloc(capacity * sizeof(DictEntry)));
+    DictSlot *slots = allocOrDie(calloc(slotCount, sizeof(DictSlot)));
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < dict->used; i++)
+    {
+        if (dict->entries[i].kind == DICT_REMOVED)
+        {
+            continue;
+        }
+        entries[count] = dict->entries[i];
+        count++;
+        placeSlot(slots, slotCount - 1, entries[count - 1].hash, count);
+    }
+
+    free(dict->entries);
+    free(dict->slots);
+    dict->entries = entries;
+    dict->slots = slots;
+    dict->slotMask = slotCount - 1;
+    dict->capacity = capacity;
+    dict->used = count;
+}
+
+Dict *newDict(void)
+{
+    Dict *dict = allocOrDie(calloc(1, sizeof(Dict)));
+    resizeDict(dict, DICT_MIN_CAPACITY);
+    return dict;
+}
+
+// Keys are shared with the original, the copies are independent from then on
+Dict *copyDict(const Dict *dict)
+{
+    Dict *copy = allocOrDie(calloc(1, sizeof(Dict)));
+    resizeDict(copy, dict->count);
+    for (uint32_t i = 0; i < dict->used; i++)
+    {
+        const DictEntry *entry = &dict->entries[i];
+        if (entry->kind == DICT_REMOVED)
+        {
+            continue;
+        }
+        DictEntry *target = &copy->entries[copy->used++];
+        *target = *entry;
+        if (entry->kind == DICT_STRING_KEY)
+        {
+            shareString(&target->stringKey, &entry->stringKey);
+        }
+        placeSlot(copy->slots, copy->slotMask, entry->hash, copy->used);
+    }
+    copy->count = copy->used;
+    return copy;
+}
+
+void freeDict(Dict *dict)
+{
+    for (uint32_t i = 0; i < dict->used; i++)
+    {
+        if (dict->entries[i].kind == DICT_STRING_KEY)
+        {
+            releaseString(&dict->entries[i].stringKey);
+        }
+    }
+    free(dict->entries);
+    free(dict->slots);
+    free(dict);
+}
+
+// Size hint, count keys then fit without growing
+void reserveDict(Dict *dict, uint32_t count)
+{
+    if (count > dict->capacity)
+    {
+        resizeDict(dict, count);
+    }
+}
+
+int32_t *findDictValue(Dict *dict, const DictKey *key)
+{
+    DictSlot *slot = findSlot(dict, key);
+    return slot->index == 0 ? NULL : &dict->entries[slot->index - 1].value;
+}
+
+// Value of key, added with 0 when missing
+int32_t *insertDictKey(Dict *dict, const DictKey *key)
+{
+    DictSlot *slot = findSlot(dict, key);
+    if (slot->index != 0)
+    {
+        return &dict->entries[slot->index - 1].value;
+    }
+
+    if (dict->used == dict->capacity)
+    {
+        // Compacting is enough when removed entries fill half of the array
+        resizeDict(dict, dict->count < dict->capacity / 2 ? dict->capacity : dict->capacity * 2);
+        slot = findSlot(dict, key);
+    }
+    DictEntry *entry = &dict->entries[dict->used];
+    entry->hash = key->hash;
+    entry->kind = key->kind;
+    entry->value = 0;
+    if (key->kind == DICT_INT_KEY)
+    {
+        entry->intKey = key->intKey;
+    }
+    else if (key->source != NULL)
+    {
+        shareString(&entry->stringKey, key->source);
+    }
+    else
+    {
+        makeString(&entry->stringKey, key->text, key->length);
+    }
+    slot->hash = key->hash;
+    slot->index = ++dict->used;
+    dict->count++;
+    return &entry->value;
+}
+
+// 0 when key was not in the dict
+int removeDictKey(Dict *dict, const DictKey *key)
+{
+    DictSlot *slot = findSlot(dict, key);
+    if (slot->index == 0)
+    {
+        return 0;
+    }
+    DictEntry *entry = &dict->entries[slot->index - 1];
+    if (entry->kind == DICT_STRING_KEY)
+    {
+        releaseString(&entry->stringKey);
+    }
+    entry->kind = DICT_REMOVED;
+    dict->count--;
+    while (dict->used > 0 && dict->entries[dict->used - 1].kind == DICT_REMOVED)
+    {
+        dict->used--;
+    }
+
+    // Shift back the slots after the hole that may move closer to their first probe,
+    // so lookups never need tombstones
+    uint32_t mask = dict->slotMask;
+    uint32_t hole = (uint32_t)(slot - dict->slots);
+    uint32_t next = (hole + 1) & mask;
+    while (dict->slots[next].index != 0)
+    {
+        uint32_t home = dict->slots[next].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            dict->slots[hole] = dict->slots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    dict->slots[hole].index = 0;
+    return 1;
+}
+
+// Entry at or after position in insertion order, NULL at the end. position moves past it.
+const DictEntry *nextDictEntry(const Dict *dict, uint32_t *position)
+{
+    while (*position < dict->used)
+    {
+        const DictEntry *entry = &dict->entries[(*position)++];
+        if (entry->kind != DICT_REMOVED)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Key written as a string literal, a string expression, or a variable holding a string or an int
+void keyFromNode(NodeRef node, DictKey *key)
+{
+    if (IS_CONCATENATION(node))
+    {
+        // Kept until the next joined key, an insert shares it
+        releaseString(&interp->joinedKey);
+        joinStringExpression(node, &interp->joinedKey);
+        key->kind = DICT_STRING_KEY;
+        key->text = stringText(&interp->joinedKey);
+        key->length = interp->joinedKey.length;
+        key->hash = hashBytes(key->text, key->length);
+        key->source = &interp->joinedKey;
+        return;
+    }
+    if (NODE_TYPE(node) == CharLiteralNode)
+    {
+        CharLiteralRecord *record = NODE(node, CharLiteralRecord);
+        key->kind = DICT_STRING_KEY;
+        key->hash = record->hash; // Computed by the parser
+        key->text = record->text;
+        key->length = record->length;
+        key->source = NULL;
+        return;
+    }
+
+    InternId name = NODE(node, IdentifierRecord)->name;
+    SymbolTableEntry *entry = lookupSymbolHashed(internedText(name), internedHash(name));
+    if (entry == NULL)
+    {
+        reportError("Runtime Error: Undefined variable '%s'\n", internedText(name));
+        failInterpreter();
+    }
+    if (entry->type == TYPE_INT)
+    {
+        makeIntKey(key, entry->intValue);
+    }
+    else if (entry->type == TYPE_CHAR)
+    {
+        key->kind = DICT_STRING_KEY;
+        key->text = stringText(&entry->stringValue);
+        key->length = entry->stringValue.length;
+        key->hash = hashBytes(key->text, key->length);
+        key->source = &entry->stringValue;
+    }
+    else
+    {
+        reportError("Type Error: Variable '%s' is not an int or a char\n", internedText(name));
+        failInterpreter();
+    }
+}
+
+void assignEmptyDict(InternId name)
+{
+    assignVariableDictHashed(internedText(name), internedHash(name), newDict());
+}
+
+void assignDictCopy(InternId name, InternId source)
+{
+    SymbolTableEntry *entry = lookupSymbolHashed(internedText(source), internedHash(source));
+    if (entry == NULL)
+    {
+        reportError("Runtime Error: Undefined variable '%s'\n", internedText(source));
+        failInterpreter();
+    }
+    if (entry->type != TYPE_DICT)
+    {
+        reportError("Type Error: Variable '%s' is not a dict\n", internedText(source));
+        failInterpreter();
+    }
+    assignVariableDictHashed(internedText(name), internedHash(name), copyDict(entry->dictValue));
+}
+
+// {'pomme': 3, 12: 1} without the newline, in insertion order
+void writeDict(const Dict *dict)
+{
+    uint32_t position = 0;
+    const DictEntry *entry;
+    int first = 1;
+    writeText("{", 1);
+    while ((entry = nextDictEntry(dict, &position)) != NULL)
+    {
+        if (!first)
+        {
+            writeText(", ", 2);
+        }
+        first = 0;
+        if (entry->kind == DICT_INT_KEY)
+        {
+            writeInt(entry->intKey);
+        }
+        else
+        {
+            writeText("'", 1);
+            writeText(stringText(&entry->stringKey), entry->stringKey.length);
+            writeText("'", 1);
+        }
+        writeText(": ", 2);
+        writeInt(entry->value);
+    }
+    writeText("}", 1);
+}
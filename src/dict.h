@@ -0,0 +1,81 @@
+#ifndef DICT_H
+#define DICT_H
+
+#include "ast.h"
+#include "stringval.h"
+#include <stdint.h>
+
+// Kinds of dict entries
+#define DICT_INT_KEY 1
+#define DICT_STRING_KEY 2
+#define DICT_REMOVED 3 // Left in place until the entries are compacted
+
+// Key of a lookup, the text is borrowed from the program or from a variable
+typedef struct
+{
+    uint8_t kind;
+    uint32_t hash;
+    int32_t intKey;
+    const char *text;
+    uint32_t length;
+    const StringValue *source; // Variable holding the text, shared on insert, NULL for a literal
+} DictKey;
+
+typedef struct
+{
+    uint32_t hash;
+    uint8_t kind;
+    int32_t value;
+    union
+    {
+        int32_t intKey;
+        StringValue stringKey; // Up to STRING_INLINE bytes stored in the entry itself
+    };
+} DictEntry;
+
+// Probe slot, index is the entry position + 1 (0 = empty). The hash is kept next to it
+// so that probing past other keys does not touch their entries.
+typedef struct
+{
+    uint32_t hash;
+    uint32_t index;
+} DictSlot;
+
+// Value of a dict variable: linear probing over a dense array of entries in insertion order
+typedef struct
+{
+    DictEntry *entries;
+    uint32_t used;  // Entries written, removed ones included
+    uint32_t count; // Keys in the dict
+    uint32_t capacity;
+    DictSlot *slots;
+    uint32_t slotMask; // Slot count - 1, at least twice the capacity
+} Dict;
+
+// Array indexes are keys too, so making one stays inline. Multiplication spreads consecutive
+// ints over the slots, the shift folds the high bits back in.
+static inline void makeIntKey(DictKey *key, int32_t value)
+{
+    uint32_t hash = (uint32_t)value * 0x9E3779B1u;
+    key->kind = DICT_INT_KEY;
+    key->hash = hash ^ (hash >> 16);
+    key->intKey = value;
+}
+
+// Dict functions
+Dict *newDict(void);
+Dict *copyDict(const Dict *dict);
+void freeDict(Dict *dict);
+void reserveDict(Dict *dict, uint32_t count);
+int32_t *findDictValue(Dict *dict, const DictKey *key);
+int32_t *insertDictKey(Dict *dict, const DictKey *key);
+int removeDictKey(Dict *dict, const DictKey *key);
+const DictEntry *nextDictEntry(const Dict *dict, uint32_t *position);
+
+// Dict variables of the bound interpreter, errors fail the script
+void keyFromNode(NodeRef node, DictKey *key);
+void assignEmptyDict(InternId name);
+void assignDictCopy(InternId name, InternId source);
+void writeDict(const Dict *dict);
+
+#endif
@@ -0,0 +1,754 @@
+#include "emitc.h"
+#include "interpreter.h"
+#include "output.h"
+#include "lexer.h"
+#include "symtab.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+const char *emitCFile = NULL;
+const char *compileOutput = NULL;
+
+// Support code of every generated program. Output goes through one buffer
+// and the error messages are the ones of the interpreter.
+static const char *runtimePrelude =
+    "#include <limits.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "static char output[1 << 16];\n"
+    "static size_t outputLength;\n"
+    "\n"
+    "static void flushOutput(void)\n"
+    "{\n"
+    "    fwrite(output, 1, outputLength, stdout);\n"
+    "    fflush(stdout);\n"
+    "    outputLength = 0;\n"
+    "}\n"
+    "\n"
+    "static void writeText(const char *text, size_t length)\n"
+    "{\n"
+    "    if (outputLength + length > sizeof(output))\n"
+    "    {\n"
+    "        flushOutput();\n"
+    "        if (length > sizeof(output))\n"
+    "        {\n"
+    "            fwrite(text, 1, length, stdout);\n"
+    "            return;\n"
+    "        }\n"
+    "    }\n"
+    "    memcpy(output + outputLength, text, length);\n"
+    "    outputLength += length;\n"
+    "}\n"
+    "\n"
+    "static void printInt(int value)\n"
+    "{\n"
+    "    char digits[16];\n"
+    "    char *end = digits + sizeof(digits);\n"
+    "    char *start = end;\n"
+    "    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;\n"
+    "    *--start = '\\n';\n"
+    "    do\n"
+    "    {\n"
+    "        *--start = (char)('0' + magnitude % 10);\n"
+    "        magnitude /= 10;\n"
+    "    } while (magnitude != 0);\n"
+    "    if (value < 0)\n"
+    "    {\n"
+    "        *--start = '-';\n"
+    "    }\n"
+    "    writeText(start, (size_t)(end - start));\n"
+    "}\n"
+    "\n"
+    "static void printString(const char *text)\n"
+    "{\n"
+    "    writeText(text, strlen(text));\n"
+    "    writeText(\"\\n\", 1);\n"
+    "}\n"
+    "\n"
+    "static int failRead(const char *name, int type)\n"
+    "{\n"
+    "    flushOutput();\n"
+    "    if (type == 0)\n"
+    "    {\n"
+    "        printf(\"Runtime Error: Undefined variable '%s'\\n\", name);\n"
+    "    }\n"
+    "    else\n"
+    "    {\n"
+    "        printf(\"Type Error: Variable '%s' is not of type int\\n\", name);\n"
+    "    }\n"
+    "    exit(1);\n"
+    "}\n"
+    "\n"
+    "static const char *failString(const char *name, int type)\n"
+    "{\n"
+    "    flushOutput();\n"
+    "    if (type == 0)\n"
+    "    {\n"
+    "        printf(\"Runtime Error: Undefined variable '%s'\\n\", name);\n"
+    "    }\n"
+    "    else\n"
+    "    {\n"
+    "        printf(\"Type Error: Variable '%s' is not of type char\\n\", name);\n"
+    "    }\n"
+    "    exit(1);\n"
+    "}\n"
+    "\n"
+    "// New text of a string expression, owned by the variable it is assigned to or freed once printed\n"
+    "static char *joinStrings(const char **parts, int count)\n"
+    "{\n"
+    "    size_t length = 0;\n"
+    "    for (int i = 0; i < count; i++)\n"
+    "    {\n"
+    "        length += strlen(parts[i]);\n"
+    "    }\n"
+    "    char *joined = malloc(length + 1);\n"
+    "    if (joined == NULL)\n"
+    "    {\n"
+    "        flushOutput();\n"
+    "        printf(\"Runtime Error: Out of memory\\n\");\n"
+    "        exit(1);\n"
+    "    }\n"
+    "    char *end = joined;\n"
+    "    for (int i = 0; i < count; i++)\n"
+    "    {\n"
+    "        size_t partLength = strlen(parts[i]);\n"
+    "        memcpy(end, parts[i], partLength);\n"
+    "        end += partLength;\n"
+    "    }\n"
+    "    *end = '\\0';\n"
+    "    return joined;\n"
+    "}\n"
+    "\n"
+    "static void failType(void)\n"
+    "{\n"
+    "    flushOutput();\n"
+    "    printf(\"Type Error: Expected a string, but got an int\\n\");\n"
+    "    exit(1);\n"
+    "}\n"
+    "\n"
+    "// Wrapping arithmetic, like the interpreter on two's complement machines\n"
+    "static inline int add(int a, int b)\n"
+    "{\n"
+    "    return (int)((unsigned)a + (unsigned)b);\n"
+    "}\n"
+    "\n"
+    "static inline int sub(int a, int b)\n"
+    "{\n"
+    "    return (int)((unsigned)a - (unsigned)b);\n"
+    "}\n"
+    "\n"
+    "static inline int mul(int a, int b)\n"
+    "{\n"
+    "    return (int)((unsigned)a * (unsigned)b);\n"
+    "}\n"
+    "\n"
+    "static void failDivision(int b)\n"
+    "{\n"
+    "    flushOutput();\n"
+    "    if (b == 0)\n"
+    "    {\n"
+    "        printf(\"Runtime Error: Division by zero\\n\");\n"
+    "    }\n"
+    "    else\n"
+    "    {\n"
+    "        printf(\"Runtime Error: Integer overflow in division\\n\");\n"
+    "    }\n"
+    "    exit(1);\n"
+    "}\n"
+    "\n"
+    "static inline int divide(int a, int b)\n"
+    "{\n"
+    "    return b == 0 || (a == INT_MIN && b == -1) ? (failDivision(b), 0) : a / b;\n"
+    "}\n"
+    "\n"
+    "static inline int modulo(int a, int b)\n"
+    "{\n"
+    "    return b == 0 || (a == INT_MIN && b == -1) ? (failDivision(b), 0) : a % b;\n"
+    "}\n"
+    "\n";
+
+// Text written before and between the operands of a binary operator, both forms end with ')'
+static void operatorText(TokenType op, const char **before, const char **between)
+{
+    *before = "(";
+    switch (op)
+    {
+    case Add:
+        *before = "add(";
+        *between = ", ";
+        break;
+    case Sub:
+        *before = "sub(";
+        *between = ", ";
+        break;
+    case Mul:
+        *before = "mul(";
+        *between = ", ";
+        break;
+    case Div:
+        *before = "divide(";
+        *between = ", ";
+        break;
+    case Mod:
+        *before = "modulo(";
+        *between = ", ";
+        break;
+    case Lt:
+        *between = " < ";
+        break;
+    case Le:
+        *between = " <= ";
+        break;
+    case Gt:
+        *between = " > ";
+        break;
+    case Ge:
+        *between = " >= ";
+        break;
+    default:
+        *between = " != ";
+        break;
+    }
+}
+
+// Every name of the language is also a valid C identifier, the prefixes keep them apart from C keywords
+static void emitRead(FILE *out, InternId name)
+{
+    const char *text = internedText(name);
+    fprintf(out, "(t_%s == 1 ? v_%s : failRead(\"%s\", t_%s))", text, text, text, text);
+}
+
+static void emitInt(FILE *out, int32_t value)
+{
+    if (value == INT32_MIN)
+    {
+        fprintf(out, "(-2147483647 - 1)");
+    }
+    else
+    {
+        fprintf(out, "%d", value);
+    }
+}
+
+// Items of emitExpression, a node to write or the rest of an operator
+enum
+{
+    ITEM_NODE,
+    ITEM_BETWEEN,
+    ITEM_AFTER,
+};
+
+// In order walk with a heap stack, nesting is only limited by the C compiler reading the output
+static void emitExpression(FILE *out, NodeRef root)
+{
+    uint32_t base = interp->emitStack.count;
+    pushWork(&interp->emitStack, root);
+    pushWork(&interp->emitStack, ITEM_NODE);
+
+    while (interp->emitStack.count > base)
+    {
+        uint32_t item = POP_WORK(&interp->emitStack);
+        NodeRef node = POP_WORK(&interp->emitStack);
+        const char *before;
+        const char *between;
+
+        if (item == ITEM_BETWEEN)
+        {
+            operatorText((TokenType)NODE(node, BinaryOpRecord)->header.tokenType, &before, &between);
+            fputs(between, out);
+            continue;
+        }
+        if (item == ITEM_AFTER)
+        {
+            fputc(')', out);
+            continue;
+        }
+
+        switch (NODE_TYPE(node))
+        {
+        case NumberNode:
+            emitInt(out, NODE(node, NumberRecord)->value);
+            break;
+        case CharLiteralNode:
+            // An int expression sees the first character, like the VM
+            emitInt(out, NODE(node, CharLiteralRecord)->text[0]);
+            break;
+        case IdentifierNode:
+            emitRead(out, NODE(node, IdentifierRecord)->name);
+            break;
+        case LocalNode:
+            fprintf(out, "l_%u", NODE(node, LocalRecord)->slot);
+            break;
+        default:
+        {
+            BinaryOpRecord *record = NODE(node, BinaryOpRecord);
+            operatorText((TokenType)record->header.tokenType, &before, &between);
+            fputs(before, out);
+            pushWork(&interp->emitStack, node);
+            pushWork(&interp->emitStack, ITEM_AFTER);
+            pushWork(&interp->emitStack, record->right);
+            pushWork(&interp->emitStack, ITEM_NODE);
+            pushWork(&interp->emitStack, node);
+            pushWork(&interp->emitStack, ITEM_BETWEEN);
+            pushWork(&interp->emitStack, record->left);
+            pushWork(&interp->emitStack, ITEM_NODE);
+            break;
+        }
+        }
+    }
+}
+
+static void emitStringLiteral(FILE *out, const char *text, uint32_t length)
+{
+    fputc('"', out);
+    for (uint32_t i = 0; i < length; i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\' || c == '?')
+        {
+            fprintf(out, "\\%c", c);
+        }
+        else if (c < 0x20 || c >= 0x7F)
+        {
+            fprintf(out, "\\%03o", c);
+        }
+        else
+        {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void indent(FILE *out, int depth)
+{
+    for (int i = 0; i < depth; i++)
+    {
+        fputs("    ", out);
+    }
+}
+
+// Opens a block with the parts of a string expression, literals and char variables joined by +,
+// and their joined copy in joined
+static void emitJoinedString(FILE *out, NodeRef value, int depth)
+{
+    uint32_t base = interp->emitStack.count;
+    int count = 0;
+
+    fprintf(out, "{\n");
+    indent(out, depth + 1);
+    fprintf(out, "const char *parts[] = {");
+    pushWork(&interp->emitStack, value);
+    while (interp->emitStack.count > base)
+    {
+        NodeRef node = POP_WORK(&interp->emitStack);
+        if (NODE_TYPE(node) == BinaryOpNode && NODE(node, BinaryOpRecord)->header.tokenType == Add)
+        {
+            pushWork(&interp->emitStack, NODE(node, BinaryOpRecord)->right);
+            pushWork(&interp->emitStack, NODE(node, BinaryOpRecord)->left);
+            continue;
+        }
+        fputs(count++ == 0 ? "" : ", ", out);
+        if (NODE_TYPE(node) == CharLiteralNode)
+        {
+            emitStringLiteral(out, NODE(node, CharLiteralRecord)->text, NODE(node, CharLiteralRecord)->length);
+        }
+        else if (NODE_TYPE(node) == IdentifierNode)
+        {
+            const char *text = internedText(NODE(node, IdentifierRecord)->name);
+            fprintf(out, "(t_%s == 2 ? s_%s : failString(\"%s\", t_%s))", text, text, text, text);
+        }
+        else
+        {
+            fprintf(out, "(failType(), \"\")");
+        }
+    }
+    fprintf(out, "};\n");
+    indent(out, depth + 1);
+    fprintf(out, "char *joined = joinStrings(parts, %d);\n", count);
+}
+
+// The text is copied into a buffer owned by the variable
+static void emitStringExpression(FILE *out, AssignmentRecord *record, int depth)
+{
+    const char *target = internedText(record->name);
+    emitJoinedString(out, record->value, depth);
+    indent(out, depth + 1);
+    fprintf(out, "free(o_%s);\n", target);
+    indent(out, depth + 1);
+    fprintf(out, "o_%s = joined;\n", target);
+    indent(out, depth + 1);
+    fprintf(out, "s_%s = joined;\n", target);
+    indent(out, depth + 1);
+    fprintf(out, "t_%s = 2;\n", target);
+    indent(out, depth);
+    fprintf(out, "}\n");
+}
+
+static void emitAssignment(FILE *out, NodeRef node, int depth)
+{
+    indent(out, depth);
+    if (NODE_TYPE(node) == LocalAssignNode)
+    {
+        fprintf(out, "l_%u = ", NODE(node, LocalAssignRecord)->slot);
+        emitExpression(out, NODE(node, LocalAssignRecord)->value);
+        fprintf(out, ";\n");
+        return;
+    }
+
+    AssignmentRecord *record = NODE(node, AssignmentRecord);
+    const char *text = internedText(record->name);
+
+    if (record->header.varType == TYPE_CHAR)
+    {
+        if (NODE_TYPE(record->value) == CharLiteralNode)
+        {
+            CharLiteralRecord *literal = NODE(record->value, CharLiteralRecord);
+            fprintf(out, "s_%s = ", text);
+            emitStringLiteral(out, literal->text, literal->length);
+            fprintf(out, ";\n");
+            indent(out, depth);
+            fprintf(out, "t_%s = 2;\n", text);
+        }
+        else
+        {
+            emitStringExpression(out, record, depth);
+        }
+        return;
+    }
+
+    fprintf(out, "v_%s = ", text);
+    emitExpression(out, record->value);
+    fprintf(out, ";\n");
+    indent(out, depth);
+    fprintf(out, "t_%s = 1;\n", text);
+}
+
+// What is left to write once a block is written waits on the emit stack under the expressions,
+// a frame is its words with its kind on top
+enum
+{
+    BLOCK_LIST,  // Next statement, depth
+    BLOCK_ELSE,  // Else branch, depth of the if
+    BLOCK_CLOSE, // Depth of the '{'
+    BLOCK_FOR,   // Increment, depth of the loop
+};
+
+static void pushBlock(NodeRef node, int depth, uint32_t kind)
+{
+    pushWork(&interp->emitStack, node);
+    pushWork(&interp->emitStack, (uint32_t)depth);
+    pushWork(&interp->emitStack, kind);
+}
+
+// '{' and its statements, the '}' is written by the frame under them
+static void openBlock(FILE *out, NodeRef node, int depth)
+{
+    indent(out, depth);
+    fprintf(out, "{\n");
+    pushBlock(NULL_NODE, depth, BLOCK_CLOSE);
+    pushBlock(node, depth + 1, BLOCK_LIST);
+}
+
+// for loops become while loops, the language has no break or continue.
+// The blocks of a statement are pushed, emitStatements writes them.
+static void emitStatement(FILE *out, NodeRef node, int depth)
+{
+    switch (NODE_TYPE(node))
+    {
+    case AssignmentNode:
+    case LocalAssignNode:
+        emitAssignment(out, node, depth);
+        break;
+
+    case PrintNode:
+    {
+        NodeRef argument = NODE(node, PrintRecord)->argument;
+        indent(out, depth);
+        if (NODE_TYPE(argument) == IdentifierNode)
+        {
+            // Like printVariable, a variable that does not exist prints nothing
+            const char *text = internedText(NODE(argument, IdentifierRecord)->name);
+            fprintf(out, "if (t_%s == 1) printInt(v_%s); else if (t_%s == 2) printString(s_%s);\n",
+                    text, text, text, text);
+        }
+        else if (NODE_TYPE(argument) == CharLiteralNode)
+        {
+            CharLiteralRecord *literal = NODE(argument, CharLiteralRecord);
+            fprintf(out, "printString(");
+            emitStringLiteral(out, literal->text, literal->length);
+            fprintf(out, ");\n");
+        }
+        else if (IS_CONCATENATION(argument))
+        {
+            emitJoinedString(out, argument, depth);
+            indent(out, depth + 1);
+            fprintf(out, "printString(joined);\n");
+            indent(out, depth + 1);
+            fprintf(out, "free(joined);\n");
+            indent(out, depth);
+            fprintf(out, "}\n");
+        }
+        else
+        {
+            fprintf(out, "printInt(");
+            emitExpression(out, argument);
+            fprintf(out, ");\n");
+        }
+        break;
+    }
+
+    case FlushNode:
+        indent(out, depth);
+        fprintf(out, "flushOutput();\n");
+        break;
+
+    case IfNode:
+    {
+        IfRecord *record = NODE(node, IfRecord);
+        indent(out, depth);
+        fprintf(out, "if (");
+        emitExpression(out, record->condition);
+        fprintf(out, ")\n");
+        pushBlock(record->elseBranch, depth, BLOCK_ELSE);
+        openBlock(out, record->thenBranch, depth);
+        break;
+    }
+
+    case ForNode:
+    {
+        ForRecord *record = NODE(node, ForRecord);
+        emitAssignment(out, record->init, depth);
+        indent(out, depth);
+        fprintf(out, "while (");
+        emitExpression(out, record->condition);
+        fprintf(out, ")\n");
+        indent(out, depth);
+        fprintf(out, "{\n");
+        pushBlock(record->increment, depth, BLOCK_FOR);
+        pushBlock(record->body, depth + 1, BLOCK_LIST);
+        break;
+    }
+
+    case WhileNode:
+    {
+        WhileRecord *record = NODE(node, WhileRecord);
+        indent(out, depth);
+        fprintf(out, "while (");
+        emitExpression(out, record->condition);
+        fprintf(out, ")\n");
+        openBlock(out, record->body, depth);
+        break;
+    }
+
+    default:
+        reportError("Compiler Error: Unexpected node type '%d' in statement\n", NODE_TYPE(node));
+        failInterpreter();
+    }
+}
+
+// A statement list with the blocks nested in it, without recursion
+static void emitStatements(FILE *out, NodeRef node, int depth)
+{
+    WorkStack *work = &interp->emitStack;
+    uint32_t base = work->count;
+    pushBlock(node, depth, BLOCK_LIST);
+
+    while (work->count > base)
+    {
+        uint32_t kind = POP_WORK(work);
+        depth = (int)POP_WORK(work);
+        node = POP_WORK(work);
+        switch (kind)
+        {
+        case BLOCK_LIST:
+            if (node != NULL_NODE)
+            {
+                pushBlock(NEXT_NODE(node), depth, BLOCK_LIST);
+                emitStatement(out, node, depth);
+            }
+            break;
+        case BLOCK_ELSE:
+            if (node != NULL_NODE)
+            {
+                indent(out, depth);
+                fprintf(out, "else\n");
+                openBlock(out, node, depth);
+            }
+            break;
+        case BLOCK_FOR:
+            emitAssignment(out, node, depth + 1);
+            indent(out, depth);
+            fprintf(out, "}\n");
+            break;
+        case BLOCK_CLOSE:
+            indent(out, depth);
+            fprintf(out, "}\n");
+            break;
+        }
+    }
+}
+
+// Names declared once at the top of main
+typedef struct
+{
+    FILE *out;
+    uint8_t *declared; // Indexed by InternId
+} Declarations;
+
+static int visitDeclaration(NodeRef node, void *context)
+{
+    Declarations *declarations = context;
+    InternId name;
+    if (NODE_TYPE(node) == IdentifierNode)
+    {
+        name = NODE(node, IdentifierRecord)->name;
+    }
+    else if (NODE_TYPE(node) == AssignmentNode)
+    {
+        name = NODE(node, AssignmentRecord)->name;
+    }
+    else
+    {
+        return 0;
+    }
+    if (!declarations->declared[name])
+    {
+        const char *text = internedText(name);
+        declarations->declared[name] = 1;
+        fprintf(declarations->out, "    int v_%s = 0;\n    const char *s_%s = NULL;\n    char *o_%s = NULL;\n    int t_%s = 0;\n",
+                text, text, text, text);
+    }
+    return 0;
+}
+
+// The translation only knows int and char variables
+static int visitUnsupported(NodeRef node, void *context)
+{
+    (void)context;
+    switch (NODE_TYPE(node))
+    {
+    case ArrayLiteralNode:
+    case IndexNode:
+    case ArrayCallNode:
+    case IndexAssignNode:
+    case ArrayOpNode:
+    case DictLiteralNode:
+    case ForEachNode:
+    case FunctionNode:
+    case CallNode:
+        return 1;
+    case AssignmentNode:
+        return NODE(node, AssignmentRecord)->header.varType == TYPE_ARRAY ||
+               NODE(node, AssignmentRecord)->header.varType == TYPE_DICT;
+    default:
+        return 0;
+    }
+}
+
+// Variables become locals of main with a type tag, the C compiler removes the checks it can prove
+void emitProgramC(NodeRef program, FILE *out)
+{
+    if (forEachNode(program, visitUnsupported, NULL))
+    {
+        reportError("Compiler Error: Arrays, dicts and functions are not supported by --emit-c\n");
+        failInterpreter();
+    }
+    fputs(runtimePrelude, out);
+    fprintf(out, "int main(void)\n{\n");
+    fprintf(out, "    // Value, text, owned text and type of each variable, the type is 0 undefined, 1 int, 2 char\n");
+
+    Declarations declarations = {out, calloc(interp->interner.count + 1, 1)};
+    if (declarations.declared == NULL)
+    {
+        reportError("Compiler Error: Out of memory\n");
+        failInterpreter();
+    }
+    forEachNode(program, visitDeclaration, &declarations);
+    free(declarations.declared);
+    // Variables of the blocks are always assigned before they are read, they need no type
+    uint32_t slots = topLevelSlots(program);
+    for (uint32_t slot = 0; slot < slots; slot++)
+    {
+        fprintf(out, "    int l_%u = 0;\n", slot);
+    }
+
+    fprintf(out, "\n");
+    emitStatements(out, program, 1);
+    fprintf(out, "\n    flushOutput();\n    return 0;\n}\n");
+}
+
+// Run the system C compiler, CC overrides the default cc
+static int runCompiler(const char *source, const char *output)
+{
+    const char *compiler = getenv("CC");
+    if (compiler == NULL || compiler[0] == '\0')
+    {
+        compiler = "cc";
+    }
+
+    fflush(interp->out);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        reportError("Compiler Error: Cannot start '%s'\n", compiler);
+        return 1;
+    }
+    if (pid == 0)
+    {
+        execlp(compiler, compiler, "-O2", "-o", output, source, (char *)NULL);
+        printf("Compiler Error: Cannot run '%s'\n", compiler);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        reportError("Compiler Error: '%s' failed on %s\n", compiler, source);
+        return 1;
+    }
+    return 0;
+}
+
+// Write the C file, then build it when --compile is given
+void translateProgram(NodeRef program)
+{
+    char temporary[4096];
+    const char *source = emitCFile;
+    if (source == NULL)
+    {
+        snprintf(temporary, sizeof(temporary), "%s.c", compileOutput);
+        source = temporary;
+    }
+
+    FILE *out = fopen(source, "w");
+    if (out == NULL)
+    {
+        reportError("Compiler Error: Cannot write '%s'\n", source);
+        failInterpreter();
+    }
+    emitProgramC(program, out);
+    if (fclose(out) != 0)
+    {
+        reportError("Compiler Error: Cannot write '%s'\n", source);
+        failInterpreter();
+    }
+
+    if (compileOutput != NULL)
+    {
+        int failed = runCompiler(source, compileOutput);
+        // The C file is only kept when it was asked for
+        if (emitCFile == NULL)
+        {
+            remove(source);
+        }
+        if (failed)
+        {
+            failInterpreter();
+        }
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef EMITC_H
+#define EMITC_H
+
+#include "ast.h"
+#include <stdio.h>
+
+// Write the program as C instead of running it, set with --emit-c FILE
+extern const char *emitCFile;
+
+// Build a native executable from that C with the system compiler, set with --compile FILE
+extern const char *compileOutput;
+
+// Ahead of time functions
+void emitProgramC(NodeRef program, FILE *out);
+void translateProgram(NodeRef program);
+
+#endif
@@ -1,48 +1,59 @@
 #include "input.h"
-#include "lexer.h"
-#include "parser.h"
+#include "interpreter.h"
+#include "batch.h"
+#include "cache.h"
+#include "source.h"
+#include "optimizer.h"
+#include "profile.h"
+#include "jit.h"
+#include "emitc.h"
 #include <stdio.h>
+#include <unistd.h>
 
-void interpret(const char *inputExpression)
+// Interpreter of the command line, variables persist across the lines of the interactive mode
+static Interpreter *session;
+
+int interpret(const char *inputExpression)
 {
-    setInput(inputExpression);
-    ASTNode *program = parseProgram();
-    if (DEBUG)
-        printf("Interpreter: Parsed program successfully\n");
-    evaluateProgram(program);
-    if (DEBUG)
-        printf("Interpreter: Evaluated AST successfully\n");
-    freeAST(program);
+    return interpretBuffer(inputExpression, strlen(inputExpression));
 }
 
-void interpretFile(const char *fileName)
+// The buffer does not need a terminating NUL, the lexer stops at length
+int interpretBuffer(const char *buffer, size_t length)
 {
-    FILE *file = fopen(fileName, "r");
-    if (file == NULL)
+    return runScript(session, buffer, length);
+}
+
+int interpretFile(const char *fileName)
+{
+    SourceBuffer source;
+    if (loadSourceFile(fileName, &source) != 0)
     {
-        perror("Erreur lors de l'ouverture du fichier");
-        return;
+        return 1;
     }
-    char line[1024];
-    char *inputBuffer = NULL;
-    size_t inputSize = 0;
-    while (fgets(line, sizeof(line), file))
+    int failed = useCache ? runCachedScript(session, fileName, source.data, source.length)
+                          : interpretBuffer(source.data, source.length);
+    releaseSource(&source);
+    return failed;
+}
+
+// Script piped on the standard input, ex: echo 'print(1);' | ./interp -
+int interpretStdin()
+{
+    SourceBuffer source;
+    if (loadSourceStream(STDIN_FILENO, &source) != 0)
     {
-        size_t len = strlen(line);
-        inputBuffer = realloc(inputBuffer, inputSize + len + 1);
-        strcpy(inputBuffer + inputSize, line);
-        inputSize += len;
+        return 1;
     }
-    fclose(file);
-
-    interpret(inputBuffer);
-
-    free(inputBuffer);
+    int failed = interpretBuffer(source.data, source.length);
+    releaseSource(&source);
+    return failed;
 }
 
 void interactiveMode()
 {
     char inputLine[256];
+    session->keepFunctions = 1; // A function declared on one line is called on the next ones
     printf("Mode interactif. Tapez 'exit' pour quitter.\n");
     while (1)
     {
@@ -60,38 +71,204 @@ void interactiveMode()
     }
 }
 
-void handleInput()
+// Menu shown when the command line names no script
+int handleInput()
 {
+    char choice[16];
     int mode = 0;
 
-    do
+    while (mode != 1 && mode != 2)
     {
-        system("clear");
         printf("Choisissez le mode d'exécution:\n");
         printf("1. Mode fichier\n");
         printf("2. Mode interactif\n");
         printf("Entrez votre choix (1 ou 2): ");
-        scanf("%d", &mode);
-        getchar();
-    } while (mode != 1 && mode != 2);
+        if (fgets(choice, sizeof(choice), stdin) == NULL)
+        {
+            return 0;
+        }
+        mode = atoi(choice);
+    }
 
     if (mode == 1)
     {
         printf("Entrez le nom du fichier: ");
         char fileName[256];
-        fgets(fileName, sizeof(fileName), stdin);
+        if (fgets(fileName, sizeof(fileName), stdin) == NULL)
+        {
+            return 1;
+        }
         fileName[strcspn(fileName, "\n")] = 0;
-        interpretFile(fileName);
-    }
-    else if (mode == 2)
-    {
-        interactiveMode();
+        return interpretFile(fileName);
     }
+    interactiveMode();
+    return 0;
+}
+
+static void reportProfile()
+{
+    fflush(stdout);
+    printProfile(stderr);
+}
+
+static void printUsage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options] [script | -]\n"
+            "       %s [options] -e 'code'\n"
+            "       %s [options] --batch script...\n"
+            "Options:\n"
+            "  --tree-walk         run with the recursive evaluator instead of the VM\n"
+            "  --jit               run the loops of the integer subset as machine code\n"
+            "  --stream            execute each top-level statement right after parsing it\n"
+            "  --no-optimize       evaluate the AST exactly as parsed\n"
+            "  --stack-limit N     entries allowed in each work stack and in the VM stack\n"
+            "  --emit-c FILE       write the program as C instead of running it\n"
+            "  --compile FILE      build a native executable with the system C compiler\n"
+            "  --profile           count and time every statement\n"
+            "  --trace SPEC        trace subsystems, ex: lexer=1,eval=2\n"
+            "  --cache             reuse the parsed program of unchanged script files\n"
+            "  --cache-dir DIR     same, with the cache files kept in DIR\n"
+            "  --threads N         threads of the batch runner\n",
+            program, program, program);
 }
 
 // Main function
-int main()
+int main(int argc, char *argv[])
 {
-    handleInput();
-    return 0;
+    const char *traceSpec = getenv("INTERP_TRACE");
+    if (traceSpec != NULL && configureTrace(traceSpec) != 0)
+    {
+        return 1;
+    }
+    int tracing = traceSpec != NULL;
+    const char *scriptFile = NULL;
+    const char *inlineCode = NULL;
+    char **batchFiles = NULL;
+    int batchCount = 0;
+    int threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; i++)
+    {
+        // Check the VM against the recursive evaluator
+        if (strcmp(argv[i], "--tree-walk") == 0)
+        {
+            useTreeWalker = 1;
+        }
+        // Run the loops of the integer subset as x86-64 machine code
+        else if (strcmp(argv[i], "--jit") == 0)
+        {
+            useJit = 1;
+        }
+        // Execute each top-level statement right after parsing it
+        else if (strcmp(argv[i], "--stream") == 0)
+        {
+            streamStatements = 1;
+        }
+        // Evaluate the AST exactly as parsed
+        else if (strcmp(argv[i], "--no-optimize") == 0)
+        {
+            useOptimizer = 0;
+        }
+        // Entries allowed in each work stack and in the VM stack, ex: --stack-limit 1000000
+        else if (strcmp(argv[i], "--stack-limit") == 0 && i + 1 < argc)
+        {
+            workStackLimit = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        // Write the program as C instead of running it, ex: --emit-c script.c
+        else if (strcmp(argv[i], "--emit-c") == 0 && i + 1 < argc)
+        {
+            emitCFile = argv[++i];
+        }
+        // Build a native executable with the system C compiler, ex: --compile script
+        else if (strcmp(argv[i], "--compile") == 0 && i + 1 < argc)
+        {
+            compileOutput = argv[++i];
+        }
+        // Count and time every statement, the report is printed on exit
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            useProfiler = 1;
+        }
+        // Trace subsystems, ex: --trace lexer=1,eval=2
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            if (configureTrace(argv[++i]) != 0)
+            {
+                return 1;
+            }
+            tracing = 1;
+        }
+        // Reuse the parsed program of unchanged script files, ex: --cache or --cache-dir /tmp/interp
+        else if (strcmp(argv[i], "--cache") == 0)
+        {
+            useCache = 1;
+        }
+        else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc)
+        {
+            useCache = 1;
+            cacheDirectory = argv[++i];
+        }
+        // Threads of the batch runner, ex: --threads 4
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threadCount = atoi(argv[++i]);
+        }
+        // Run every following file as an independent script, ex: --batch a.txt b.txt
+        else if (strcmp(argv[i], "--batch") == 0)
+        {
+            batchFiles = argv + i + 1;
+            batchCount = argc - i - 1;
+            break;
+        }
+        // Run the code given on the command line, ex: -e 'print(1 + 2);'
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc && scriptFile == NULL && inlineCode == NULL)
+        {
+            inlineCode = argv[++i];
+        }
+        // Script to run, "-" reads it from the standard input
+        else if ((argv[i][0] != '-' || argv[i][1] == '\0') && scriptFile == NULL && inlineCode == NULL)
+        {
+            scriptFile = argv[i];
+        }
+        // Unknown option, an option missing its argument, or a second script
+        else
+        {
+            fprintf(stderr, "Error: Unexpected argument '%s'\n", argv[i]);
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // The profiler, the trace and the C output are shared by the whole process
+    if (batchFiles != NULL)
+    {
+        if (useProfiler || tracing || emitCFile != NULL || compileOutput != NULL)
+        {
+            printf("Batch Error: --profile, --trace, --emit-c and --compile take a single script\n");
+            return 1;
+        }
+        return runBatch(batchFiles, batchCount, threadCount);
+    }
+
+    // Only the tree walker runs statements one by one, and positions need the whole source
+    if (useProfiler)
+    {
+        useTreeWalker = 1;
+        streamStatements = 0;
+        atexit(reportProfile);
+    }
+
+    // Bound for the whole run so that the trace printed at exit can name variables
+    session = createInterpreter(stdout);
+    interp = session;
+    if (inlineCode != NULL)
+    {
+        return interpret(inlineCode);
+    }
+    if (scriptFile != NULL)
+    {
+        return strcmp(scriptFile, "-") == 0 ? interpretStdin() : interpretFile(scriptFile);
+    }
+    return handleInput();
 }
\ No newline at end of file
@@ -1,9 +1,13 @@
 #ifndef INPUT_H
 #define INPUT_H
 
-void interpret(const char *inputExpression);
-void interpretFile(const char *fileName);
+#include <stddef.h>
+
+int interpret(const char *inputExpression);
+int interpretBuffer(const char *buffer, size_t length);
+int interpretFile(const char *fileName);
+int interpretStdin();
 void interactiveMode();
-void handleInput();
+int handleInput();
 
 #endif
\ No newline at end of file
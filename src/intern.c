@@ -0,0 +1,106 @@
+#include "intern.h"
+#include "interpreter.h"
+#include "output.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// FNV-1a hash, also used by the symbol table
+uint32_t hashBytes(const char *text, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void *allocOrDie(void *pointer)
+{
+    if (pointer == NULL)
+    {
+        reportError("Interner Error: Out of memory\n");
+        failInterpreter();
+    }
+    return pointer;
+}
+
+static void growSlots(Interner *interner)
+{
+    uint32_t slotCount = interner->slots == NULL ? 256 : (interner->slotMask + 1) * 2;
+    uint32_t *slots = allocOrDie(calloc(slotCount, sizeof(uint32_t)));
+    uint32_t mask = slotCount - 1;
+
+    for (uint32_t id = 0; id < interner->count; id++)
+    {
+        uint32_t slot = interner->hashes[id] & mask;
+        while (slots[slot] != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id + 1;
+    }
+
+    free(interner->slots);
+    interner->slots = slots;
+    interner->slotMask = mask;
+}
+
+// Return the id of text, adding it to the pool on first use
+InternId internString(const char *text, size_t length)
+{
+    Interner *interner = &interp->interner;
+    if (interner->slots == NULL || (interner->count + 1) * 2 > interner->slotMask + 1)
+    {
+        growSlots(interner);
+    }
+
+    uint32_t hash = hashBytes(text, length);
+    uint32_t slot = hash & interner->slotMask;
+    while (interner->slots[slot] != 0)
+    {
+        InternId id = interner->slots[slot] - 1;
+        if (interner->hashes[id] == hash && interner->lengths[id] == length &&
+            memcmp(interner->chars + interner->offsets[id], text, length) == 0)
+        {
+            return id;
+        }
+        slot = (slot + 1) & interner->slotMask;
+    }
+
+    if (interner->count == interner->capacity)
+    {
+        interner->capacity = interner->capacity == 0 ? 128 : interner->capacity * 2;
+        interner->offsets = allocOrDie(realloc(interner->offsets, interner->capacity * sizeof(uint32_t)));
+        interner->lengths = allocOrDie(realloc(interner->lengths, interner->capacity * sizeof(uint32_t)));
+        interner->hashes = allocOrDie(realloc(interner->hashes, interner->capacity * sizeof(uint32_t)));
+    }
+    while (interner->charCount + length + 1 > interner->charCapacity)
+    {
+        interner->charCapacity = interner->charCapacity == 0 ? 4096 : interner->charCapacity * 2;
+        interner->chars = allocOrDie(realloc(interner->chars, interner->charCapacity));
+    }
+
+    InternId id = interner->count++;
+    interner->offsets[id] = interner->charCount;
+    interner->lengths[id] = (uint32_t)length;
+    interner->hashes[id] = hash;
+    memcpy(interner->chars + interner->charCount, text, length);
+    interner->chars[interner->charCount + length] = '\0';
+    interner->charCount += length + 1;
+    interner->slots[slot] = id + 1;
+    return id;
+}
+
+void freeInterner()
+{
+    Interner *interner = &interp->interner;
+    free(interner->chars);
+    free(interner->offsets);
+    free(interner->lengths);
+    free(interner->hashes);
+    free(interner->slots);
+    memset(interner, 0, sizeof(Interner));
+}
@@ -0,0 +1,34 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Interned strings are identified by their index, the same text always gets the same id
+typedef uint32_t InternId;
+
+// String pool, the text of every interned string is stored once and null terminated
+typedef struct
+{
+    char *chars;
+    uint32_t charCount;
+    uint32_t charCapacity;
+
+    uint32_t *offsets; // Start of each string in chars
+    uint32_t *lengths;
+    uint32_t *hashes;
+    uint32_t count;
+    uint32_t capacity;
+
+    uint32_t *slots; // Open addressing index, id + 1 (0 = empty)
+    uint32_t slotMask;
+} Interner;
+
+// Interner functions
+uint32_t hashBytes(const char *text, size_t length);
+InternId internString(const char *text, size_t length);
+void freeInterner();
+
+// internedText, internedLength and internedHash read the bound interpreter, see interpreter.h
+
+#endif
@@ -0,0 +1,168 @@
+#include "interpreter.h"
+#include "output.h"
+#include "optimizer.h"
+#include "jit.h"
+#include "emitc.h"
+#include <stdlib.h>
+#include <string.h>
+
+_Thread_local Interpreter *interp = NULL;
+
+Interpreter *createInterpreter(FILE *out)
+{
+    Interpreter *interpreter = calloc(1, sizeof(Interpreter));
+    if (interpreter == NULL)
+    {
+        fprintf(out, "Runtime Error: Out of memory\n");
+        exit(1);
+    }
+    interpreter->out = out;
+    interpreter->lexer.locatedLine = 1;
+    initChunk(&interpreter->chunk);
+    return interpreter;
+}
+
+void destroyInterpreter(Interpreter *interpreter)
+{
+    Interpreter *previous = interp;
+    interp = interpreter;
+    flushOutput();
+    freeSymbolTable();
+    releaseString(&interpreter->joinedKey);
+    freeInterner();
+    releaseJitCode();
+    interp = previous == interpreter ? NULL : previous;
+
+    free(interpreter->arena.words);
+    freeWorkStack(&interpreter->operandStack);
+    freeWorkStack(&interpreter->operatorStack);
+    freeWorkStack(&interpreter->parseStack);
+    freeWorkStack(&interpreter->expressionStack);
+    freeWorkStack(&interpreter->valueStack);
+    freeWorkStack(&interpreter->frameStack);
+    freeWorkStack(&interpreter->functions);
+    freeWorkStack(&interpreter->localNames);
+    freeWorkStack(&interpreter->localStack);
+    freeWorkStack(&interpreter->compiledFunctions);
+    freeWorkStack(&interpreter->pendingCalls);
+    freeWorkStack(&interpreter->foldStack);
+    freeWorkStack(&interpreter->resultStack);
+    freeWorkStack(&interpreter->compileStack);
+    freeWorkStack(&interpreter->emitStack);
+    free(interpreter->nameFlags);
+    freeChunk(&interpreter->chunk);
+    free(interpreter->vmStack);
+    free(interpreter);
+}
+
+// Leave the running script, its variables are kept
+void failInterpreter(void)
+{
+    if (interp == NULL || interp->recover == NULL)
+    {
+        if (interp != NULL)
+        {
+            flushOutput();
+        }
+        exit(1);
+    }
+    longjmp(*interp->recover, 1);
+}
+
+// Drop what a failed script left half done, the arena may belong to a compiled program so it is only emptied.
+// The functions of earlier scripts are kept.
+static void recoverInterpreter(Interpreter *interpreter)
+{
+    releaseJitCode();
+    interpreter->arena.count = interpreter->keptWords;
+    interpreter->blockDepth = 0;
+    interpreter->trackNames = 0;
+    interpreter->loopSlotCount = 0;
+    interpreter->operandStack.count = 0;
+    interpreter->operatorStack.count = 0;
+    interpreter->parseStack.count = 0;
+    interpreter->expressionStack.count = 0;
+    interpreter->valueStack.count = 0;
+    interpreter->frameStack.count = 0;
+    interpreter->functions.count = interpreter->keptFunctions;
+    interpreter->localNames.count = 0;
+    interpreter->scopeBase = 0;
+    interpreter->slotCount = 0;
+    interpreter->currentFunction = NULL_NODE;
+    interpreter->localStack.count = 0;
+    interpreter->localBase = 0;
+    interpreter->callBase = 0;
+    interpreter->returnValue = 0;
+    interpreter->resuming = 0;
+    interpreter->compiledFunctions.count = 0;
+    interpreter->pendingCalls.count = 0;
+    interpreter->foldStack.count = 0;
+    interpreter->resultStack.count = 0;
+    interpreter->compileStack.count = 0;
+    interpreter->emitStack.count = 0;
+}
+
+static void unbindInterpreter(Interpreter *interpreter, Interpreter *previous)
+{
+    flushOutput();
+    interpreter->recover = NULL;
+    interp = previous;
+}
+
+// Call step with the interpreter bound to the calling thread, 1 when it failed.
+// Errors return here through failInterpreter, the variables are kept.
+int guardInterpreter(Interpreter *interpreter, void (*step)(void *context), void *context)
+{
+    Interpreter *previous = interp;
+    jmp_buf recover;
+
+    interp = interpreter;
+    interpreter->recover = &recover;
+    if (setjmp(recover) != 0)
+    {
+        recoverInterpreter(interpreter);
+        unbindInterpreter(interpreter, previous);
+        return 1;
+    }
+    step(context);
+    unbindInterpreter(interpreter, previous);
+    return 0;
+}
+
+typedef struct
+{
+    const char *buffer;
+    size_t length;
+} ScriptSource;
+
+static void runSource(void *context)
+{
+    ScriptSource *source = context;
+    setInputBuffer(source->buffer, source->length);
+    if (emitCFile != NULL || compileOutput != NULL)
+    {
+        uint32_t removed;
+        NodeRef program = parseProgram();
+        if (useOptimizer)
+        {
+            program = optimizeProgram(program, &removed);
+        }
+        translateProgram(program);
+    }
+    else if (streamStatements)
+    {
+        streamProgram();
+    }
+    else
+    {
+        evaluateProgram(parseProgram());
+    }
+    freeAST();
+}
+
+// Run length bytes of source with the options of the command line, 1 when the script failed
+int runScript(Interpreter *interpreter, const char *buffer, size_t length)
+{
+    ScriptSource source = {buffer, length};
+    return guardInterpreter(interpreter, runSource, &source);
+}
@@ -0,0 +1,110 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "compiler.h"
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Induction variables of the counted loops being compiled, see compiler.c
+#define MAX_LOOP_SLOTS 64
+
+// Bytes of program output kept before writing them to out, see output.c
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+// Everything one script needs while it runs, interpreters only share the command line options
+typedef struct Interpreter
+{
+    // Front end
+    Lexer lexer;
+    Token currentToken;
+    int blockDepth;
+    Interner interner;
+    ASTArena arena;
+    WorkStack operandStack; // Operands and pending operators of parseExpression
+    WorkStack operatorStack;
+    WorkStack parseStack;   // Statements waiting for the end of their block
+    WorkStack functions;    // Name and node of each declared function
+    int keepFunctions;      // Functions stay declared for the next scripts, set by the interactive mode
+    uint32_t keptFunctions; // Entries of functions declared by earlier scripts
+    uint32_t keptWords;     // Arena words kept for them, the nodes of the scripts that declared them
+    WorkStack localNames;   // Name of each slot visible from the statement being parsed
+    uint32_t scopeBase;     // First slot of the innermost block
+    uint32_t slotCount;     // Slots used so far by the function being parsed
+    NodeRef currentFunction;
+
+    // Tree walker
+    SymbolTable symbols;
+    StringValue joinedKey; // Last dict key joined from a string expression, see keyFromNode
+    WorkStack expressionStack; // Pending nodes and computed values of runExpressions
+    WorkStack valueStack;
+    WorkStack frameStack;
+    WorkStack localStack; // Slots of the top level blocks, then of the running functions, one frame after the other
+    uint32_t localBase;   // First slot of the running function
+    uint32_t callBase;    // Frame stack count when it was called
+    int returnValue;
+    uint32_t resumeBase;  // Pending work of the expression that entered the call that just returned
+    int resuming;
+
+    // Optimizer, names are indexed by InternId
+    uint8_t *nameFlags;
+    uint32_t nameCapacity;
+    int trackNames;
+    WorkStack foldStack;
+    WorkStack resultStack;
+
+    // Bytecode engine
+    Chunk chunk;
+    WorkStack compileStack;
+    struct
+    {
+        InternId name;
+        int slot;
+    } loopSlots[MAX_LOOP_SLOTS];
+    int loopSlotCount;
+    WorkStack compiledFunctions; // Node, entry and frame size of each function in the chunk
+    WorkStack pendingCalls;      // Operand position and node of each call to patch
+    int *vmStack;
+    int vmStackCapacity;
+
+    // Machine code of the running loop, unmapped by failInterpreter too
+    void *jitCode;
+    size_t jitSize;
+
+    // Ahead of time translation
+    WorkStack emitStack;
+
+    char output[OUTPUT_BUFFER_SIZE]; // Program output not written to out yet
+    size_t outputLength;
+    FILE *out;         // Program output and error messages
+    jmp_buf *recover;  // Where failInterpreter returns to, NULL exits the process
+} Interpreter;
+
+// Interpreter the modules work on, bound to the calling thread by runScript
+extern _Thread_local Interpreter *interp;
+
+// Interpreter functions
+Interpreter *createInterpreter(FILE *out);
+void destroyInterpreter(Interpreter *interpreter);
+int runScript(Interpreter *interpreter, const char *buffer, size_t length);
+int guardInterpreter(Interpreter *interpreter, void (*step)(void *context), void *context);
+void failInterpreter(void) __attribute__((noreturn));
+
+// Text of an interned string, only valid until the next internString call
+static inline const char *internedText(InternId id)
+{
+    return interp->interner.chars + interp->interner.offsets[id];
+}
+
+static inline uint32_t internedLength(InternId id)
+{
+    return interp->interner.lengths[id];
+}
+
+// Symbol table hash of an interned string
+static inline uint32_t internedHash(InternId id)
+{
+    return interp->interner.hashes[id];
+}
+
+#endif
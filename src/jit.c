@@ -0,0 +1,999 @@
+#include "jit.h"
+#include "interpreter.h"
+#include "output.h"
+#include "vm.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#include <sys/mman.h>
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+int useJit = 0;
+
+// Statements from first to last go to the VM as one chunk, in the slots of the whole program
+static void runSegment(NodeRef first, NodeRef last, Chunk *chunk, int slots)
+{
+    NodeRef after = NEXT_NODE(last);
+    NEXT_NODE(last) = NULL_NODE;
+    resetChunk(chunk);
+    chunk->slotCount = slots;
+    compileProgram(first, chunk);
+    // Linked again before running, a runtime error must not cut a compiled program
+    NEXT_NODE(last) = after;
+    runChunk(chunk);
+}
+
+#if JIT_SUPPORTED
+
+#define JIT_MAX_VARIABLES 256
+#define JIT_MAX_PUSHES 4096 // Machine stack words one expression may use
+#define JIT_REGISTERS 4
+
+// Variables of a loop, the native code addresses them from rbx
+typedef struct
+{
+    int32_t values[JIT_MAX_VARIABLES];
+    uint8_t defined[JIT_MAX_VARIABLES]; // 0 until the variable exists
+} JitFrame;
+
+typedef void (*JitFunction)(JitFrame *frame);
+
+#define VALUE_OFFSET(variable) ((int32_t)(variable) * 4)
+#define DEFINED_OFFSET(variable) ((int32_t)offsetof(JitFrame, defined) + (int32_t)(variable))
+
+// x86-64 registers, numbered as in their encoding
+enum
+{
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RBX = 3,
+    RDI = 7,
+    R12 = 12,
+    R13 = 13,
+    R14 = 14,
+    R15 = 15,
+};
+
+// Callee saved, they survive the calls to the print and error helpers
+static const int variableRegisters[JIT_REGISTERS] = {R12, R13, R14, R15};
+
+// Condition codes, cc ^ 1 is the opposite condition
+enum
+{
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_L = 0xC,
+    CC_GE = 0xD,
+    CC_LE = 0xE,
+    CC_G = 0xF,
+};
+
+typedef enum
+{
+    OPERAND_IMMEDIATE,
+    OPERAND_VARIABLE,
+    OPERAND_RCX,
+} OperandKind;
+
+typedef struct
+{
+    OperandKind kind;
+    int32_t value; // Constant or variable index
+} Operand;
+
+typedef struct
+{
+    uint8_t *code;
+    uint32_t count;
+    uint32_t capacity;
+
+    InternId names[JIT_MAX_VARIABLES];
+    uint32_t uses[JIT_MAX_VARIABLES];
+    int8_t registers[JIT_MAX_VARIABLES]; // Register holding the variable, -1 for its frame slot
+    uint8_t known[JIT_MAX_VARIABLES];    // Existed before the loop, reads need no check
+    uint32_t variableCount;
+
+    WorkStack work;           // Pending blocks of the loop, then pending nodes of compileExpression
+    WorkStack undefinedJumps; // Jump position and variable of each check of an unassigned read
+    WorkStack divisionJumps;  // Jump position of each check of a failing division, ecx holds the divisor
+    uint32_t pushes;          // Words the current expression keeps on the machine stack
+    int failed;
+} Jit;
+
+// Helpers called from the native code
+
+static void jitPrint(int value)
+{
+    printInt(value);
+}
+
+static void jitUndefined(InternId name)
+{
+    reportError("Runtime Error: Undefined variable '%s'\n", internedText(name));
+    failInterpreter();
+}
+
+// Encoding
+
+static void emitByte(Jit *jit, uint8_t byte)
+{
+    if (jit->count == jit->capacity)
+    {
+        jit->capacity = jit->capacity == 0 ? 4096 : jit->capacity * 2;
+        jit->code = realloc(jit->code, jit->capacity);
+        if (jit->code == NULL)
+        {
+            reportError("JIT Error: Out of memory\n");
+            failInterpreter();
+        }
+    }
+    jit->code[jit->count++] = byte;
+}
+
+static void emit32(Jit *jit, int32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        emitByte(jit, (uint8_t)((uint32_t)value >> (8 * i)));
+    }
+}
+
+static void emitOpcode(Jit *jit, int opcode)
+{
+    if (opcode > 0xFF)
+    {
+        emitByte(jit, (uint8_t)(opcode >> 8));
+    }
+    emitByte(jit, (uint8_t)opcode);
+}
+
+// opcode reg, [rbx + offset]
+static void emitFrameAccess(Jit *jit, int opcode, int reg, int32_t offset)
+{
+    if (reg >= 8)
+    {
+        emitByte(jit, 0x44);
+    }
+    emitOpcode(jit, opcode);
+    emitByte(jit, (uint8_t)(0x80 | ((reg & 7) << 3) | RBX));
+    emit32(jit, offset);
+}
+
+// opcode reg, operand where the operand is a variable or ecx
+static void emitRegisterOperand(Jit *jit, int opcode, int reg, Operand operand)
+{
+    int rm = operand.kind == OPERAND_RCX ? RCX : jit->registers[operand.value];
+    if (rm < 0)
+    {
+        emitFrameAccess(jit, opcode, reg, VALUE_OFFSET(operand.value));
+        return;
+    }
+    uint8_t rex = (uint8_t)(0x40 | (reg >= 8 ? 0x04 : 0) | (rm >= 8 ? 0x01 : 0));
+    if (rex != 0x40)
+    {
+        emitByte(jit, rex);
+    }
+    emitOpcode(jit, opcode);
+    emitByte(jit, (uint8_t)(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// mov reg, operand
+static void emitLoad(Jit *jit, int reg, Operand operand)
+{
+    if (operand.kind == OPERAND_IMMEDIATE)
+    {
+        emitByte(jit, (uint8_t)(0xB8 + reg));
+        emit32(jit, operand.value);
+        return;
+    }
+    emitRegisterOperand(jit, 0x8B, reg, operand);
+}
+
+// mov rax, function ; call rax
+static void emitCall(Jit *jit, uintptr_t function)
+{
+    uint64_t address = (uint64_t)function;
+    emitByte(jit, 0x48);
+    emitByte(jit, 0xB8);
+    for (int i = 0; i < 8; i++)
+    {
+        emitByte(jit, (uint8_t)(address >> (8 * i)));
+    }
+    emitByte(jit, 0xFF);
+    emitByte(jit, 0xD0);
+}
+
+// Jump with a placeholder target, cc < 0 jumps always, returns the position of the displacement
+static uint32_t emitJump(Jit *jit, int cc)
+{
+    if (cc < 0)
+    {
+        emitByte(jit, 0xE9);
+    }
+    else
+    {
+        emitByte(jit, 0x0F);
+        emitByte(jit, (uint8_t)(0x80 | cc));
+    }
+    emit32(jit, 0);
+    return jit->count - 4;
+}
+
+static void patchJump(Jit *jit, uint32_t at, uint32_t target)
+{
+    int32_t displacement = (int32_t)(target - (at + 4));
+    memcpy(jit->code + at, &displacement, 4);
+}
+
+static void emitJumpTo(Jit *jit, int cc, uint32_t target)
+{
+    patchJump(jit, emitJump(jit, cc), target);
+}
+
+// Variables
+
+// Key of a block variable, no interned id has the high bit set
+#define JIT_SLOT(slot) (0x80000000u | (slot))
+
+static int isSlotKey(InternId name)
+{
+    return (name & JIT_SLOT(0)) != 0;
+}
+
+static int findVariable(Jit *jit, InternId name)
+{
+    for (uint32_t i = 0; i < jit->variableCount; i++)
+    {
+        if (jit->names[i] == name)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static int addVariable(Jit *jit, InternId name)
+{
+    int variable = findVariable(jit, name);
+    if (variable < 0)
+    {
+        if (jit->variableCount == JIT_MAX_VARIABLES)
+        {
+            return 1;
+        }
+        variable = (int)jit->variableCount++;
+        jit->names[variable] = name;
+    }
+    jit->uses[variable]++;
+    return 0;
+}
+
+// Collect the variables, non zero when the loop leaves the integer subset
+static int visitJitNode(NodeRef node, void *context)
+{
+    Jit *jit = context;
+    switch (NODE_TYPE(node))
+    {
+    case NumberNode:
+    case CharLiteralNode:
+    case PrintNode:
+    case FlushNode:
+    case IfNode:
+    case ForNode:
+    case WhileNode:
+        return 0;
+    case BinaryOpNode:
+        return IS_CONCATENATION(node);
+    case IdentifierNode:
+        return addVariable(jit, NODE(node, IdentifierRecord)->name);
+    case LocalNode:
+        return addVariable(jit, JIT_SLOT(NODE(node, LocalRecord)->slot));
+    case LocalAssignNode:
+        return addVariable(jit, JIT_SLOT(NODE(node, LocalAssignRecord)->slot));
+    case AssignmentNode:
+        if (NODE(node, AssignmentRecord)->header.varType != TYPE_INT)
+        {
+            return 1;
+        }
+        return addVariable(jit, NODE(node, AssignmentRecord)->name);
+    default:
+        return 1;
+    }
+}
+
+// The most used variables get the callee saved registers
+static void allocateRegisters(Jit *jit)
+{
+    memset(jit->registers, -1, sizeof(jit->registers));
+    for (int r = 0; r < JIT_REGISTERS; r++)
+    {
+        int best = -1;
+        for (uint32_t i = 0; i < jit->variableCount; i++)
+        {
+            if (jit->registers[i] < 0 && (best < 0 || jit->uses[i] > jit->uses[best]))
+            {
+                best = (int)i;
+            }
+        }
+        if (best < 0)
+        {
+            break;
+        }
+        jit->registers[best] = (int8_t)variableRegisters[r];
+    }
+}
+
+// Reads of a variable created inside the loop fail like OP_LOAD until it is assigned
+static Operand variableOperand(Jit *jit, InternId name)
+{
+    int variable = findVariable(jit, name);
+    if (!jit->known[variable])
+    {
+        // cmp byte [rbx + defined], 0 ; je stub
+        emitByte(jit, 0x80);
+        emitByte(jit, 0xBB);
+        emit32(jit, DEFINED_OFFSET(variable));
+        emitByte(jit, 0);
+        pushWork(&jit->undefinedJumps, emitJump(jit, CC_E));
+        pushWork(&jit->undefinedJumps, (uint32_t)variable);
+    }
+    Operand operand = {OPERAND_VARIABLE, variable};
+    return operand;
+}
+
+// Expressions
+
+static int isLeaf(NodeRef node)
+{
+    return NODE_TYPE(node) != BinaryOpNode;
+}
+
+// Constant or variable, a char literal counts as its first character like in the VM
+static Operand leafOperand(Jit *jit, NodeRef node)
+{
+    Operand operand = {OPERAND_IMMEDIATE, 0};
+    switch (NODE_TYPE(node))
+    {
+    case NumberNode:
+        operand.value = NODE(node, NumberRecord)->value;
+        break;
+    case CharLiteralNode:
+        operand.value = NODE(node, CharLiteralRecord)->text[0];
+        break;
+    case LocalNode:
+        operand = variableOperand(jit, JIT_SLOT(NODE(node, LocalRecord)->slot));
+        break;
+    default:
+        operand = variableOperand(jit, NODE(node, IdentifierRecord)->name);
+        break;
+    }
+    return operand;
+}
+
+static int conditionCode(TokenType op)
+{
+    switch (op)
+    {
+    case Lt:
+        return CC_L;
+    case Le:
+        return CC_LE;
+    case Gt:
+        return CC_G;
+    case Ge:
+        return CC_GE;
+    default:
+        return CC_NE;
+    }
+}
+
+// eax = eax op operand. With condition set, a comparison only sets the flags and returns its condition code.
+static int emitOperator(Jit *jit, TokenType op, Operand operand, int condition)
+{
+    int immediate = operand.kind == OPERAND_IMMEDIATE;
+    switch (op)
+    {
+    case Add:
+    case Sub:
+        if (immediate)
+        {
+            emitByte(jit, op == Add ? 0x05 : 0x2D);
+            emit32(jit, operand.value);
+        }
+        else
+        {
+            emitRegisterOperand(jit, op == Add ? 0x03 : 0x2B, RAX, operand);
+        }
+        return -1;
+
+    case Mul:
+        if (immediate)
+        {
+            emitByte(jit, 0x69); // imul eax, eax, imm32
+            emitByte(jit, 0xC0);
+            emit32(jit, operand.value);
+        }
+        else
+        {
+            emitRegisterOperand(jit, 0x0FAF, RAX, operand);
+        }
+        return -1;
+
+    case Div:
+    case Mod:
+        if (operand.kind != OPERAND_RCX)
+        {
+            emitLoad(jit, RCX, operand);
+        }
+        // idiv traps on a zero divisor and on INT_MIN / -1, both go to the stub of emitEpilogue
+        if (!immediate || operand.value == 0)
+        {
+            emitByte(jit, 0x85); // test ecx, ecx ; je stub
+            emitByte(jit, 0xC9);
+            pushWork(&jit->divisionJumps, emitJump(jit, CC_E));
+        }
+        if (!immediate || operand.value == -1)
+        {
+            uint32_t skip = 0;
+            if (!immediate)
+            {
+                emitByte(jit, 0x83); // cmp ecx, -1 ; jne skip
+                emitByte(jit, 0xF9);
+                emitByte(jit, 0xFF);
+                skip = emitJump(jit, CC_NE);
+            }
+            emitByte(jit, 0x3D); // cmp eax, INT_MIN ; je stub
+            emit32(jit, INT32_MIN);
+            pushWork(&jit->divisionJumps, emitJump(jit, CC_E));
+            if (!immediate)
+            {
+                patchJump(jit, skip, jit->count);
+            }
+        }
+        emitByte(jit, 0x99); // cdq
+        emitByte(jit, 0xF7); // idiv ecx
+        emitByte(jit, 0xF9);
+        if (op == Mod)
+        {
+            emitByte(jit, 0x89); // mov eax, edx
+            emitByte(jit, 0xD0);
+        }
+        return -1;
+
+    default:
+    {
+        if (immediate)
+        {
+            emitByte(jit, 0x3D);
+            emit32(jit, operand.value);
+        }
+        else
+        {
+            emitRegisterOperand(jit, 0x3B, RAX, operand);
+        }
+        int cc = conditionCode(op);
+        if (condition)
+        {
+            return cc;
+        }
+        emitByte(jit, 0x0F); // setcc al
+        emitByte(jit, (uint8_t)(0x90 | cc));
+        emitByte(jit, 0xC0);
+        emitByte(jit, 0x0F); // movzx eax, al
+        emitByte(jit, 0xB6);
+        emitByte(jit, 0xC0);
+        return -1;
+    }
+    }
+}
+
+// States of a node in compileExpression
+enum
+{
+    EXPRESSION_START,
+    EXPRESSION_LEFT_DONE,   // Save the left value before computing the right one
+    EXPRESSION_APPLY_LEAF,  // Left value in eax, the right operand is a leaf
+    EXPRESSION_APPLY_STACK, // Left value on the machine stack, right value in eax
+};
+
+// Value of root in eax, binary operators with a leaf on the right use it directly.
+// With condition set, a comparison at the root returns its condition code instead, -1 otherwise.
+static int compileExpression(Jit *jit, NodeRef root, int condition)
+{
+    WorkStack *work = &jit->work;
+    uint32_t base = work->count;
+    int cc = -1;
+    pushWork(work, root);
+    pushWork(work, EXPRESSION_START);
+
+    while (work->count > base)
+    {
+        uint32_t state = POP_WORK(work);
+        NodeRef node = POP_WORK(work);
+
+        if (state == EXPRESSION_START)
+        {
+            if (isLeaf(node))
+            {
+                emitLoad(jit, RAX, leafOperand(jit, node));
+                continue;
+            }
+            BinaryOpRecord *record = NODE(node, BinaryOpRecord);
+            pushWork(work, node);
+            pushWork(work, isLeaf(record->right) ? EXPRESSION_APPLY_LEAF : EXPRESSION_LEFT_DONE);
+            pushWork(work, record->left);
+            pushWork(work, EXPRESSION_START);
+        }
+        else if (state == EXPRESSION_LEFT_DONE)
+        {
+            emitByte(jit, 0x50); // push rax
+            if (++jit->pushes > JIT_MAX_PUSHES)
+            {
+                jit->failed = 1;
+                work->count = base;
+                return -1;
+            }
+            pushWork(work, node);
+            pushWork(work, EXPRESSION_APPLY_STACK);
+            pushWork(work, NODE(node, BinaryOpRecord)->right);
+            pushWork(work, EXPRESSION_START);
+        }
+        else
+        {
+            BinaryOpRecord *record = NODE(node, BinaryOpRecord);
+            Operand operand = {OPERAND_RCX, 0};
+            if (state == EXPRESSION_APPLY_LEAF)
+            {
+                operand = leafOperand(jit, record->right);
+            }
+            else
+            {
+                emitByte(jit, 0x89); // mov ecx, eax
+                emitByte(jit, 0xC1);
+                emitByte(jit, 0x58); // pop rax
+                jit->pushes--;
+            }
+            cc = emitOperator(jit, (TokenType)record->header.tokenType, operand, condition && node == root);
+        }
+    }
+    return cc;
+}
+
+// Condition code that holds when the expression is true
+static int compileCondition(Jit *jit, NodeRef condition)
+{
+    int cc = compileExpression(jit, condition, 1);
+    if (cc < 0)
+    {
+        emitByte(jit, 0x85); // test eax, eax
+        emitByte(jit, 0xC0);
+        cc = CC_NE;
+    }
+    return cc;
+}
+
+// Statements
+
+// What is left to emit once a block is compiled, a frame is its words with its kind on top
+enum
+{
+    BLOCK_LIST,   // Next statement
+    BLOCK_ELSE,   // Else branch, jump over the then branch
+    BLOCK_END_IF, // Jump over the else branch
+    BLOCK_LOOP,   // Loop node, jump to the condition, start of the body
+};
+
+static void pushBlock(Jit *jit, NodeRef node)
+{
+    pushWork(&jit->work, node);
+    pushWork(&jit->work, BLOCK_LIST);
+}
+
+static void compileAssignment(Jit *jit, NodeRef node)
+{
+    int variable;
+    if (NODE_TYPE(node) == LocalAssignNode)
+    {
+        compileExpression(jit, NODE(node, LocalAssignRecord)->value, 0);
+        variable = findVariable(jit, JIT_SLOT(NODE(node, LocalAssignRecord)->slot));
+    }
+    else
+    {
+        compileExpression(jit, NODE(node, AssignmentRecord)->value, 0);
+        variable = findVariable(jit, NODE(node, AssignmentRecord)->name);
+    }
+    Operand operand = {OPERAND_VARIABLE, variable};
+    emitRegisterOperand(jit, 0x89, RAX, operand);
+    if (!jit->known[variable])
+    {
+        // mov byte [rbx + defined], 1
+        emitByte(jit, 0xC6);
+        emitByte(jit, 0x83);
+        emit32(jit, DEFINED_OFFSET(variable));
+        emitByte(jit, 1);
+    }
+}
+
+// Loops are rotated, the condition sits after the body and jumps back to it
+static void compileStatement(Jit *jit, NodeRef node)
+{
+    switch (NODE_TYPE(node))
+    {
+    case AssignmentNode:
+    case LocalAssignNode:
+        compileAssignment(jit, node);
+        break;
+
+    case PrintNode:
+    {
+        NodeRef argument = NODE(node, PrintRecord)->argument;
+        if (NODE_TYPE(argument) == IdentifierNode)
+        {
+            // Like printVariable, a variable that does not exist prints nothing
+            int variable = findVariable(jit, NODE(argument, IdentifierRecord)->name);
+            uint32_t skip = 0;
+            if (!jit->known[variable])
+            {
+                emitByte(jit, 0x80); // cmp byte [rbx + defined], 0
+                emitByte(jit, 0xBB);
+                emit32(jit, DEFINED_OFFSET(variable));
+                emitByte(jit, 0);
+                skip = emitJump(jit, CC_E);
+            }
+            Operand operand = {OPERAND_VARIABLE, variable};
+            emitLoad(jit, RDI, operand);
+            emitCall(jit, (uintptr_t)jitPrint);
+            if (!jit->known[variable])
+            {
+                patchJump(jit, skip, jit->count);
+            }
+        }
+        else if (NODE_TYPE(argument) == CharLiteralNode)
+        {
+            // The arena does not move while the loop runs
+            uint64_t text = (uint64_t)(uintptr_t)NODE(argument, CharLiteralRecord)->text;
+            emitByte(jit, 0x48); // mov rdi, imm64
+            emitByte(jit, 0xBF);
+            for (int i = 0; i < 8; i++)
+            {
+                emitByte(jit, (uint8_t)(text >> (8 * i)));
+            }
+            emitCall(jit, (uintptr_t)printString);
+        }
+        else
+        {
+            compileExpression(jit, argument, 0);
+            emitByte(jit, 0x89); // mov edi, eax
+            emitByte(jit, 0xC7);
+            emitCall(jit, (uintptr_t)jitPrint);
+        }
+        break;
+    }
+
+    case FlushNode:
+        emitCall(jit, (uintptr_t)flushOutput);
+        break;
+
+    case IfNode:
+    {
+        IfRecord *record = NODE(node, IfRecord);
+        uint32_t elseJump = emitJump(jit, compileCondition(jit, record->condition) ^ 1);
+        pushWork(&jit->work, record->elseBranch);
+        pushWork(&jit->work, elseJump);
+        pushWork(&jit->work, BLOCK_ELSE);
+        pushBlock(jit, record->thenBranch);
+        break;
+    }
+
+    case ForNode:
+    {
+        ForRecord *record = NODE(node, ForRecord);
+        compileAssignment(jit, record->init);
+        pushWork(&jit->work, node);
+        pushWork(&jit->work, emitJump(jit, -1));
+        pushWork(&jit->work, jit->count);
+        pushWork(&jit->work, BLOCK_LOOP);
+        pushBlock(jit, record->body);
+        break;
+    }
+
+    case WhileNode:
+        pushWork(&jit->work, node);
+        pushWork(&jit->work, emitJump(jit, -1));
+        pushWork(&jit->work, jit->count);
+        pushWork(&jit->work, BLOCK_LOOP);
+        pushBlock(jit, NODE(node, WhileRecord)->body);
+        break;
+
+    default:
+        jit->failed = 1;
+        break;
+    }
+}
+
+// Compile the blocks pushed by compileStatement, the innermost first
+static void compileBlocks(Jit *jit)
+{
+    WorkStack *work = &jit->work;
+    while (work->count > 0 && !jit->failed)
+    {
+        switch (POP_WORK(work))
+        {
+        case BLOCK_LIST:
+        {
+            NodeRef node = POP_WORK(work);
+            if (node != NULL_NODE)
+            {
+                pushBlock(jit, NEXT_NODE(node));
+                compileStatement(jit, node);
+            }
+            break;
+        }
+
+        case BLOCK_ELSE:
+        {
+            uint32_t elseJump = POP_WORK(work);
+            NodeRef elseBranch = POP_WORK(work);
+            if (elseBranch == NULL_NODE)
+            {
+                patchJump(jit, elseJump, jit->count);
+                break;
+            }
+            uint32_t endJump = emitJump(jit, -1);
+            patchJump(jit, elseJump, jit->count);
+            pushWork(work, endJump);
+            pushWork(work, BLOCK_END_IF);
+            pushBlock(jit, elseBranch);
+            break;
+        }
+
+        case BLOCK_END_IF:
+            patchJump(jit, POP_WORK(work), jit->count);
+            break;
+
+        case BLOCK_LOOP:
+        {
+            // The increment and the condition follow the body
+            uint32_t loopStart = POP_WORK(work);
+            uint32_t conditionJump = POP_WORK(work);
+            NodeRef node = POP_WORK(work);
+            NodeRef condition;
+            if (NODE_TYPE(node) == ForNode)
+            {
+                compileAssignment(jit, NODE(node, ForRecord)->increment);
+                condition = NODE(node, ForRecord)->condition;
+            }
+            else
+            {
+                condition = NODE(node, WhileRecord)->condition;
+            }
+            patchJump(jit, conditionJump, jit->count);
+            emitJumpTo(jit, compileCondition(jit, condition), loopStart);
+            break;
+        }
+        }
+    }
+}
+
+// Save the registers, rbx points to the frame and the register variables are loaded from it
+static void emitPrologue(Jit *jit)
+{
+    emitByte(jit, 0x53); // push rbx
+    for (int r = 0; r < JIT_REGISTERS; r++)
+    {
+        emitByte(jit, 0x41);
+        emitByte(jit, (uint8_t)(0x50 + (variableRegisters[r] & 7)));
+    }
+    // Five pushes after the return address keep rsp aligned on 16 bytes for the calls
+    emitByte(jit, 0x48); // mov rbx, rdi
+    emitByte(jit, 0x89);
+    emitByte(jit, 0xFB);
+    for (uint32_t i = 0; i < jit->variableCount; i++)
+    {
+        if (jit->registers[i] >= 0)
+        {
+            emitFrameAccess(jit, 0x8B, jit->registers[i], VALUE_OFFSET(i));
+        }
+    }
+}
+
+static void emitEpilogue(Jit *jit)
+{
+    for (uint32_t i = 0; i < jit->variableCount; i++)
+    {
+        if (jit->registers[i] >= 0)
+        {
+            emitFrameAccess(jit, 0x89, jit->registers[i], VALUE_OFFSET(i));
+        }
+    }
+    for (int r = JIT_REGISTERS - 1; r >= 0; r--)
+    {
+        emitByte(jit, 0x41);
+        emitByte(jit, (uint8_t)(0x58 + (variableRegisters[r] & 7)));
+    }
+    emitByte(jit, 0x5B); // pop rbx
+    emitByte(jit, 0xC3); // ret
+
+    // The error helper does not return, realign the stack wherever the check was
+    while (jit->undefinedJumps.count > 0)
+    {
+        uint32_t variable = POP_WORK(&jit->undefinedJumps);
+        patchJump(jit, POP_WORK(&jit->undefinedJumps), jit->count);
+        emitByte(jit, 0x48); // and rsp, -16
+        emitByte(jit, 0x83);
+        emitByte(jit, 0xE4);
+        emitByte(jit, 0xF0);
+        emitByte(jit, 0xBF); // mov edi, name
+        emit32(jit, (int32_t)jit->names[variable]);
+        emitCall(jit, (uintptr_t)jitUndefined);
+    }
+    if (jit->divisionJumps.count > 0)
+    {
+        while (jit->divisionJumps.count > 0)
+        {
+            patchJump(jit, POP_WORK(&jit->divisionJumps), jit->count);
+        }
+        emitByte(jit, 0x48); // and rsp, -16
+        emitByte(jit, 0x83);
+        emitByte(jit, 0xE4);
+        emitByte(jit, 0xF0);
+        emitByte(jit, 0x89); // mov edi, ecx
+        emitByte(jit, 0xCF);
+        emitCall(jit, (uintptr_t)failDivision);
+    }
+}
+
+static void freeJit(Jit *jit)
+{
+    free(jit->code);
+    freeWorkStack(&jit->work);
+    freeWorkStack(&jit->undefinedJumps);
+    freeWorkStack(&jit->divisionJumps);
+}
+
+// Run one loop as native code, 0 when it has to go to the VM instead.
+// Variables are copied from the symbol table into the frame and written back when the loop ends,
+// the variables of the blocks around it from the slots at the bottom of the VM stack.
+static int runNativeLoop(NodeRef loop)
+{
+    Jit jit;
+    JitFrame frame;
+    memset(&jit, 0, sizeof(jit));
+
+    NodeRef after = NEXT_NODE(loop);
+    NEXT_NODE(loop) = NULL_NODE;
+    int unsupported = forEachNode(loop, visitJitNode, &jit);
+    NEXT_NODE(loop) = after;
+
+    for (uint32_t i = 0; i < jit.variableCount && !unsupported; i++)
+    {
+        InternId name = jit.names[i];
+        if (isSlotKey(name))
+        {
+            jit.known[i] = frame.defined[i] = 1;
+            frame.values[i] = interp->vmStack[name & ~JIT_SLOT(0)];
+            continue;
+        }
+        SymbolTableEntry *entry = lookupSymbolHashed(internedText(name), internedHash(name));
+        unsupported = entry != NULL && entry->type != TYPE_INT;
+        jit.known[i] = frame.defined[i] = entry != NULL;
+        frame.values[i] = entry != NULL ? entry->intValue : 0;
+    }
+    if (unsupported)
+    {
+        TRACE(TRACE_COMPILER, TRACE_INFO, EV_JIT_LOOP, loop, 0, jit.variableCount);
+        return 0;
+    }
+
+    allocateRegisters(&jit);
+    emitPrologue(&jit);
+    compileStatement(&jit, loop);
+    compileBlocks(&jit);
+    emitEpilogue(&jit);
+
+    void *memory = MAP_FAILED;
+    if (!jit.failed)
+    {
+        memory = mmap(NULL, jit.count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (memory == MAP_FAILED)
+    {
+        TRACE(TRACE_COMPILER, TRACE_INFO, EV_JIT_LOOP, loop, 0, jit.variableCount);
+        freeJit(&jit);
+        return 0;
+    }
+    // Written then made executable, the pages are never writable and executable at once
+    memcpy(memory, jit.code, jit.count);
+    if (mprotect(memory, jit.count, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, jit.count);
+        freeJit(&jit);
+        return 0;
+    }
+
+    TRACE(TRACE_COMPILER, TRACE_INFO, EV_JIT_LOOP, loop, jit.count, jit.variableCount);
+    JitFunction function;
+    memcpy(&function, &memory, sizeof(function));
+
+    // An undefined variable leaves the loop through failInterpreter, the code is unmapped by releaseJitCode
+    interp->jitCode = memory;
+    interp->jitSize = jit.count;
+    freeJit(&jit);
+    function(&frame);
+    interp->jitCode = NULL;
+    munmap(memory, interp->jitSize);
+
+    for (uint32_t i = 0; i < jit.variableCount; i++)
+    {
+        if (isSlotKey(jit.names[i]))
+        {
+            interp->vmStack[jit.names[i] & ~JIT_SLOT(0)] = frame.values[i];
+        }
+        else if (frame.defined[i])
+        {
+            InternId name = jit.names[i];
+            assignVariableIntHashed(internedText(name), internedHash(name), TYPE_INT, frame.values[i]);
+        }
+    }
+    return 1;
+}
+
+// Unmap the code of a loop left by failInterpreter
+void releaseJitCode()
+{
+    if (interp->jitCode != NULL)
+    {
+        munmap(interp->jitCode, interp->jitSize);
+        interp->jitCode = NULL;
+    }
+}
+
+#else
+
+static int runNativeLoop(NodeRef loop)
+{
+    (void)loop;
+    return 0;
+}
+
+void releaseJitCode()
+{
+}
+
+#endif
+
+static int isLoop(NodeRef node)
+{
+    return NODE_TYPE(node) == ForNode || NODE_TYPE(node) == WhileNode;
+}
+
+// Loops run as native code, the statements between them and the loops the JIT cannot take run in the VM
+void runJitProgram(NodeRef program, Chunk *chunk)
+{
+    // A constant if of the top level leaves the variables of its block between the loops and the chunks
+    int slots = (int)topLevelSlots(program);
+    memset(reserveStack(slots + 1), 0, (slots + 1) * sizeof(int));
+    NodeRef first = program;
+    while (first != NULL_NODE)
+    {
+        if (isLoop(first) && runNativeLoop(first))
+        {
+            first = NEXT_NODE(first);
+            continue;
+        }
+        NodeRef last = first;
+        while (NEXT_NODE(last) != NULL_NODE && !isLoop(NEXT_NODE(last)))
+        {
+            last = NEXT_NODE(last);
+        }
+        runSegment(first, last, chunk, slots);
+        first = NEXT_NODE(last);
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "compiler.h"
+
+// Translate loops of the integer subset to x86-64 code, set with --jit
+extern int useJit;
+
+// JIT functions
+void runJitProgram(NodeRef program, Chunk *chunk);
+void releaseJitCode();
+
+#endif
@@ -1,330 +1,404 @@
 #include "lexer.h"
-#include <ctype.h>
+#include "interpreter.h"
+#include "output.h"
 
-static const char *input; // Input string
-static int position = 0;  // Current position in input
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
-void setInput(const char *inputStr)
+// Character classes
+#define CC_SPACE 0x01 // ' ', '\t', '\n', '\v', '\f', '\r'
+#define CC_DIGIT 0x02 // '0' to '9'
+#define CC_ALPHA 0x04 // Letters, can start an identifier
+#define CC_IDENT 0x08 // Letters, digits and '_'
+
+#define S CC_SPACE
+#define D (CC_DIGIT | CC_IDENT)
+#define A (CC_ALPHA | CC_IDENT)
+#define U CC_IDENT
+
+static const uint8_t charClass[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, S, S, S, S, S, 0, 0, // 0x00
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x10
+    S, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x20
+    D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0, // 0x30
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A, // 0x40
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, U, // 0x50
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A, // 0x60
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0, // 0x70
+    // Bytes 0x80 to 0xFF have no class
+};
+
+#undef S
+#undef D
+#undef A
+#undef U
+
+// Operators and symbols, with their optional two character form
+typedef struct
+{
+    uint8_t isOperator;
+    uint8_t single; // Token for the character alone
+    char second;    // Character completing the two character form
+    uint8_t pair;   // Token for the two character form
+} OperatorEntry;
+
+static const OperatorEntry operatorTable[256] = {
+    ['+'] = {1, Add, '+', Inc},
+    ['-'] = {1, Sub, '-', Dec},
+    ['*'] = {1, Mul, 0, 0},
+    ['/'] = {1, Div, 0, 0},
+    ['%'] = {1, Mod, 0, 0},
+    ['^'] = {1, Pow, 0, 0},
+    ['='] = {1, Assign, 0, 0},
+    ['<'] = {1, Lt, '=', Le},
+    ['>'] = {1, Gt, '=', Ge},
+    ['!'] = {1, Error, '=', Ne}, // '!' is only valid in '!='
+    ['('] = {1, Lparen, 0, 0},
+    [')'] = {1, Rparen, 0, 0},
+    ['{'] = {1, Lbrace, 0, 0},
+    ['}'] = {1, Rbrace, 0, 0},
+    [';'] = {1, Semicolon, 0, 0},
+    ['['] = {1, Lbracket, 0, 0},
+    [']'] = {1, Rbracket, 0, 0},
+    [','] = {1, Comma, 0, 0},
+};
+
+// Keywords, placed by a perfect hash of their length, first and last character
+typedef struct
 {
-    input = inputStr;
-    position = 0;
+    const char *text;
+    uint8_t length;
+    uint8_t type;
+} KeywordEntry;
+
+#define KEYWORD_HASH(word, length) \
+    (((unsigned char)(word)[0] + ((unsigned)(unsigned char)(word)[(length) - 1] << 2) + 2 * (length)) & 31)
+
+// Slots follow KEYWORD_HASH, they must be recomputed when a keyword is added
+static const KeywordEntry keywordTable[32] = {
+    [1] = {"else", 4, Else},
+    [5] = {"if", 2, If},
+    [10] = {"print", 5, Print},
+    [14] = {"function", 8, Function},
+    [15] = {"array", 5, ArrayKeyword},
+    [16] = {"flush", 5, Flush},
+    [19] = {"char", 4, CharKeyword},
+    [20] = {"for", 3, For},
+    [21] = {"while", 5, While},
+    [22] = {"return", 6, Return},
+    [28] = {"dict", 4, DictKeyword},
+    [31] = {"int", 3, IntKeyword},
+};
+
+// Find the keyword spelled by word, Identifier when there is none
+static inline TokenType keywordType(const char *word, uint32_t length)
+{
+    const KeywordEntry *entry = &keywordTable[KEYWORD_HASH(word, length)];
+    if (entry->length == length && memcmp(entry->text, word, length) == 0)
+    {
+        return entry->type;
+    }
+    return Identifier;
 }
 
-// Return the current character in the input
-char peek()
+// Block scanners, each returns the position of the first byte outside the run.
+// They take the input as locals so the loops keep it in registers.
+// Whole blocks are tested at once while they fit in the input, the tail is scalar.
+#if defined(__AVX2__)
+#define SIMD_WIDTH 32
+typedef __m256i SimdBlock;
+#define simdLoad(p) _mm256_loadu_si256((const __m256i *)(p))
+#define simdSet(c) _mm256_set1_epi8((char)(c))
+#define simdEq(a, b) _mm256_cmpeq_epi8(a, b)
+#define simdGt(a, b) _mm256_cmpgt_epi8(a, b)
+#define simdOr(a, b) _mm256_or_si256(a, b)
+#define simdAnd(a, b) _mm256_and_si256(a, b)
+#define simdMask(a) ((uint32_t)_mm256_movemask_epi8(a))
+#define SIMD_FULL_MASK 0xFFFFFFFFu
+#elif defined(__SSE2__)
+#define SIMD_WIDTH 16
+typedef __m128i SimdBlock;
+#define simdLoad(p) _mm_loadu_si128((const __m128i *)(p))
+#define simdSet(c) _mm_set1_epi8((char)(c))
+#define simdEq(a, b) _mm_cmpeq_epi8(a, b)
+#define simdGt(a, b) _mm_cmpgt_epi8(a, b)
+#define simdOr(a, b) _mm_or_si128(a, b)
+#define simdAnd(a, b) _mm_and_si128(a, b)
+#define simdMask(a) ((uint32_t)_mm_movemask_epi8(a))
+#define SIMD_FULL_MASK 0xFFFFu
+#endif
+
+#ifdef SIMD_WIDTH
+// Bytes lo <= c <= hi, signed compares reject bytes >= 0x80 which have no class
+static inline SimdBlock simdInRange(SimdBlock block, char lo, char hi)
 {
-    return input[position];
+    return simdAnd(simdGt(block, simdSet(lo - 1)), simdGt(simdSet(hi + 1), block));
 }
 
-void advance()
+static inline SimdBlock simdIsSpace(SimdBlock block)
 {
-    if (peek() != '\0')
+    return simdOr(simdEq(block, simdSet(' ')), simdInRange(block, '\t', '\r'));
+}
+
+static inline SimdBlock simdIsIdent(SimdBlock block)
+{
+    SimdBlock lower = simdOr(block, simdSet(0x20));
+    return simdOr(simdOr(simdInRange(block, '0', '9'), simdInRange(lower, 'a', 'z')),
+                  simdEq(block, simdSet('_')));
+}
+
+static inline SimdBlock simdIsLineEnd(SimdBlock block)
+{
+    return simdOr(simdOr(simdEq(block, simdSet('\n')), simdEq(block, simdSet('\r'))),
+                  simdEq(block, simdSet('\0')));
+}
+
+// Return from the enclosing scanner at the first byte outside (or inside) the class
+#define SIMD_SKIP(pos, isMember)                                                          \
+    while ((pos) + SIMD_WIDTH <= inputLength)                                             \
+    {                                                                                     \
+        uint32_t outside = ~simdMask(isMember(simdLoad(input + (pos)))) & SIMD_FULL_MASK; \
+        if (outside != 0)                                                                 \
+        {                                                                                 \
+            return (pos) + (uint32_t)__builtin_ctz(outside);                              \
+        }                                                                                 \
+        (pos) += SIMD_WIDTH;                                                              \
+    }
+#define SIMD_SKIP_UNTIL(pos, isStop)                               \
+    while ((pos) + SIMD_WIDTH <= inputLength)                      \
+    {                                                              \
+        uint32_t stop = simdMask(isStop(simdLoad(input + (pos)))); \
+        if (stop != 0)                                             \
+        {                                                          \
+            return (pos) + (uint32_t)__builtin_ctz(stop);          \
+        }                                                          \
+        (pos) += SIMD_WIDTH;                                       \
+    }
+#else
+#define SIMD_SKIP(pos, isMember)
+#define SIMD_SKIP_UNTIL(pos, isStop)
+#endif
+
+static inline uint32_t skipClass(const char *input, uint32_t inputLength, uint32_t pos, uint8_t mask)
+{
+    while (pos < inputLength && (charClass[(unsigned char)input[pos]] & mask))
     {
-        position++;
+        pos++;
+    }
+    return pos;
+}
+
+static inline uint32_t skipWhitespace(const char *input, uint32_t inputLength, uint32_t pos)
+{
+    // Most runs are a single space or an indentation, test the first byte alone
+    if (pos < inputLength && !(charClass[(unsigned char)input[pos]] & CC_SPACE))
+    {
+        return pos;
     }
+    SIMD_SKIP(pos, simdIsSpace)
+    return skipClass(input, inputLength, pos, CC_SPACE);
 }
 
-void skipWhitespace()
+static inline uint32_t skipIdentifier(const char *input, uint32_t inputLength, uint32_t pos)
 {
-    while (isspace(peek()))
+    SIMD_SKIP(pos, simdIsIdent)
+    return skipClass(input, inputLength, pos, CC_IDENT);
+}
+
+// Skip until end of line
+static inline uint32_t skipComment(const char *input, uint32_t inputLength, uint32_t pos)
+{
+    SIMD_SKIP_UNTIL(pos, simdIsLineEnd)
+    while (pos < inputLength && input[pos] != '\n' && input[pos] != '\r' && input[pos] != '\0')
     {
-        advance();
+        pos++;
     }
+    return pos;
 }
 
-void skipComment()
+// Lex a null terminated string
+void setInput(const char *inputStr)
 {
-    // Skip until end of line
-    while (peek() != '\n' && peek() != '\0' && peek() != '\r')
+    setInputBuffer(inputStr, strlen(inputStr));
+}
+
+// Lex length bytes, the buffer does not need a terminating null byte
+void setInputBuffer(const char *buffer, size_t length)
+{
+    if (length > UINT32_MAX)
     {
-        advance();
+        reportError("Lexer Error: Input larger than 4 GiB\n");
+        failInterpreter();
     }
+    Lexer *lexer = &interp->lexer;
+    lexer->input = buffer;
+    lexer->length = (uint32_t)length;
+    lexer->position = 0;
+    lexer->located = 0;
+    lexer->locatedLine = 1;
+    lexer->locatedLineStart = 0;
 }
 
-Token createToken(TokenType type, const char *value)
+// Line and column of an input offset, both from 1
+// Offsets are usually asked in increasing order, so the scan resumes from the last one
+void locateOffset(uint32_t offset, uint32_t *line, uint32_t *column)
+{
+    Lexer *lexer = &interp->lexer;
+    if (offset < lexer->located)
+    {
+        lexer->located = 0;
+        lexer->locatedLine = 1;
+        lexer->locatedLineStart = 0;
+    }
+    const char *newline;
+    while ((newline = memchr(lexer->input + lexer->located, '\n', offset - lexer->located)) != NULL)
+    {
+        lexer->located = (uint32_t)(newline - lexer->input) + 1;
+        lexer->locatedLine++;
+        lexer->locatedLineStart = lexer->located;
+    }
+    lexer->located = offset;
+    *line = lexer->locatedLine;
+    *column = offset - lexer->locatedLineStart + 1;
+}
+
+// Token covering the input from start to end
+Token createToken(TokenType type, uint32_t start, uint32_t end)
 {
     Token token;
     token.type = type;
-    token.value = strdup(value);
+    token.offset = start;
+    token.length = end - start;
+    token.intValue = 0;
     return token;
 }
 
-Token getNextToken()
+// Text of a token, it is not null terminated, use token.length
+const char *tokenText(Token token)
 {
-    skipWhitespace();
-
-    char current_char = peek();
+    return interp->lexer.input + token.offset;
+}
 
-    // End of input
-    if (current_char == '\0')
-    {
-        if (DEBUG)
-            printf("Lexer: End of input\n");
-        return createToken(Eof, "");
-    }
+// Token starting at *cursor, the cursor is left after it
+static inline Token scanToken(const char *input, uint32_t inputLength, uint32_t *cursor)
+{
+    uint32_t position = *cursor;
 
-    // Numbers
-    if (isdigit(current_char))
+    // Skip whitespace and comments
+    while (1)
     {
-        char buffer[256];
-        int i = 0;
-        while (isdigit(peek()))
+        position = skipWhitespace(input, inputLength, position);
+        if (position + 1 < inputLength && input[position] == '/' && input[position + 1] == '/')
         {
-            buffer[i++] = peek();
-            advance();
+            position = skipComment(input, inputLength, position + 2);
+            continue;
         }
-        buffer[i] = '\0';
-        if (DEBUG)
-            printf("Lexer: Recognized number '%s'\n", buffer);
-        return createToken(Number, buffer);
+        break;
     }
 
-    // Char literal
-    if (current_char == '\'')
+    uint32_t start = position;
+
+    // End of input
+    if (position >= inputLength || input[position] == '\0')
     {
-        advance();
-        char buffer[256];
-        int i = 0;
+        *cursor = position;
+        return createToken(Eof, start, position);
+    }
 
-        while (peek() != '\'' && peek() != '\0' && i < (int)(sizeof(buffer) - 1))
-        {
-            buffer[i++] = peek();
-            advance();
-        }
+    unsigned char current_char = (unsigned char)input[position];
+    uint8_t cls = charClass[current_char];
 
-        if (peek() == '\'')
-        {
-            buffer[i] = '\0';
-            advance();
-            if (DEBUG)
-                printf("Lexer: Recognized char literal (as string) '%s'\n", buffer);
-            return createToken(StringLiteral, buffer); // Return as string literal
-        }
-        else
+    // Numbers, decoded once here
+    if (cls & CC_DIGIT)
+    {
+        uint32_t value = 0;
+        while (position < inputLength && (charClass[(unsigned char)input[position]] & CC_DIGIT))
         {
-            printf("Lexer Error: Unterminated char literal\n");
-            exit(1);
+            value = value * 10 + (uint32_t)(input[position] - '0');
+            position++;
         }
+        *cursor = position;
+        Token token = createToken(Number, start, position);
+        token.intValue = (int32_t)value;
+        return token;
     }
 
     // Identifiers and keywords
-    if (isalpha(current_char))
+    if (cls & CC_ALPHA)
     {
-        char buffer[256];
-        int i = 0;
-        while (isalnum(peek()) || peek() == '_')
-        {
-            buffer[i++] = peek();
-            advance();
-        }
-        buffer[i] = '\0';
+        position = skipIdentifier(input, inputLength, position + 1);
+        const char *word = input + start;
+        uint32_t length = position - start;
+        TokenType type = keywordType(word, length);
 
-        // Keywords
-        if (strcmp(buffer, "if") == 0)
+        if (type == Identifier)
         {
-            if (DEBUG)
-                printf("Lexer: Recognized keyword 'if'\n");
-            return createToken(If, "if");
+            *cursor = position;
+            Token token = createToken(Identifier, start, position);
+            token.name = internString(word, length);
+            return token;
         }
-        else if (strcmp(buffer, "else") == 0)
+
+        // Recognize 'else if' as a single token
+        if (type == Else)
         {
-            // Check for 'else if'
-            skipWhitespace();
-            if (strncmp(&input[position], "if", 2) == 0 && !isalnum(input[position + 2]))
+            uint32_t next = skipWhitespace(input, inputLength, position);
+            if (next + 2 <= inputLength && input[next] == 'i' && input[next + 1] == 'f' &&
+                (next + 2 == inputLength || !(charClass[(unsigned char)input[next + 2]] & CC_IDENT)))
             {
-                // Recognize 'else if' as a single token
-                advance(); // 'i'
-                advance(); // 'f'
-                if (DEBUG)
-                    printf("Lexer: Recognized keyword 'else if'\n");
-                return createToken(ElseIf, "else if");
+                position = next + 2;
+                type = ElseIf;
             }
-            else
-            {
-                if (DEBUG)
-                    printf("Lexer: Recognized keyword 'else'\n");
-                return createToken(Else, "else");
-            }
-        }
-        else if (strcmp(buffer, "for") == 0)
-        {
-            if (DEBUG)
-                printf("Lexer: Recognized keyword 'for'\n");
-            return createToken(For, "for");
         }
-        else if (strcmp(buffer, "while") == 0)
-        {
-            if (DEBUG)
-                printf("Lexer: Recognized keyword 'while'\n");
-            return createToken(While, "while");
-        }
-        else if (strcmp(buffer, "print") == 0)
-        {
-            if (DEBUG)
-                printf("Lexer: Recognized keyword 'print'\n");
-            return createToken(Print, "print");
-        }
-        else if (strcmp(buffer, "int") == 0)
-        {
-            if (DEBUG)
-                printf("Lexer: Recognized keyword 'int'\n");
-            return createToken(IntKeyword, "int");
-        }
-        else if (strcmp(buffer, "char") == 0)
-        {
-            return createToken(CharKeyword, "char");
-        }
-        else
+
+        *cursor = position;
+        return createToken(type, start, position);
+    }
+
+    // Char literal, the token only covers the text between the quotes
+    if (current_char == '\'')
+    {
+        start = position + 1;
+        const char *quote = memchr(input + start, '\'', inputLength - start);
+        if (quote == NULL)
         {
-            if (DEBUG)
-                printf("Lexer: Recognized identifier '%s'\n", buffer);
-            return createToken(Identifier, buffer);
+            reportError("Lexer Error: Unterminated char literal\n");
+            failInterpreter();
         }
+        position = (uint32_t)(quote - input);
+        *cursor = position + 1;
+        return createToken(StringLiteral, start, position); // Return as string literal
     }
 
     // Operators and symbols
-    switch (current_char)
+    const OperatorEntry *entry = &operatorTable[current_char];
+    if (!entry->isOperator)
     {
-    case '+':
-        advance();
-        if (peek() == '+')
-        {
-            advance();
-            if (DEBUG)
-                printf("Lexer: Recognized operator '++'\n");
-            return createToken(Inc, "++");
-        }
-        else
-        {
-            if (DEBUG)
-                printf("Lexer: Recognized operator '+'\n");
-            return createToken(Add, "+");
-        }
-    case '-':
-        advance();
-        if (peek() == '-')
-        {
-            advance();
-            if (DEBUG)
-                printf("Lexer: Recognized operator '--'\n");
-            return createToken(Dec, "--");
-        }
-        else
-        {
-            if (DEBUG)
-                printf("Lexer: Recognized operator '-'\n");
-            return createToken(Sub, "-");
-        }
-    case '*':
-        advance();
-        if (DEBUG)
-            printf("Lexer: Recognized operator '*'\n");
-        return createToken(Mul, "*");
-    case '/':
-        advance();
-        if (peek() == '/')
-        {
-            advance();
-            skipComment();
-            return getNextToken();
-        }
-        else
-        {
-            if (DEBUG)
-                printf("Lexer: Recognized operator '/'\n");
-            return createToken(Div, "/");
-        }
-    case '%':
-        advance();
-        if (DEBUG)
-            printf("Lexer: Recognized operator '%%'\n");
-        return createToken(Mod, "%");
-    case '^':
-        advance();
-        if (DEBUG)
-            printf("Lexer: Recognized operator '^'\n");
-        return createToken(Pow, "^");
-    case '=':
-        advance();
-        if (DEBUG)
-            printf("Lexer: Recognized operator '='\n");
-        return createToken(Assign, "=");
-    case '<':
-        advance();
-        if (peek() == '=')
-        {
-            advance();
-            if (DEBUG)
-                printf("Lexer: Recognized operator '<='\n");
-            return createToken(Le, "<=");
-        }
-        else
-        {
-            if (DEBUG)
-                printf("Lexer: Recognized operator '<'\n");
-            return createToken(Lt, "<");
-        }
-    case '>':
-        advance();
-        if (peek() == '=')
-        {
-            advance();
-            if (DEBUG)
-                printf("Lexer: Recognized operator '>='\n");
-            return createToken(Ge, ">=");
-        }
-        else
-        {
-            if (DEBUG)
-                printf("Lexer: Recognized operator '>'\n");
-            return createToken(Gt, ">");
-        }
-    case '!':
-        advance();
-        if (peek() == '=')
-        {
-            advance();
-            if (DEBUG)
-                printf("Lexer: Recognized operator '!='\n");
-            return createToken(Ne, "!=");
-        }
-        else
-        {
-            printf("Lexer Error: Unexpected character '!' without '='\n");
-            exit(1);
-        }
-    case '(':
-        advance();
-        if (DEBUG)
-            printf("Lexer: Recognized symbol '('\n");
-        return createToken(Lparen, "(");
-    case ')':
-        advance();
-        if (DEBUG)
-            printf("Lexer: Recognized symbol ')'\n");
-        return createToken(Rparen, ")");
-    case '{':
-        advance();
-        if (DEBUG)
-            printf("Lexer: Recognized symbol '{'\n");
-        return createToken(Lbrace, "{");
-    case '}':
-        advance();
-        if (DEBUG)
-            printf("Lexer: Recognized symbol '}'\n");
-        return createToken(Rbrace, "}");
-    case ';':
-        advance();
-        if (DEBUG)
-            printf("Lexer: Recognized symbol ';'\n");
-        return createToken(Semicolon, ";");
-    default:
-        printf("Lexer Error: Unknown character '%c'\n", current_char);
-        exit(1);
+        reportError("Lexer Error: Unknown character '%c'\n", current_char);
+        failInterpreter();
+    }
+    position++;
+    TokenType type = (TokenType)entry->single;
+    if (entry->second != 0 && position < inputLength && input[position] == entry->second)
+    {
+        position++;
+        type = (TokenType)entry->pair;
+    }
+    if (type == Error)
+    {
+        reportError("Lexer Error: Unexpected character '%c' without '%c'\n", current_char, entry->second);
+        failInterpreter();
     }
+
+    *cursor = position;
+    return createToken(type, start, position);
 }
 
-void freeToken(Token token)
+Token getNextToken()
 {
-    free(token.value);
+    Lexer *lexer = &interp->lexer;
+    Token token = scanToken(lexer->input, lexer->length, &lexer->position);
+    TRACE(TRACE_LEXER, TRACE_DETAIL, EV_LEX_TOKEN, token.type, token.offset, token.length);
+    return token;
 }
@@ -4,9 +4,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-// Enable debugging by setting DEBUG to 1
-#define DEBUG 1
+#include <stdint.h>
+#include "intern.h"
+#include "trace.h"
 
 // Definition of token types
 typedef enum
@@ -48,24 +48,52 @@ typedef enum
     Semicolon = 29, // ';'
                     // Special tokens
     Eof = 30,       // End of file
-    Error = 31      // Error
+    Error = 31,     // Error
+    Flush = 32,        // 'flush', numbered last so the other values do not change
+    Lbracket = 33,     // '['
+    Rbracket = 34,     // ']'
+    Comma = 35,        // ','
+    ArrayKeyword = 36, // 'array'
+    DictKeyword = 37,  // 'dict'
+    Function = 38,     // 'function'
+    Return = 39        // 'return'
 } TokenType;
 
-// Token structure
+// Token structure, the text stays in the input buffer
 typedef struct
 {
-    TokenType type; // Type of token
-    char *value;    // Value of token
+    TokenType type;  // Type of token
+    uint32_t offset; // Start of the token text in the input
+    uint32_t length; // Length of the token text
+    union
+    {
+        int32_t intValue; // Decoded value of a Number
+        InternId name;    // Interned text of an Identifier
+    };
 } Token;
 
+// Lexer state, one per interpreter
+typedef struct
+{
+    const char *input; // Input buffer
+    uint32_t length;   // Bytes in the input buffer
+    uint32_t position; // Current position in input
+
+    // Last position located by locateOffset, lines are only counted when asked
+    uint32_t located;
+    uint32_t locatedLine;
+    uint32_t locatedLineStart;
+} Lexer;
+
 // Lexer functions
 void setInput(const char *inputStr);
+void setInputBuffer(const char *buffer, size_t length);
 Token getNextToken();
-void freeToken(Token token);
-char peek();
-void advance();
-void skipWhitespace();
-Token createToken(TokenType type, const char *value);
-Token peekNextToken();
+Token createToken(TokenType type, uint32_t start, uint32_t end);
+const char *tokenText(Token token);
+void locateOffset(uint32_t offset, uint32_t *line, uint32_t *column);
+
+// printf arguments for a "%.*s" conversion of a token
+#define TOKEN_TEXT_ARGS(token) (int)(token).length, tokenText(token)
 
 #endif
\ No newline at end of file
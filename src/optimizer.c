@@ -0,0 +1,538 @@
+#include "optimizer.h"
+#include "interpreter.h"
+#include "output.h"
+#include "lexer.h"
+#include "symtab.h"
+#include "array.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+int useOptimizer = 1;
+
+// Flags of interp->nameFlags, only filled when the whole program is known
+#define NAME_CHAR_ASSIGNED 1 // Assigned a string somewhere in the program
+#define NAME_KNOWN_INT 2     // Assigned an int by a statement that always runs before
+
+static int visitCount(NodeRef node, void *context)
+{
+    (void)node;
+    (*(uint32_t *)context)++;
+    return 0;
+}
+
+// Every node reachable from node, statement lists included
+static uint32_t countNodes(NodeRef node)
+{
+    uint32_t count = 0;
+    forEachNode(node, visitCount, &count);
+    return count;
+}
+
+// Names that ever hold a string, an array or a dict are never treated as known ints,
+// neither are loop variables that may walk over the keys of a dict
+static int visitCharAssignment(NodeRef node, void *context)
+{
+    (void)context;
+    if (NODE_TYPE(node) == AssignmentNode && NODE(node, AssignmentRecord)->header.varType != TYPE_INT)
+    {
+        interp->nameFlags[NODE(node, AssignmentRecord)->name] |= NAME_CHAR_ASSIGNED;
+    }
+    else if (NODE_TYPE(node) == ForEachNode)
+    {
+        interp->nameFlags[NODE(node, ForEachRecord)->variable] |= NAME_CHAR_ASSIGNED;
+    }
+    return 0;
+}
+
+static int constantValue(NodeRef node, int32_t *value)
+{
+    switch (NODE_TYPE(node))
+    {
+    case NumberNode:
+        *value = NODE(node, NumberRecord)->value;
+        return 1;
+    case CharLiteralNode:
+        *value = NODE(node, CharLiteralRecord)->text[0];
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Evaluating the node can not fail at runtime
+static int isSafe(NodeRef node)
+{
+    switch (NODE_TYPE(node))
+    {
+    case NumberNode:
+    case CharLiteralNode:
+    case LocalNode:
+        return 1;
+    case IdentifierNode:
+        return interp->trackNames && (interp->nameFlags[NODE(node, IdentifierRecord)->name] & NAME_KNOWN_INT);
+    default:
+        // Folding has already turned every safe binary operation into a number
+        return 0;
+    }
+}
+
+// Same wrap-around as the VM. Division by zero and INT_MIN / -1 stay unfolded so every engine reports them with failDivision
+static int foldBinary(TokenType op, int32_t a, int32_t b, int32_t *result)
+{
+    switch (op)
+    {
+    case Add:
+        *result = (int32_t)((uint32_t)a + (uint32_t)b);
+        return 1;
+    case Sub:
+        *result = (int32_t)((uint32_t)a - (uint32_t)b);
+        return 1;
+    case Mul:
+        *result = (int32_t)((uint32_t)a * (uint32_t)b);
+        return 1;
+    case Div:
+    case Mod:
+        if (b == 0 || (a == INT32_MIN && b == -1))
+        {
+            return 0;
+        }
+        *result = op == Div ? a / b : a % b;
+        return 1;
+    case Lt:
+        *result = a < b;
+        return 1;
+    case Le:
+        *result = a <= b;
+        return 1;
+    case Gt:
+        *result = a > b;
+        return 1;
+    case Ge:
+        *result = a >= b;
+        return 1;
+    case Ne:
+        *result = a != b;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Turn the record into a number in place, a NumberRecord is smaller than a BinaryOpRecord
+static NodeRef rewriteAsNumber(NodeRef node, int32_t value)
+{
+    NumberRecord *record = NODE(node, NumberRecord);
+    record->header.nodeType = NumberNode;
+    record->header.tokenType = 0;
+    record->value = value;
+    return node;
+}
+
+// Simplify one operator whose operands are already folded, returns the node replacing it
+static NodeRef foldOperator(NodeRef node)
+{
+    BinaryOpRecord *record = NODE(node, BinaryOpRecord);
+    NodeRef left = record->left;
+    NodeRef right = record->right;
+    TokenType op = record->header.tokenType;
+    int32_t a, b, result;
+    if (IS_CONCATENATION(node))
+    {
+        return node; // Strings are joined when it runs
+    }
+    int leftConstant = constantValue(left, &a);
+    int rightConstant = constantValue(right, &b);
+
+    if (leftConstant && rightConstant)
+    {
+        return foldBinary(op, a, b, &result) ? rewriteAsNumber(node, result) : node;
+    }
+
+    // x + 0, 0 + x, x - 0, x * 1, 1 * x, x / 1
+    if (rightConstant && ((b == 0 && (op == Add || op == Sub)) || (b == 1 && (op == Mul || op == Div))))
+    {
+        return left;
+    }
+    if (leftConstant && ((a == 0 && op == Add) || (a == 1 && op == Mul)))
+    {
+        return right;
+    }
+
+    // x * 0 drops x, only when reading x can not raise an error
+    if (op == Mul && ((rightConstant && b == 0 && isSafe(left)) || (leftConstant && a == 0 && isSafe(right))))
+    {
+        return rewriteAsNumber(node, 0);
+    }
+    return node;
+}
+
+// Post-order walk, an operator waits under a NULL_NODE marker for its folded operands.
+// An index, a key or call arguments are folded the same way, the element itself is only known at runtime.
+static NodeRef foldExpression(NodeRef root)
+{
+    uint32_t base = interp->foldStack.count;
+    pushWork(&interp->foldStack, root);
+
+    while (interp->foldStack.count > base)
+    {
+        NodeRef node = POP_WORK(&interp->foldStack);
+        if (node == NULL_NODE)
+        {
+            node = POP_WORK(&interp->foldStack);
+            switch (NODE_TYPE(node))
+            {
+            case BinaryOpNode:
+            {
+                BinaryOpRecord *record = NODE(node, BinaryOpRecord);
+                record->right = POP_WORK(&interp->resultStack);
+                record->left = POP_WORK(&interp->resultStack);
+                node = foldOperator(node);
+                break;
+            }
+            case IndexNode:
+                NODE(node, IndexRecord)->index = POP_WORK(&interp->resultStack);
+                break;
+            case ArrayCallNode:
+                NODE(node, ArrayCallRecord)->key = POP_WORK(&interp->resultStack);
+                break;
+            default:
+            {
+                CallRecord *record = NODE(node, CallRecord);
+                for (uint32_t i = record->count; i > 0; i--)
+                {
+                    record->arguments[i - 1] = POP_WORK(&interp->resultStack);
+                }
+                break;
+            }
+            }
+            pushWork(&interp->resultStack, node);
+            continue;
+        }
+
+        switch (NODE_TYPE(node))
+        {
+        case BinaryOpNode:
+            pushWork(&interp->foldStack, node);
+            pushWork(&interp->foldStack, NULL_NODE);
+            pushWork(&interp->foldStack, NODE(node, BinaryOpRecord)->right);
+            pushWork(&interp->foldStack, NODE(node, BinaryOpRecord)->left);
+            break;
+        case IndexNode:
+            pushWork(&interp->foldStack, node);
+            pushWork(&interp->foldStack, NULL_NODE);
+            pushWork(&interp->foldStack, NODE(node, IndexRecord)->index);
+            break;
+        case ArrayCallNode:
+            if (NODE(node, ArrayCallRecord)->key == NULL_NODE)
+            {
+                pushWork(&interp->resultStack, node);
+                break;
+            }
+            pushWork(&interp->foldStack, node);
+            pushWork(&interp->foldStack, NULL_NODE);
+            pushWork(&interp->foldStack, NODE(node, ArrayCallRecord)->key);
+            break;
+        case CallNode:
+        {
+            CallRecord *record = NODE(node, CallRecord);
+            pushWork(&interp->foldStack, node);
+            pushWork(&interp->foldStack, NULL_NODE);
+            for (uint32_t i = record->count; i > 0; i--)
+            {
+                pushWork(&interp->foldStack, record->arguments[i - 1]);
+            }
+            break;
+        }
+        default:
+            pushWork(&interp->resultStack, node);
+            break;
+        }
+    }
+
+    return POP_WORK(&interp->resultStack);
+}
+
+// Statement lists wait on the fold stack under the expressions being folded, a frame is the node
+// that owns the list, its depth, the next statement, the first and last statements kept and its kind
+typedef enum
+{
+    OPTIMIZE_LIST,     // Returned by optimizeBlock
+    OPTIMIZE_SPLICE,   // Branch of a constant if, its statements replace the if
+    OPTIMIZE_THEN,
+    OPTIMIZE_ELSE,
+    OPTIMIZE_BODY,     // Body of a loop
+    OPTIMIZE_FUNCTION,
+} OptimizeKind;
+
+#define OPTIMIZE_FRAME 6
+
+static void pushList(NodeRef owner, int depth, NodeRef list, OptimizeKind kind)
+{
+    pushWork(&interp->foldStack, owner);
+    pushWork(&interp->foldStack, (uint32_t)depth);
+    pushWork(&interp->foldStack, list);
+    pushWork(&interp->foldStack, NULL_NODE);
+    pushWork(&interp->foldStack, NULL_NODE);
+    pushWork(&interp->foldStack, kind);
+}
+
+// Add the statements from first to tail to the list of a frame
+static void appendStatements(uint32_t *frame, NodeRef first, NodeRef tail)
+{
+    if (first == NULL_NODE)
+    {
+        return;
+    }
+    if (frame[3] == NULL_NODE)
+    {
+        frame[3] = first;
+    }
+    else
+    {
+        NEXT_NODE(frame[4]) = first;
+    }
+    frame[4] = tail;
+}
+
+// Optimize one statement, the result is a list running from the returned node to *tail.
+// The blocks of the statement are pushed as lists of their own and filled in once optimized.
+static NodeRef optimizeNode(NodeRef node, int depth, NodeRef *tail)
+{
+    *tail = node;
+
+    switch (NODE_TYPE(node))
+    {
+    case AssignmentNode:
+    {
+        AssignmentRecord *record = NODE(node, AssignmentRecord);
+        if (record->header.varType == TYPE_INT)
+        {
+            record->value = foldExpression(record->value);
+            if (interp->trackNames && depth == 0 && !(interp->nameFlags[record->name] & NAME_CHAR_ASSIGNED))
+            {
+                interp->nameFlags[record->name] |= NAME_KNOWN_INT;
+            }
+        }
+        return node;
+    }
+
+    case PrintNode:
+    {
+        PrintRecord *record = NODE(node, PrintRecord);
+        NodeRef argument = foldExpression(record->argument);
+        // print(x) prints strings too, keep the expression unless x is an int anyway
+        if (NODE_TYPE(argument) != IdentifierNode || NODE_TYPE(record->argument) == IdentifierNode || isSafe(argument))
+        {
+            record->argument = argument;
+        }
+        return node;
+    }
+
+    case LocalAssignNode:
+        NODE(node, LocalAssignRecord)->value = foldExpression(NODE(node, LocalAssignRecord)->value);
+        return node;
+
+    case CallNode:
+        return foldExpression(node);
+
+    case ReturnNode:
+    {
+        ReturnRecord *record = NODE(node, ReturnRecord);
+        if (record->value != NULL_NODE)
+        {
+            record->value = foldExpression(record->value);
+        }
+        return node;
+    }
+
+    case FunctionNode:
+        // A body may run before any top-level assignment, the names known so far say nothing about it
+        interp->trackNames = 0;
+        pushList(node, depth + 1, NODE(node, FunctionRecord)->body, OPTIMIZE_FUNCTION);
+        return node;
+
+    case IndexAssignNode:
+    {
+        IndexAssignRecord *record = NODE(node, IndexAssignRecord);
+        record->index = foldExpression(record->index);
+        record->value = foldExpression(record->value);
+        return node;
+    }
+
+    case ArrayOpNode:
+    {
+        ArrayOpRecord *record = NODE(node, ArrayOpRecord);
+        if (record->builtin != BUILTIN_ADD && record->first != NULL_NODE)
+        {
+            record->first = foldExpression(record->first);
+        }
+        if (record->second != NULL_NODE)
+        {
+            record->second = foldExpression(record->second);
+        }
+        return node;
+    }
+
+    case IfNode:
+    {
+        IfRecord *record = NODE(node, IfRecord);
+        int32_t condition;
+        record->condition = foldExpression(record->condition);
+        if (constantValue(record->condition, &condition))
+        {
+            // The branch taken always runs, its statements replace the if
+            pushList(NULL_NODE, depth, condition ? record->thenBranch : record->elseBranch, OPTIMIZE_SPLICE);
+            return *tail = NULL_NODE;
+        }
+        pushList(node, depth + 1, record->elseBranch, OPTIMIZE_ELSE);
+        pushList(node, depth + 1, record->thenBranch, OPTIMIZE_THEN);
+        return node;
+    }
+
+    case ForNode:
+    {
+        ForRecord *record = NODE(node, ForRecord);
+        int32_t condition;
+        NodeRef unused;
+        record->init = optimizeNode(record->init, depth, &unused);
+        record->condition = foldExpression(record->condition);
+        if (constantValue(record->condition, &condition) && !condition)
+        {
+            // Only the initialization runs
+            *tail = record->init;
+            return record->init;
+        }
+        record->increment = optimizeNode(record->increment, depth + 1, &unused);
+        pushList(node, depth + 1, record->body, OPTIMIZE_BODY);
+        return node;
+    }
+
+    case WhileNode:
+    {
+        WhileRecord *record = NODE(node, WhileRecord);
+        int32_t condition;
+        record->condition = foldExpression(record->condition);
+        if (constantValue(record->condition, &condition) && !condition)
+        {
+            return *tail = NULL_NODE;
+        }
+        pushList(node, depth + 1, record->body, OPTIMIZE_BODY);
+        return node;
+    }
+
+    case ForEachNode:
+        pushList(node, depth + 1, NODE(node, ForEachRecord)->body, OPTIMIZE_BODY);
+        return node;
+
+    default:
+        return node;
+    }
+}
+
+// Optimize a statement list and relink the statements that are left, nested blocks included
+static NodeRef optimizeBlock(NodeRef node, int depth)
+{
+    WorkStack *frames = &interp->foldStack;
+    uint32_t base = frames->count;
+    int trackNames = interp->trackNames;
+    NodeRef result = NULL_NODE;
+    pushList(NULL_NODE, depth, node, OPTIMIZE_LIST);
+
+    while (frames->count > base)
+    {
+        uint32_t at = frames->count - OPTIMIZE_FRAME;
+        uint32_t *frame = frames->items + at;
+        node = frame[2];
+        if (node != NULL_NODE)
+        {
+            frame[2] = NEXT_NODE(node);
+            NodeRef tail;
+            NodeRef first = optimizeNode(node, (int)frame[1], &tail);
+            // The blocks of node may have moved the stack
+            appendStatements(frames->items + at, first, tail);
+            continue;
+        }
+
+        // The list is done, its owner gets what is left of it
+        frames->count = at;
+        NodeRef owner = frame[0];
+        NodeRef head = frame[3];
+        if (frame[4] != NULL_NODE)
+        {
+            NEXT_NODE(frame[4]) = NULL_NODE;
+        }
+        switch ((OptimizeKind)frame[5])
+        {
+        case OPTIMIZE_LIST:
+            result = head;
+            break;
+        case OPTIMIZE_SPLICE:
+            appendStatements(frames->items + at - OPTIMIZE_FRAME, head, frame[4]);
+            break;
+        case OPTIMIZE_THEN:
+            NODE(owner, IfRecord)->thenBranch = head;
+            break;
+        case OPTIMIZE_ELSE:
+            NODE(owner, IfRecord)->elseBranch = head;
+            break;
+        case OPTIMIZE_BODY:
+            if (NODE_TYPE(owner) == ForNode)
+            {
+                NODE(owner, ForRecord)->body = head;
+            }
+            else if (NODE_TYPE(owner) == WhileNode)
+            {
+                NODE(owner, WhileRecord)->body = head;
+            }
+            else
+            {
+                NODE(owner, ForEachRecord)->body = head;
+            }
+            break;
+        case OPTIMIZE_FUNCTION:
+            NODE(owner, FunctionRecord)->body = head;
+            interp->trackNames = trackNames;
+            break;
+        }
+    }
+    return result;
+}
+
+// Fold constants and drop dead branches, removed receives the number of nodes dropped
+NodeRef optimizeProgram(NodeRef program, uint32_t *removed)
+{
+    uint32_t before = countNodes(program);
+
+    if (interp->nameCapacity < interp->interner.count)
+    {
+        free(interp->nameFlags);
+        interp->nameCapacity = interp->interner.count;
+        interp->nameFlags = malloc(interp->nameCapacity);
+        if (interp->nameFlags == NULL)
+        {
+            reportError("Optimizer Error: Out of memory\n");
+            failInterpreter();
+        }
+    }
+    memset(interp->nameFlags, 0, interp->interner.count);
+    interp->trackNames = 1;
+    forEachNode(program, visitCharAssignment, NULL);
+
+    program = optimizeBlock(program, 0);
+
+    interp->trackNames = 0;
+    *removed = before - countNodes(program);
+    TRACE(TRACE_OPTIMIZER, TRACE_INFO, EV_OPTIMIZE_END, *removed, before - *removed, 0);
+    return program;
+}
+
+// Streaming mode only sees one statement, variable types are not tracked
+NodeRef optimizeStatement(NodeRef statement, uint32_t *removed)
+{
+    uint32_t before = countNodes(statement);
+    statement = optimizeBlock(statement, 0);
+    *removed = before - countNodes(statement);
+    TRACE(TRACE_OPTIMIZER, TRACE_INFO, EV_OPTIMIZE_END, *removed, before - *removed, 0);
+    return statement;
+}
@@ -0,0 +1,13 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "ast.h"
+
+// Run the optimizer between parsing and evaluation
+extern int useOptimizer;
+
+// Optimizer functions, both return the new first statement
+NodeRef optimizeProgram(NodeRef program, uint32_t *removed);
+NodeRef optimizeStatement(NodeRef statement, uint32_t *removed);
+
+#endif
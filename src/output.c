@@ -0,0 +1,79 @@
+#include "output.h"
+#include "interpreter.h"
+#include <stdarg.h>
+#include <string.h>
+
+void flushOutput()
+{
+    if (interp->outputLength > 0)
+    {
+        fwrite(interp->output, 1, interp->outputLength, interp->out);
+        interp->outputLength = 0;
+    }
+    fflush(interp->out);
+}
+
+void writeText(const char *text, size_t length)
+{
+    if (interp->outputLength + length > sizeof(interp->output))
+    {
+        flushOutput();
+        if (length > sizeof(interp->output))
+        {
+            fwrite(text, 1, length, interp->out);
+            return;
+        }
+    }
+    memcpy(interp->output + interp->outputLength, text, length);
+    interp->outputLength += length;
+}
+
+// Digits are written from the end of the buffer, printf would parse its format on every call
+static char *formatInt(int value, char *end)
+{
+    char *start = end;
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    do
+    {
+        *--start = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0)
+    {
+        *--start = '-';
+    }
+    return start;
+}
+
+void printInt(int value)
+{
+    char digits[16];
+    char *end = digits + sizeof(digits);
+    end[-1] = '\n';
+    char *start = formatInt(value, end - 1);
+    writeText(start, (size_t)(end - start));
+}
+
+// Same digits without the newline
+void writeInt(int value)
+{
+    char digits[16];
+    char *end = digits + sizeof(digits);
+    char *start = formatInt(value, end);
+    writeText(start, (size_t)(end - start));
+}
+
+void printString(const char *text)
+{
+    writeText(text, strlen(text));
+    writeText("\n", 1);
+}
+
+void reportError(const char *format, ...)
+{
+    va_list arguments;
+    flushOutput();
+    va_start(arguments, format);
+    vfprintf(interp->out, format, arguments);
+    va_end(arguments);
+}
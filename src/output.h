@@ -0,0 +1,17 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+// Program output collects in the buffer of the bound interpreter and reaches interp->out
+// when it is full, on flush(), at the end of each run and before an error message
+void writeText(const char *text, size_t length);
+void printInt(int value);
+void writeInt(int value);
+void printString(const char *text);
+void flushOutput();
+
+// Print an error message after the output of the script
+void reportError(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
@@ -1,478 +1,1510 @@
 #include "parser.h"
+#include "interpreter.h"
+#include "output.h"
+#include "compiler.h"
+#include "vm.h"
+#include "jit.h"
+#include "optimizer.h"
+#include "profile.h"
+#include "array.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
-// Current token
-Token currentToken;
+// Run programs with the recursive evaluator instead of the bytecode VM
+int useTreeWalker = 0;
 
-// Symbol table
-SymbolTableEntry symbolTable[100];
-int symbolCount = 0;
+// Memory bounded by the largest top-level statement instead of the whole program
+int streamStatements = 0;
 
 // Function prototypes
 void nextToken();
 void match(TokenType expected);
 const char *tokenTypeToString(TokenType type);
-ASTNode *parseStatement();
-ASTNode *parseBlock();
-ASTNode *parseExpression();
-ASTNode *parseTerm();
-ASTNode *parseFactor();
-ASTNode *parseIfStatement();
-ASTNode *parseForStatement();
-ASTNode *parseWhileStatement();
-ASTNode *parseAssignment(VariableType varType);
-ASTNode *parsePrintStatement();
-int lookupVariable(const char *name);
+NodeRef parseStatement();
+NodeRef parseExpression();
+static NodeRef parseValue();
+static void requireInt(NodeRef node);
+static int parseFactor(uint32_t *openParens, uint32_t *context);
+NodeRef parseArrayLiteral();
+NodeRef parseAssignment(VariableType varType, int declaration);
+NodeRef parseAssignmentValue(InternId name, VariableType varType, int declaration);
+NodeRef parseIdentifierStatement();
+NodeRef parseArrayOperation(InternId function);
+static InternId parseArrayArgument();
+NodeRef parsePrintStatement();
+NodeRef parseFlushStatement();
+NodeRef parseReturnStatement();
+static NodeRef parseCall(NodeRef function);
+static NodeRef createCall(NodeRef function, uint32_t base);
+static NodeRef functionNamed(InternId name);
+static int localSlot(InternId name);
+void markCountedLoop(NodeRef node);
 
 // Parser entry point
-void evaluateProgram(ASTNode *node)
+void evaluateProgram(NodeRef node)
 {
-    while (node != NULL)
+    uint32_t removed;
+    if (useOptimizer)
     {
-        evaluateAST(node);
-        node = node->next;
+        node = optimizeProgram(node, &removed);
     }
+    executeProgram(node);
+}
+
+// Run a program that is already optimized
+void executeProgram(NodeRef node)
+{
+    TRACE(TRACE_EVAL, TRACE_INFO, EV_EVAL_BEGIN, useTreeWalker, 0, 0);
+    if (useTreeWalker)
+    {
+        evaluateBlock(node);
+    }
+    else
+    {
+        // The chunk belongs to the interpreter so that a failing script does not leak it
+        Chunk *chunk = &interp->chunk;
+        resetChunk(chunk);
+        if (useJit)
+        {
+            runJitProgram(node, chunk);
+        }
+        else
+        {
+            compileProgram(node, chunk);
+            runChunk(chunk);
+        }
+    }
+    TRACE(TRACE_EVAL, TRACE_INFO, EV_EVAL_END, 0, 0, 0);
+}
+
+// Run each top-level statement as soon as it is parsed, the arena and the chunk are reused
+void streamProgram()
+{
+    TRACE(TRACE_EVAL, TRACE_INFO, EV_EVAL_BEGIN, useTreeWalker, 0, 0);
+    Chunk *chunk = &interp->chunk;
+    beginParse();
+
+    NodeRef stmt;
+    uint32_t removed;
+    while ((stmt = parseTopLevelStatement()) != NULL_NODE)
+    {
+        // A constant if can turn the statement into a list or remove it
+        if (useOptimizer)
+        {
+            stmt = optimizeStatement(stmt, &removed);
+        }
+        if (useTreeWalker)
+        {
+            evaluateBlock(stmt);
+        }
+        else if (useJit)
+        {
+            runJitProgram(stmt, chunk);
+        }
+        else
+        {
+            resetChunk(chunk);
+            compileProgram(stmt, chunk);
+            runChunk(chunk);
+        }
+        // Declared functions are called by later statements, their nodes must stay
+        if (interp->functions.count == interp->keptFunctions)
+        {
+            freeAST();
+        }
+    }
+
+    TRACE(TRACE_EVAL, TRACE_INFO, EV_EVAL_END, 0, 0, 0);
 }
 
 void nextToken()
 {
-    currentToken = getNextToken();
-    if (DEBUG)
-        printf("Parser: Next token is '%s' of type %d\n", currentToken.value, currentToken.type);
+    interp->currentToken = getNextToken();
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_TOKEN, interp->currentToken.type, interp->currentToken.offset, interp->currentToken.length);
 }
 
 // Match the current token with the expected token
 void match(TokenType expected)
 {
-    if (currentToken.type == expected)
+    if (interp->currentToken.type == expected)
     {
-        if (DEBUG)
-            printf("Parser: Matched token '%s'\n", currentToken.value);
+        TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_MATCH, interp->currentToken.type, interp->currentToken.offset, interp->currentToken.length);
         nextToken();
     }
     else
     {
-        printf("Syntax Error: Expected token type %d, but got %d\n", expected, currentToken.type);
-        exit(1);
+        reportError("Syntax Error: Expected token type %d, but got %d\n", expected, interp->currentToken.type);
+        failInterpreter();
+    }
+}
+
+NodeRef createBinaryOp(TokenType op, NodeRef left, NodeRef right)
+{
+    NodeRef node = allocNode(BinaryOpNode, sizeof(BinaryOpRecord));
+    BinaryOpRecord *record = NODE(node, BinaryOpRecord);
+    record->header.tokenType = op;
+    record->left = left;
+    record->right = right;
+    return node;
+}
+
+// The literal text is copied into the arena right after its record
+NodeRef createCharLiteral(const char *text, size_t length)
+{
+    NodeRef node = allocNode(CharLiteralNode, sizeof(CharLiteralRecord) + length + 1);
+    CharLiteralRecord *record = NODE(node, CharLiteralRecord);
+    record->length = (uint32_t)length;
+    record->hash = hashBytes(text, length);
+    memcpy(record->text, text, length);
+    record->text[length] = '\0';
+    return node;
+}
+
+// Read the first token of the input given to the lexer
+void beginParse()
+{
+    TRACE(TRACE_PARSER, TRACE_INFO, EV_PARSE_BEGIN, 0, 0, 0);
+    if (useProfiler)
+    {
+        resetProfileNodes();
     }
+    interp->functions.count = interp->keptFunctions;
+    nextToken();
 }
 
-// Look up a symbol in the symbol table
-SymbolTableEntry *lookupSymbol(const char *name)
+// Next statement of the program, NULL_NODE at the end of the input
+NodeRef parseTopLevelStatement()
 {
-    for (int i = 0; i < symbolCount; i++)
+    if (interp->currentToken.type == Eof)
     {
-        if (strcmp(symbolTable[i].identifier, name) == 0)
+        // Once the whole script is parsed, the functions it declared stay for the next ones
+        if (interp->keepFunctions && interp->functions.count > interp->keptFunctions)
         {
-            return &symbolTable[i];
+            interp->keptFunctions = interp->functions.count;
+            interp->keptWords = interp->arena.count;
         }
+        TRACE(TRACE_PARSER, TRACE_INFO, EV_PARSE_END, interp->arena.count, 0, 0);
+        return NULL_NODE;
     }
-    return NULL;
+    return parseStatement();
 }
 
-ASTNode *parseProgram()
+NodeRef parseProgram()
 {
-    if (DEBUG)
-        printf("Parser: Starting to parse program\n");
-    nextToken();
-    ASTNode *statements = NULL;
-    ASTNode *lastStatement = NULL;
+    beginParse();
+    NodeRef statements = NULL_NODE;
+    NodeRef lastStatement = NULL_NODE;
+    NodeRef stmt;
 
-    while (currentToken.type != Eof)
+    while ((stmt = parseTopLevelStatement()) != NULL_NODE)
     {
-        ASTNode *stmt = parseStatement();
-
-        if (statements == NULL)
+        if (statements == NULL_NODE)
         {
             statements = stmt;
         }
         else
         {
-            lastStatement->next = stmt;
+            NEXT_NODE(lastStatement) = stmt;
         }
         lastStatement = stmt;
     }
 
-    if (DEBUG)
-        printf("Parser: Finished parsing program\n");
     return statements;
 }
 
-ASTNode *parseStatement()
+// Statements with a block wait on interp->parseStack while the statements of the block are parsed,
+// so blocks nest as deep as --stack-limit allows. A frame is its words with its kind on top.
+typedef enum
 {
-    if (DEBUG)
-        printf("Parser: Parsing a statement\n");
-    ASTNode *node;
-
-    switch (currentToken.type)
-    {
-    case IntKeyword:
-        nextToken();
-        node = parseAssignment(TYPE_INT);
-        match(Semicolon);
-        break;
-    case CharKeyword:
-        nextToken();
-        node = parseAssignment(TYPE_CHAR);
-        match(Semicolon);
-        break;
-    case If:
-        node = parseIfStatement();
-        break;
-    case For:
-        node = parseForStatement();
-        break;
-    case While:
-        node = parseWhileStatement();
-        break;
-    case Print:
-        node = parsePrintStatement();
-        match(Semicolon);
-        break;
-    case Identifier:
-        node = parseAssignment(TYPE_INT);
-        match(Semicolon);
-        break;
-    default:
-        printf("Syntax Error: Unexpected token '%s' of type %d\n", currentToken.value, currentToken.type);
-        exit(1);
-        break;
-    }
-
-    return node;
+    PARSE_BLOCK,    // first statement, last statement, scope base of the enclosing block
+    PARSE_IF,       // line, column, condition
+    PARSE_ELSE,     // line, column, condition, then branch
+    PARSE_ELSE_IF,  // line, column, condition, then branch, the inner if is parsed above it
+    PARSE_FOR,      // line, column, init, condition, increment
+    PARSE_EACH,     // line, column, variable, container
+    PARSE_WHILE,    // line, column, condition
+    PARSE_FUNCTION, // line, column, function node
+} ParseKind;
+
+static void pushParse(uint32_t word)
+{
+    pushWork(&interp->parseStack, word);
 }
 
-ASTNode *parseIfStatement()
+// '{' opens a block, the statements parsed next are added to it
+static void beginBlock()
 {
-    if (DEBUG)
-        printf("Parser: Parsing an if statement\n");
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->nodeType = IfNode;
-
-    match(If);
-    match(Lparen);
-    node->condition = parseExpression();
-    match(Rparen);
-
-    node->thenBranch = parseBlock();
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_BLOCK, 0, 0);
+    match(Lbrace);
+    interp->blockDepth++;
+    pushParse(NULL_NODE);
+    pushParse(NULL_NODE);
+    pushParse(interp->scopeBase);
+    pushParse(PARSE_BLOCK);
+    interp->scopeBase = interp->localNames.count;
+}
 
-    if (currentToken.type == Else || currentToken.type == ElseIf)
+static void appendStatement(NodeRef stmt)
+{
+    uint32_t *frame = interp->parseStack.items + interp->parseStack.count - 4;
+    if (frame[0] == NULL_NODE)
     {
-        if (currentToken.type == ElseIf)
-        {
-            if (DEBUG)
-                printf("Parser: Parsing else if clause\n");
-            match(ElseIf);
-            node->elseBranch = parseIfStatement();
-        }
-        else
-        {
-            if (DEBUG)
-                printf("Parser: Parsing else clause\n");
-            match(Else);
-            node->elseBranch = parseBlock();
-        }
+        frame[0] = stmt;
     }
     else
     {
-        node->elseBranch = NULL;
+        NEXT_NODE(frame[1]) = stmt;
     }
+    frame[1] = stmt;
+}
 
-    return node;
+// '}' closes the innermost block and gives its statements
+static NodeRef endBlock()
+{
+    match(Rbrace);
+    interp->blockDepth--;
+    WorkStack *frames = &interp->parseStack;
+    frames->count -= 4;
+    NodeRef statements = frames->items[frames->count];
+
+    // Les cases du bloc servent aux blocs suivants
+    interp->localNames.count = interp->scopeBase;
+    interp->scopeBase = frames->items[frames->count + 2];
+    return statements;
+}
+
+// if or else if, the keyword is already matched
+static void beginIf(uint32_t line, uint32_t column)
+{
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_IF, 0, 0);
+    match(Lparen);
+    NodeRef condition = parseExpression();
+    match(Rparen);
+    pushParse(line);
+    pushParse(column);
+    pushParse(condition);
+    pushParse(PARSE_IF);
+    beginBlock();
 }
 
-ASTNode *parseForStatement()
+static NodeRef createIf(NodeRef condition, NodeRef thenBranch, NodeRef elseBranch)
 {
-    if (DEBUG)
-        printf("Parser: Parsing a for statement\n");
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->nodeType = ForNode;
+    NodeRef node = allocNode(IfNode, sizeof(IfRecord));
+    IfRecord *record = NODE(node, IfRecord);
+    record->condition = condition;
+    record->thenBranch = thenBranch;
+    record->elseBranch = elseBranch;
+    return node;
+}
 
+static void beginFor(uint32_t line, uint32_t column)
+{
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_FOR, 0, 0);
     match(For);
     match(Lparen);
 
-    // Ini
-    node->init = parseAssignment(TYPE_INT);
+    // Ini, ou 'nom in conteneur' pour parcourir un tableau ou un dict
+    if (interp->currentToken.type != Identifier)
+    {
+        reportError("Syntax Error: Expected an identifier, but got '%.*s'\n", TOKEN_TEXT_ARGS(interp->currentToken));
+        failInterpreter();
+    }
+    InternId variable = interp->currentToken.name;
+    match(Identifier);
+    pushParse(line);
+    pushParse(column);
+    if (interp->currentToken.type == Identifier && interp->currentToken.length == 2 &&
+        memcmp(tokenText(interp->currentToken), "in", 2) == 0)
+    {
+        if (interp->currentFunction != NULL_NODE)
+        {
+            reportError("Syntax Error: Loops over arrays and dicts can not be used in function '%s'\n",
+                        internedText(NODE(interp->currentFunction, FunctionRecord)->name));
+            failInterpreter();
+        }
+        // Les éléments sont donnés à la variable par son nom
+        if (localSlot(variable) >= 0)
+        {
+            reportError("Syntax Error: Variable '%s' of a loop over an array or a dict is declared in a block\n",
+                        internedText(variable));
+            failInterpreter();
+        }
+        match(Identifier);
+        InternId container = parseArrayArgument();
+        match(Rparen);
+        pushParse(variable);
+        pushParse(container);
+        pushParse(PARSE_EACH);
+        beginBlock();
+        return;
+    }
+    NodeRef init = parseAssignmentValue(variable, TYPE_INT, 0);
     match(Semicolon);
 
     // Condition
-    node->condition = parseExpression();
+    NodeRef condition = parseExpression();
     match(Semicolon);
 
     // Increment
-    node->increment = parseAssignment(TYPE_INT);
+    NodeRef increment = parseAssignment(TYPE_INT, 0);
     match(Rparen);
 
-    node->body = parseBlock();
-
-    return node;
+    pushParse(init);
+    pushParse(condition);
+    pushParse(increment);
+    pushParse(PARSE_FOR);
+    beginBlock();
 }
 
-ASTNode *parseWhileStatement()
+static void beginWhile(uint32_t line, uint32_t column)
 {
-    if (DEBUG)
-        printf("Parser: Parsing a while statement\n");
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->nodeType = WhileNode;
-
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_WHILE, 0, 0);
     match(While);
     match(Lparen);
-    node->condition = parseExpression();
+    NodeRef condition = parseExpression();
     match(Rparen);
-
-    node->body = parseBlock();
-
-    return node;
+    pushParse(line);
+    pushParse(column);
+    pushParse(condition);
+    pushParse(PARSE_WHILE);
+    beginBlock();
 }
 
-ASTNode *parseBlock()
+// function name(a, b) { ... } at the top level. The record is allocated before the body
+// so that the body can already call the function.
+static void beginFunction(uint32_t line, uint32_t column)
 {
-    if (DEBUG)
-        printf("Parser: Parsing a block\n");
-    match(Lbrace); // '{'
-    ASTNode *statements = NULL;
-    ASTNode *lastStatement = NULL;
-
-    while (currentToken.type != Rbrace && currentToken.type != Eof)
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_FUNCTION, 0, 0);
+    if (interp->blockDepth > 0)
+    {
+        reportError("Syntax Error: Functions can only be declared at the top level\n");
+        failInterpreter();
+    }
+    match(Function);
+    if (interp->currentToken.type != Identifier)
     {
-        ASTNode *stmt = parseStatement();
+        reportError("Syntax Error: Expected a function name, but got '%.*s'\n", TOKEN_TEXT_ARGS(interp->currentToken));
+        failInterpreter();
+    }
+    InternId name = interp->currentToken.name;
+    if (builtinNamed(name) != BUILTIN_NONE || functionNamed(name) != NULL_NODE)
+    {
+        reportError("Syntax Error: Function '%s' is already defined\n", internedText(name));
+        failInterpreter();
+    }
+    match(Identifier);
 
-        if (statements == NULL)
+    // Les paramètres sont les premières cases du cadre, les blocs du corps prennent les suivantes
+    interp->localNames.count = 0;
+    match(Lparen);
+    while (interp->currentToken.type == Identifier)
+    {
+        if (localSlot(interp->currentToken.name) >= 0)
         {
-            statements = stmt;
+            reportError("Syntax Error: Parameter '%s' is repeated\n", internedText(interp->currentToken.name));
+            failInterpreter();
         }
-        else
+        pushWork(&interp->localNames, interp->currentToken.name);
+        match(Identifier);
+        if (interp->currentToken.type != Comma)
         {
-            lastStatement->next = stmt;
+            break;
         }
-        lastStatement = stmt;
+        match(Comma);
     }
+    match(Rparen);
 
-    match(Rbrace); // '}'
-    return statements;
+    NodeRef node = allocNode(FunctionNode, sizeof(FunctionRecord));
+    NODE(node, FunctionRecord)->name = name;
+    NODE(node, FunctionRecord)->parameterCount = interp->localNames.count;
+    pushWork(&interp->functions, name);
+    pushWork(&interp->functions, node);
+
+    interp->currentFunction = node;
+    interp->slotCount = interp->localNames.count;
+    pushParse(line);
+    pushParse(column);
+    pushParse(node);
+    pushParse(PARSE_FUNCTION);
+    beginBlock();
 }
 
-// Assignation for int
-void assignVariableInt(const char *name, VariableType type, int intValue)
+// Start the statement at the current token. A simple statement is parsed into *node and 1 is
+// returned, a statement with a block leaves its frame and the frame of the block and returns 0.
+static int beginStatement(NodeRef *node)
 {
-    for (int i = 0; i < symbolCount; i++)
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_STATEMENT, 0, 0);
+
+    // Positions are looked up in source order, before the statement is parsed
+    uint32_t line = 0;
+    uint32_t column = 0;
+    if (useProfiler)
     {
-        if (strcmp(symbolTable[i].identifier, name) == 0)
-        {
-            symbolTable[i].type = type;
-            symbolTable[i].intValue = intValue;
-            return;
-        }
+        locateOffset(interp->currentToken.offset, &line, &column);
     }
-    if (symbolCount < 100)
+
+    switch (interp->currentToken.type)
     {
-        strcpy(symbolTable[symbolCount].identifier, name);
-        symbolTable[symbolCount].type = type;
-        symbolTable[symbolCount].intValue = intValue;
-        symbolCount++;
+    case IntKeyword:
+        nextToken();
+        *node = parseAssignment(TYPE_INT, 1);
+        match(Semicolon);
+        break;
+    case CharKeyword:
+        nextToken();
+        *node = parseAssignment(TYPE_CHAR, 1);
+        match(Semicolon);
+        break;
+    case ArrayKeyword:
+        nextToken();
+        *node = parseAssignment(TYPE_ARRAY, 1);
+        match(Semicolon);
+        break;
+    case DictKeyword:
+        nextToken();
+        *node = parseAssignment(TYPE_DICT, 1);
+        match(Semicolon);
+        break;
+    case If:
+        match(If);
+        beginIf(line, column);
+        return 0;
+    case For:
+        beginFor(line, column);
+        return 0;
+    case While:
+        beginWhile(line, column);
+        return 0;
+    case Print:
+        *node = parsePrintStatement();
+        match(Semicolon);
+        break;
+    case Flush:
+        *node = parseFlushStatement();
+        match(Semicolon);
+        break;
+    case Function:
+        beginFunction(line, column);
+        return 0;
+    case Return:
+        *node = parseReturnStatement();
+        match(Semicolon);
+        break;
+    case Identifier:
+        *node = parseIdentifierStatement();
+        match(Semicolon);
+        break;
+    default:
+        reportError("Syntax Error: Unexpected token '%.*s' of type %d\n", TOKEN_TEXT_ARGS(interp->currentToken), interp->currentToken.type);
+        failInterpreter();
+        break;
     }
-    else
+
+    if (useProfiler)
     {
-        printf("Runtime Error: Symbol table full\n");
-        exit(1);
+        profileStatement(*node, line, column);
     }
+    return 1;
 }
 
-//  Assignation for string
-void assignVariableString(const char *name, VariableType type, const char *value)
+// The block of the statement on top of the parse stack is in *node. Children are parsed first,
+// records are only written once the arena stops moving. Returns 0 when an else opens another block.
+static int endStatement(NodeRef *node)
 {
-    for (int i = 0; i < symbolCount; i++)
+    WorkStack *frames = &interp->parseStack;
+    ParseKind kind = POP_WORK(frames);
+    switch (kind)
+    {
+    case PARSE_IF:
     {
-        if (strcmp(symbolTable[i].identifier, name) == 0)
+        if (interp->currentToken.type == ElseIf)
+        {
+            TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_ELSE_IF, 0, 0);
+            uint32_t line = 0;
+            uint32_t column = 0;
+            if (useProfiler)
+            {
+                locateOffset(interp->currentToken.offset, &line, &column);
+            }
+            match(ElseIf);
+            pushParse(*node);
+            pushParse(PARSE_ELSE_IF);
+            beginIf(line, column);
+            return 0;
+        }
+        if (interp->currentToken.type == Else)
         {
-            symbolTable[i].type = type;
-            strncpy(symbolTable[i].charValue, value, sizeof(symbolTable[i].charValue) - 1);
-            symbolTable[i].charValue[sizeof(symbolTable[i].charValue) - 1] = '\0'; // Sécurise la fin de chaîne
-            return;
+            TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_ELSE, 0, 0);
+            match(Else);
+            pushParse(*node);
+            pushParse(PARSE_ELSE);
+            beginBlock();
+            return 0;
         }
+        NodeRef condition = POP_WORK(frames);
+        *node = createIf(condition, *node, NULL_NODE);
+        break;
     }
-
-    if (symbolCount < 100)
+    case PARSE_ELSE:
     {
-        strcpy(symbolTable[symbolCount].identifier, name);
-        symbolTable[symbolCount].type = type;
-        strncpy(symbolTable[symbolCount].charValue, value, sizeof(symbolTable[symbolCount].charValue) - 1);
-        symbolTable[symbolCount].charValue[sizeof(symbolTable[symbolCount].charValue) - 1] = '\0';
-        symbolCount++;
+        NodeRef thenBranch = POP_WORK(frames);
+        NodeRef condition = POP_WORK(frames);
+        *node = createIf(condition, thenBranch, *node);
+        break;
     }
-    else
+    case PARSE_ELSE_IF:
     {
-        printf("Runtime Error: Symbol table full\n");
-        exit(1);
+        // The inner if was profiled as a statement of its own at the else if
+        NodeRef thenBranch = POP_WORK(frames);
+        NodeRef condition = POP_WORK(frames);
+        *node = createIf(condition, thenBranch, *node);
+        break;
     }
-}
-
-ASTNode *parseAssignment(VariableType varType)
-{
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->nodeType = AssignmentNode;
-    node->varType = varType;
-
-    // Vérifie si le token actuel est un identifiant
-    if (currentToken.type == Identifier)
+    case PARSE_FOR:
     {
-        strcpy(node->identifier, currentToken.value);
-        match(Identifier);
+        NodeRef body = *node;
+        *node = allocNode(ForNode, sizeof(ForRecord));
+        ForRecord *record = NODE(*node, ForRecord);
+        record->increment = POP_WORK(frames);
+        record->condition = POP_WORK(frames);
+        record->init = POP_WORK(frames);
+        record->body = body;
+        markCountedLoop(*node);
+        break;
     }
-    else
+    case PARSE_EACH:
     {
-        printf("Syntax Error: Expected an identifier, but got '%s'\n", currentToken.value);
-        exit(1);
+        NodeRef body = *node;
+        *node = allocNode(ForEachNode, sizeof(ForEachRecord));
+        ForEachRecord *record = NODE(*node, ForEachRecord);
+        record->container = POP_WORK(frames);
+        record->variable = POP_WORK(frames);
+        record->body = body;
+        break;
     }
-
-    // Vérifie si le prochain token est '='
-    if (currentToken.type == Assign)
+    case PARSE_WHILE:
     {
-        match(Assign);
+        NodeRef body = *node;
+        *node = allocNode(WhileNode, sizeof(WhileRecord));
+        WhileRecord *record = NODE(*node, WhileRecord);
+        record->condition = POP_WORK(frames);
+        record->body = body;
+        break;
     }
-    else
+    case PARSE_FUNCTION:
     {
-        printf("Syntax Error: Expected '=', but got '%s'\n", currentToken.value);
-        exit(1);
+        NodeRef body = *node;
+        *node = POP_WORK(frames);
+        interp->currentFunction = NULL_NODE;
+        FunctionRecord *record = NODE(*node, FunctionRecord);
+        record->localCount = interp->slotCount;
+        record->body = body;
+        interp->localNames.count = 0;
+        interp->slotCount = 0;
+        break;
     }
-
-    // Gère l'expression après l'affectation
-    if (varType == TYPE_CHAR && currentToken.type == StringLiteral)
-    {
-        node->right = malloc(sizeof(ASTNode));
-        node->right->nodeType = CharLiteralNode;
-        node->right->stringValue = strdup(currentToken.value); // Copie la chaîne
-        match(StringLiteral);
+    default:
+        break;
     }
-    else
+
+    uint32_t column = POP_WORK(frames);
+    uint32_t line = POP_WORK(frames);
+    if (useProfiler)
     {
-        node->right = parseExpression(); // Pour d'autres types
+        profileStatement(*node, line, column);
     }
-
-    return node;
-}
-
-ASTNode *parsePrintStatement()
-{
-    if (DEBUG)
-        printf("Parser: Parsing a print statement\n");
-    ASTNode *node = malloc(sizeof(ASTNode));
-    node->nodeType = PrintNode;
-    match(Print);
-    match(Lparen);
-    match(Rparen);
-    return node;
+    return 1;
 }
 
-ASTNode *parseExpression()
+// One statement with all the blocks it contains, parsed without recursion
+NodeRef parseStatement()
 {
-    if (DEBUG)
-        printf("Parser: Parsing an expression\n");
-    ASTNode *node = parseTerm();
+    WorkStack *frames = &interp->parseStack;
+    uint32_t base = frames->count;
+    NodeRef node = NULL_NODE;
+    int complete = beginStatement(&node);
 
-    // Parse binary operators
-    while (currentToken.type == Add || currentToken.type == Sub ||
-           currentToken.type == Lt || currentToken.type == Le ||
-           currentToken.type == Gt || currentToken.type == Ge ||
-           currentToken.type == Ne)
+    while (frames->count > base)
     {
-        if (DEBUG)
-            printf("Parser: Parsing binary operator '%s'\n", currentToken.value);
-        ASTNode *temp = malloc(sizeof(ASTNode));
-        temp->nodeType = BinaryOpNode;
-        temp->tokenType = currentToken.type;
-        temp->left = node;
-        match(currentToken.type);
-        temp->right = parseTerm();
-        node = temp;
+        if (complete)
+        {
+            if (TOP_WORK(frames) != PARSE_BLOCK)
+            {
+                complete = endStatement(&node);
+                continue;
+            }
+            appendStatement(node);
+        }
+        // The innermost block goes on until its '}'
+        if (interp->currentToken.type == Rbrace || interp->currentToken.type == Eof)
+        {
+            node = endBlock();
+            complete = endStatement(&node);
+        }
+        else
+        {
+            complete = beginStatement(&node);
+        }
     }
-
     return node;
 }
 
-ASTNode *parseTerm()
+typedef struct
 {
-    if (DEBUG)
-        printf("Parser: Parsing a term\n");
-    ASTNode *node = parseFactor();
+    InternId name;
+    int slot;        // Block variable to look for instead of name, -1 for none
+    int assignments; // Look for assignments to name instead of reads
+} NameUse;
 
-    while (currentToken.type == Mul || currentToken.type == Div || currentToken.type == Mod)
+static int visitNameUse(NodeRef node, void *context)
+{
+    NameUse *use = context;
+    if (use->slot >= 0)
     {
-        if (DEBUG)
-            printf("Parser: Parsing binary operator '%s'\n", currentToken.value);
-        ASTNode *temp = malloc(sizeof(ASTNode));
-        temp->nodeType = BinaryOpNode;
-        temp->tokenType = currentToken.type;
-        temp->left = node;
-        match(currentToken.type);
-        temp->right = parseFactor();
-        node = temp;
+        return use->assignments
+                   ? NODE_TYPE(node) == LocalAssignNode && NODE(node, LocalAssignRecord)->slot == (uint32_t)use->slot
+                   : NODE_TYPE(node) == LocalNode && NODE(node, LocalRecord)->slot == (uint32_t)use->slot;
     }
-
-    return node;
+    if (use->assignments)
+    {
+        return (NODE_TYPE(node) == AssignmentNode && NODE(node, AssignmentRecord)->name == use->name) ||
+               (NODE_TYPE(node) == ForEachNode && NODE(node, ForEachRecord)->variable == use->name);
+    }
+    return NODE_TYPE(node) == IdentifierNode && NODE(node, IdentifierRecord)->name == use->name;
 }
 
-ASTNode *parseFactor()
+// Does a statement list or expression assign (or read) name
+static int usesName(NodeRef node, InternId name, int assignments)
 {
-    if (DEBUG)
-        printf("Parser: Parsing a factor\n");
-    ASTNode *node;
+    NameUse use = {name, -1, assignments};
+    return forEachNode(node, visitNameUse, &use);
+}
 
-    if (currentToken.type == Number)
-    {
-        if (DEBUG)
-            printf("Parser: Recognized number '%s'\n", currentToken.value);
-        node = malloc(sizeof(ASTNode));
-        node->nodeType = NumberNode;
-        node->value = atoi(currentToken.value);
-        match(Number);
-    }
-    else if (currentToken.type == Identifier)
-    {
-        if (DEBUG)
-            printf("Parser: Recognized identifier '%s'\n", currentToken.value);
-        node = malloc(sizeof(ASTNode));
-        node->nodeType = IdentifierNode;
-        strcpy(node->identifier, currentToken.value);
-        match(Identifier);
-    }
-    else if (currentToken.type == StringLiteral)
-    {
-        if (DEBUG)
-            printf("Parser: Recognized string literal '%s'\n", currentToken.value);
+// Does a statement list or expression assign (or read) the block variable in slot
+static int usesSlot(NodeRef node, uint32_t slot, int assignments)
+{
+    NameUse use = {0, (int)slot, assignments};
+    return forEachNode(node, visitNameUse, &use);
+}
 
-        node = malloc(sizeof(ASTNode));
-        node->nodeType = CharLiteralNode;
+typedef struct
+{
+    NodeRef body;
+    InternId variable;
+} LoopBound;
 
-        node->stringValue = malloc(strlen(currentToken.value) + 1);
-        strcpy(node->stringValue, currentToken.value);
-        match(StringLiteral);
+static int visitLoopBound(NodeRef node, void *context)
+{
+    LoopBound *bound = context;
+    // Arrays change through statements that are not assignments, an element or a length is never invariant,
+    // and a call may read them
+    if (NODE_TYPE(node) == IndexNode || NODE_TYPE(node) == ArrayCallNode || NODE_TYPE(node) == CallNode)
+    {
+        return 1;
     }
-    else if (currentToken.type == Lparen)
+    // A block variable changes when the body stores into its slot
+    if (NODE_TYPE(node) == LocalNode)
     {
-        match(Lparen);
-        node = parseExpression();
-        match(Rparen);
+        return usesSlot(bound->body, NODE(node, LocalRecord)->slot, 1);
     }
-    else
+    if (NODE_TYPE(node) != IdentifierNode)
     {
-        printf("Syntax Error: Unexpected token '%s'\n", currentToken.value);
-        exit(1);
+        return 0;
     }
+    InternId name = NODE(node, IdentifierRecord)->name;
+    return name == bound->variable || usesName(bound->body, name, 1);
+}
 
-    return node;
+// The bound keeps its value while the body runs
+static int isLoopInvariant(NodeRef expression, NodeRef body, InternId variable)
+{
+    LoopBound bound = {body, variable};
+    return !forEachNode(expression, visitLoopBound, &bound);
 }
 
-const char *tokenTypeToString(TokenType type)
+static int visitCall(NodeRef node, void *context)
 {
-    switch (type)
-    {
-    case Semicolon:
-        return ";";
-    case Lparen:
-        return "(";
+    (void)context;
+    return NODE_TYPE(node) == CallNode;
+}
+
+// Flag for (i = a; i < n; i = i + k) loops so the engines keep i out of the symbol table.
+// A function reads its globals from the symbol table, so a body that calls one is left alone,
+// and the slots of a function need no help.
+void markCountedLoop(NodeRef node)
+{
+    ForRecord *record = NODE(node, ForRecord);
+    if (NODE_TYPE(record->init) != AssignmentNode || NODE_TYPE(record->increment) != AssignmentNode ||
+        forEachNode(record->body, visitCall, NULL))
+        return;
+    AssignmentRecord *init = NODE(record->init, AssignmentRecord);
+    AssignmentRecord *increment = NODE(record->increment, AssignmentRecord);
+    InternId variable = init->name;
+
+    // Condition: i compared to a loop invariant bound
+    if (NODE_TYPE(record->condition) != BinaryOpNode)
+        return;
+    BinaryOpRecord *condition = NODE(record->condition, BinaryOpRecord);
+    TokenType compare = condition->header.tokenType;
+    if ((compare != Lt && compare != Le && compare != Gt && compare != Ge && compare != Ne) ||
+        NODE_TYPE(condition->left) != IdentifierNode ||
+        NODE(condition->left, IdentifierRecord)->name != variable ||
+        !isLoopInvariant(condition->right, record->body, variable))
+        return;
+
+    // Increment: i = i + k, i = k + i or i = i - k with a literal k
+    if (increment->name != variable || NODE_TYPE(increment->value) != BinaryOpNode)
+        return;
+    BinaryOpRecord *step = NODE(increment->value, BinaryOpRecord);
+    NodeRef left = step->left;
+    NodeRef right = step->right;
+    if (step->header.tokenType == Add && NODE_TYPE(left) == NumberNode)
+    {
+        left = step->right;
+        right = step->left;
+    }
+    if ((step->header.tokenType != Add && step->header.tokenType != Sub) ||
+        NODE_TYPE(left) != IdentifierNode || NODE(left, IdentifierRecord)->name != variable ||
+        NODE_TYPE(right) != NumberNode)
+        return;
+
+    // The body may read i but not assign it
+    if (usesName(record->body, variable, 1))
+        return;
+
+    int32_t k = NODE(right, NumberRecord)->value;
+    record->step = step->header.tokenType == Add ? k : (int32_t)(0u - (uint32_t)k);
+    record->header.flags = FOR_COUNTED;
+    if (usesName(record->body, variable, 0))
+    {
+        record->header.flags |= FOR_OBSERVED;
+    }
+}
+
+// Slot of a variable declared by the blocks around the statement, -1 for a global
+static int localSlot(InternId name)
+{
+    for (uint32_t i = interp->localNames.count; i > 0; i--)
+    {
+        if (interp->localNames.items[i - 1] == name)
+        {
+            return (int)(i - 1);
+        }
+    }
+    return -1;
+}
+
+// Slot of a variable declared in the innermost block. A name already declared by that block keeps
+// its slot, otherwise the next free one is taken, freed again when the block ends.
+static int declareLocal(InternId name)
+{
+    int slot = localSlot(name);
+    if (slot >= 0 && (uint32_t)slot >= interp->scopeBase)
+    {
+        return slot;
+    }
+    pushWork(&interp->localNames, name);
+    if (interp->localNames.count > interp->slotCount)
+    {
+        interp->slotCount = interp->localNames.count;
+    }
+    return (int)interp->localNames.count - 1;
+}
+
+typedef struct
+{
+    NodeRef functionEnd; // Statement after the function being visited
+    int inFunction;
+    uint32_t count;
+} TopLevelSlots;
+
+// The body of a function is visited before the statement after it
+static int visitTopLevelSlot(NodeRef node, void *context)
+{
+    TopLevelSlots *slots = context;
+    if (node == slots->functionEnd)
+    {
+        slots->inFunction = 0;
+    }
+    if (NODE_TYPE(node) == FunctionNode)
+    {
+        slots->functionEnd = NEXT_NODE(node);
+        slots->inFunction = 1;
+    }
+    else if (NODE_TYPE(node) == LocalAssignNode && !slots->inFunction &&
+             NODE(node, LocalAssignRecord)->slot >= slots->count)
+    {
+        slots->count = NODE(node, LocalAssignRecord)->slot + 1;
+    }
+    return 0;
+}
+
+// Slots of the variables declared by the blocks of the top level, the engines run the
+// program in a frame of that size like the body of a function
+uint32_t topLevelSlots(NodeRef program)
+{
+    TopLevelSlots slots = {NULL_NODE, 0, 0};
+    forEachNode(program, visitTopLevelSlot, &slots);
+    return slots.count;
+}
+
+// Function declared under name, NULL_NODE when there is none
+static NodeRef functionNamed(InternId name)
+{
+    WorkStack *functions = &interp->functions;
+    for (uint32_t i = 0; i < functions->count; i += 2)
+    {
+        if (functions->items[i] == name)
+        {
+            return functions->items[i + 1];
+        }
+    }
+    return NULL_NODE;
+}
+
+NodeRef parseReturnStatement()
+{
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_RETURN, 0, 0);
+    if (interp->currentFunction == NULL_NODE)
+    {
+        reportError("Syntax Error: 'return' outside of a function\n");
+        failInterpreter();
+    }
+    match(Return);
+    NodeRef value = NULL_NODE;
+    if (interp->currentToken.type != Semicolon)
+    {
+        value = parseExpression();
+    }
+
+    NodeRef node = allocNode(ReturnNode, sizeof(ReturnRecord));
+    NODE(node, ReturnRecord)->value = value;
+    return node;
+}
+
+// f(a, b), the arguments wait on the operand stack until the record is allocated
+static NodeRef parseCall(NodeRef function)
+{
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_CALL, 0, 0);
+    WorkStack *arguments = &interp->operandStack;
+    uint32_t base = arguments->count;
+
+    match(Lparen);
+    while (interp->currentToken.type != Rparen)
+    {
+        pushWork(arguments, parseExpression());
+        if (interp->currentToken.type != Comma)
+        {
+            break;
+        }
+        match(Comma);
+    }
+    match(Rparen);
+    return createCall(function, base);
+}
+
+// Call of function with the arguments above base on the operand stack
+static NodeRef createCall(NodeRef function, uint32_t base)
+{
+    WorkStack *arguments = &interp->operandStack;
+    uint32_t count = arguments->count - base;
+    FunctionRecord *callee = NODE(function, FunctionRecord);
+    for (uint32_t i = base; i < arguments->count; i++)
+    {
+        requireInt(arguments->items[i]);
+    }
+    if (count != callee->parameterCount)
+    {
+        reportError("Syntax Error: Function '%s' takes %u arguments, but got %u\n", internedText(callee->name),
+                    callee->parameterCount, count);
+        failInterpreter();
+    }
+
+    NodeRef node = allocNode(CallNode, sizeof(CallRecord) + count * sizeof(NodeRef));
+    CallRecord *record = NODE(node, CallRecord);
+    record->function = function;
+    record->count = count;
+    if (count > 0)
+    {
+        memcpy(record->arguments, arguments->items + base, count * sizeof(NodeRef));
+    }
+    arguments->count = base;
+    return node;
+}
+
+NodeRef parseAssignment(VariableType varType, int declaration)
+{
+    InternId name;
+
+    // Vérifie si le token actuel est un identifiant
+    if (interp->currentToken.type == Identifier)
+    {
+        name = interp->currentToken.name;
+        match(Identifier);
+    }
+    else
+    {
+        reportError("Syntax Error: Expected an identifier, but got '%.*s'\n", TOKEN_TEXT_ARGS(interp->currentToken));
+        failInterpreter();
+    }
+    return parseAssignmentValue(name, varType, declaration);
+}
+
+// '= value' of an assignment whose name is already matched, declaration when it follows a type
+NodeRef parseAssignmentValue(InternId name, VariableType varType, int declaration)
+{
+    if (interp->currentFunction != NULL_NODE && varType != TYPE_INT)
+    {
+        reportError("Syntax Error: Only int variables can be declared in function '%s'\n",
+                    internedText(NODE(interp->currentFunction, FunctionRecord)->name));
+        failInterpreter();
+    }
+    if (declaration && varType != TYPE_INT && interp->blockDepth > 0)
+    {
+        // Only ints have slots, a string, array or dict declared in a block would outlive it
+        reportError("Syntax Error: Only int variables can be declared in a block\n");
+        failInterpreter();
+    }
+
+    // Vérifie si le prochain token est '='
+    if (interp->currentToken.type == Assign)
+    {
+        match(Assign);
+    }
+    else
+    {
+        reportError("Syntax Error: Expected '=', but got '%.*s'\n", TOKEN_TEXT_ARGS(interp->currentToken));
+        failInterpreter();
+    }
+
+    // Gère l'expression après l'affectation, une chaîne seule devient un CharLiteralNode.
+    // Un tableau reçoit une liste entre crochets ou la copie d'un autre tableau,
+    // un dict reçoit {} ou la copie d'un autre dict.
+    NodeRef value;
+    if (varType != TYPE_ARRAY && varType != TYPE_DICT)
+    {
+        value = parseValue();
+    }
+    else if (varType == TYPE_ARRAY && interp->currentToken.type == Lbracket)
+    {
+        value = parseArrayLiteral();
+    }
+    else if (varType == TYPE_DICT && interp->currentToken.type == Lbrace)
+    {
+        match(Lbrace);
+        match(Rbrace);
+        value = allocNode(DictLiteralNode, sizeof(NodeHeader));
+    }
+    else if (interp->currentToken.type == Identifier)
+    {
+        value = allocNode(IdentifierNode, sizeof(IdentifierRecord));
+        NODE(value, IdentifierRecord)->name = interp->currentToken.name;
+        match(Identifier);
+    }
+    else
+    {
+        reportError("Syntax Error: Expected %s, but got '%.*s'\n", varType == TYPE_ARRAY ? "an array" : "a dict",
+                    TOKEN_TEXT_ARGS(interp->currentToken));
+        failInterpreter();
+    }
+
+    // Une concaténation affectée sans type rend la variable globale char, les int et les variables locales la refusent
+    if (varType == TYPE_INT && IS_CONCATENATION(value))
+    {
+        if (declaration || localSlot(name) >= 0 || interp->currentFunction != NULL_NODE)
+        {
+            requireInt(value);
+        }
+        varType = TYPE_CHAR;
+    }
+
+    // Un int déclaré dans un bloc, ou affecté la première fois dans une fonction, reçoit
+    // une case du bloc après sa valeur, qui lit encore la variable du même nom déjà visible
+    int slot = varType == TYPE_INT ? localSlot(name) : -1;
+    if (varType == TYPE_INT && ((declaration && interp->blockDepth > 0) ||
+                                (slot < 0 && interp->currentFunction != NULL_NODE)))
+    {
+        slot = declareLocal(name);
+    }
+    if (slot >= 0)
+    {
+        NodeRef node = allocNode(LocalAssignNode, sizeof(LocalAssignRecord));
+        NODE(node, LocalAssignRecord)->slot = (uint32_t)slot;
+        NODE(node, LocalAssignRecord)->value = value;
+        return node;
+    }
+
+    NodeRef node = allocNode(AssignmentNode, sizeof(AssignmentRecord));
+    AssignmentRecord *record = NODE(node, AssignmentRecord);
+    record->header.varType = varType;
+    record->name = name;
+    record->value = value;
+    return node;
+}
+
+// [e1, e2, ...], the elements wait on the operand stack until the record is allocated
+NodeRef parseArrayLiteral()
+{
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_ARRAY, 0, 0);
+    WorkStack *elements = &interp->operandStack;
+    uint32_t base = elements->count;
+
+    match(Lbracket);
+    while (interp->currentToken.type != Rbracket)
+    {
+        pushWork(elements, parseExpression());
+        if (interp->currentToken.type != Comma)
+        {
+            break;
+        }
+        match(Comma);
+    }
+    match(Rbracket);
+
+    uint32_t count = elements->count - base;
+    NodeRef node = allocNode(ArrayLiteralNode, sizeof(ArrayLiteralRecord) + count * sizeof(NodeRef));
+    ArrayLiteralRecord *record = NODE(node, ArrayLiteralRecord);
+    record->count = count;
+    if (count > 0)
+    {
+        memcpy(record->elements, elements->items + base, count * sizeof(NodeRef));
+    }
+    elements->count = base;
+    return node;
+}
+
+// Statement starting with a name: x = value, a[i] = value, an array operation or a call
+NodeRef parseIdentifierStatement()
+{
+    InternId name = interp->currentToken.name;
+    match(Identifier);
+
+    if (interp->currentToken.type == Lparen)
+    {
+        NodeRef function = builtinNamed(name) == BUILTIN_NONE ? functionNamed(name) : NULL_NODE;
+        return function != NULL_NODE ? parseCall(function) : parseArrayOperation(name);
+    }
+    if (interp->currentToken.type != Lbracket)
+    {
+        return parseAssignmentValue(name, TYPE_INT, 0);
+    }
+
+    match(Lbracket);
+    NodeRef index = parseValue();
+    match(Rbracket);
+    match(Assign);
+    NodeRef value = parseExpression();
+
+    NodeRef node = allocNode(IndexAssignNode, sizeof(IndexAssignRecord));
+    IndexAssignRecord *record = NODE(node, IndexAssignRecord);
+    record->name = name;
+    record->index = index;
+    record->value = value;
+    return node;
+}
+
+// Name of the array or dict passed to a builtin
+static InternId parseArrayArgument()
+{
+    if (interp->currentToken.type != Identifier)
+    {
+        reportError("Syntax Error: Expected an array or dict name, but got '%.*s'\n", TOKEN_TEXT_ARGS(interp->currentToken));
+        failInterpreter();
+    }
+    InternId name = interp->currentToken.name;
+    match(Identifier);
+    return name;
+}
+
+// Builtin named by an identifier followed by '(', expression tells whether it must return a value
+static ArrayBuiltin parseBuiltinName(InternId function, int expression)
+{
+    ArrayBuiltin builtin = builtinNamed(function);
+    if (builtin == BUILTIN_NONE)
+    {
+        reportError("Syntax Error: Unknown function '%s'\n", internedText(function));
+        failInterpreter();
+    }
+    if (builtinIsExpression(builtin) != expression)
+    {
+        reportError(expression ? "Syntax Error: Function '%s' does not return a value\n"
+                               : "Syntax Error: Function '%s' only returns a value\n",
+                    internedText(function));
+        failInterpreter();
+    }
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_CALL, 0, 0);
+    match(Lparen);
+    return builtin;
+}
+
+// push(a, value), add(a, b), scale(a, factor), fill(a, value, count), remove(d, key) or reserve(a, count)
+NodeRef parseArrayOperation(InternId function)
+{
+    ArrayBuiltin builtin = parseBuiltinName(function, 0);
+    InternId name = parseArrayArgument();
+    NodeRef arguments[2] = {NULL_NODE, NULL_NODE};
+
+    if (builtin == BUILTIN_ADD)
+    {
+        match(Comma);
+        InternId other = parseArrayArgument();
+        arguments[0] = allocNode(IdentifierNode, sizeof(IdentifierRecord));
+        NODE(arguments[0], IdentifierRecord)->name = other;
+    }
+    if (builtinTakesKey(builtin))
+    {
+        match(Comma);
+        arguments[0] = parseValue();
+    }
+    for (int i = 0; i < builtinArguments(builtin); i++)
+    {
+        match(Comma);
+        arguments[i] = parseExpression();
+    }
+    match(Rparen);
+
+    NodeRef node = allocNode(ArrayOpNode, sizeof(ArrayOpRecord));
+    ArrayOpRecord *record = NODE(node, ArrayOpRecord);
+    record->builtin = builtin;
+    record->name = name;
+    record->first = arguments[0];
+    record->second = arguments[1];
+    return node;
+}
+
+NodeRef parsePrintStatement()
+{
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_PRINT, 0, 0);
+    match(Print);
+    match(Lparen);
+    NodeRef argument = parseValue();
+    match(Rparen);
+
+    NodeRef node = allocNode(PrintNode, sizeof(PrintRecord));
+    NODE(node, PrintRecord)->argument = argument;
+    return node;
+}
+
+// flush() writes what print buffered so far
+NodeRef parseFlushStatement()
+{
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_FLUSH, 0, 0);
+    match(Flush);
+    match(Lparen);
+    match(Rparen);
+    return allocNode(FlushNode, sizeof(StatementRecord));
+}
+
+// Binding strength of a binary operator, 0 for any other token
+static int operatorPrecedence(TokenType type)
+{
+    switch (type)
+    {
+    case Mul:
+    case Div:
+    case Mod:
+        return 2;
+    case Add:
+    case Sub:
+    case Lt:
+    case Le:
+    case Gt:
+    case Ge:
+    case Ne:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// String literal or concatenation
+static int isString(NodeRef node)
+{
+    return NODE_TYPE(node) == CharLiteralNode || IS_CONCATENATION(node);
+}
+
+// A concatenation where an int is expected, a lone literal still gives its first character
+static void requireInt(NodeRef node)
+{
+    if (IS_CONCATENATION(node))
+    {
+        reportError("Type Error: Expected an int, but got a string\n");
+        failInterpreter();
+    }
+}
+
+// Combine the two topmost operands with the topmost operator. A + with a string on one side and a string
+// or a variable on the other is a concatenation, typed TYPE_CHAR, the other operators only take ints.
+static void reduceOperator()
+{
+    TokenType op = (TokenType)POP_WORK(&interp->operatorStack);
+    NodeRef right = POP_WORK(&interp->operandStack);
+    NodeRef left = POP_WORK(&interp->operandStack);
+    NodeRef node = createBinaryOp(op, left, right);
+    if (op == Add && (isString(left) || isString(right)) &&
+        (isString(left) || NODE_TYPE(left) == IdentifierNode) && (isString(right) || NODE_TYPE(right) == IdentifierNode))
+    {
+        NODE(node, BinaryOpRecord)->header.varType = TYPE_CHAR;
+    }
+    else
+    {
+        requireInt(left);
+        requireInt(right);
+    }
+    pushWork(&interp->operandStack, node);
+}
+
+// Expressions nested in an index, a call argument or a key wait on the operator stack under a frame:
+// the parentheses open around them, the enclosing frame, two words and the kind on top.
+// Kinds are above every token type so that a frame is never taken for an operator.
+enum
+{
+    NESTED_INDEX = 0x10000, // Array name
+    NESTED_CALL,            // Function, first argument on the operand stack
+    NESTED_KEY,             // Builtin, array name
+};
+
+#define NESTED_FRAME 5
+
+static void openNested(uint32_t kind, uint32_t first, uint32_t second, uint32_t *openParens, uint32_t *context)
+{
+    pushWork(&interp->operatorStack, *openParens);
+    pushWork(&interp->operatorStack, *context);
+    pushWork(&interp->operatorStack, first);
+    pushWork(&interp->operatorStack, second);
+    pushWork(&interp->operatorStack, kind);
+    *openParens = 0;
+    *context = interp->operatorStack.count;
+}
+
+static NodeRef createArrayCall(ArrayBuiltin builtin, InternId array, NodeRef key)
+{
+    NodeRef node = allocNode(ArrayCallNode, sizeof(ArrayCallRecord));
+    NODE(node, ArrayCallRecord)->builtin = builtin;
+    NODE(node, ArrayCallRecord)->name = array;
+    NODE(node, ArrayCallRecord)->key = key;
+    return node;
+}
+
+// The innermost nested expression ends at the current token, its node becomes an operand of the
+// enclosing expression. Returns 0 when a comma starts the next argument of a call instead.
+static int closeNested(uint32_t *openParens, uint32_t *context)
+{
+    WorkStack *operators = &interp->operatorStack;
+    while (operatorPrecedence(TOP_WORK(operators)) > 0)
+    {
+        reduceOperator();
+    }
+    uint32_t kind = TOP_WORK(operators);
+    if (kind == NESTED_CALL && interp->currentToken.type == Comma)
+    {
+        // Like parseCall, a comma before the ')' is allowed
+        match(Comma);
+        if (interp->currentToken.type != Rparen)
+        {
+            return 0;
+        }
+    }
+    operators->count -= NESTED_FRAME;
+    uint32_t *frame = operators->items + operators->count;
+    *openParens = frame[0];
+    *context = frame[1];
+    uint32_t first = frame[2];
+    uint32_t second = frame[3];
+
+    NodeRef node;
+    if (kind == NESTED_INDEX)
+    {
+        match(Rbracket);
+        node = allocNode(IndexNode, sizeof(IndexRecord));
+        NODE(node, IndexRecord)->name = first;
+        NODE(node, IndexRecord)->index = POP_WORK(&interp->operandStack);
+    }
+    else if (kind == NESTED_CALL)
+    {
+        match(Rparen);
+        node = createCall(first, second);
+    }
+    else
+    {
+        match(Rparen);
+        node = createArrayCall((ArrayBuiltin)first, second, POP_WORK(&interp->operandStack));
+    }
+    pushWork(&interp->operandStack, node);
+    return 1;
+}
+
+// Expression giving an int
+NodeRef parseExpression()
+{
+    NodeRef node = parseValue();
+    requireInt(node);
+    return node;
+}
+
+// Operator precedence parsing with heap stacks, parentheses, indexes and calls can nest to any depth.
+// Operators of the same precedence group to the left. The value may be a concatenation, which only
+// print, assignments and keys take.
+static NodeRef parseValue()
+{
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_EXPRESSION, 0, 0);
+    uint32_t openParens = 0;
+    uint32_t context = 0;                                // Stack count above the innermost frame, 0 for none
+    uint32_t operatorBase = interp->operatorStack.count; // Operators of the expression being indexed
+
+    while (1)
+    {
+        while (interp->currentToken.type == Lparen)
+        {
+            pushWork(&interp->operatorStack, Lparen);
+            openParens++;
+            match(Lparen);
+        }
+        if (!parseFactor(&openParens, &context))
+        {
+            continue;
+        }
+
+        // Parentheses and nested expressions may end one after the other
+        int argument = 0;
+        while (!argument)
+        {
+            while (interp->currentToken.type == Rparen && openParens > 0)
+            {
+                while (TOP_WORK(&interp->operatorStack) != Lparen)
+                {
+                    reduceOperator();
+                }
+                interp->operatorStack.count--;
+                openParens--;
+                match(Rparen);
+            }
+            if (operatorPrecedence(interp->currentToken.type) != 0 || context == 0)
+            {
+                break;
+            }
+            if (openParens > 0)
+            {
+                match(Rparen); // Reports the missing ')'
+            }
+            argument = !closeNested(&openParens, &context);
+        }
+        if (argument)
+        {
+            continue;
+        }
+
+        int precedence = operatorPrecedence(interp->currentToken.type);
+        if (precedence == 0)
+        {
+            break;
+        }
+
+        TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_OPERATOR, interp->currentToken.type, 0, 0);
+        while (interp->operatorStack.count > operatorBase &&
+               operatorPrecedence(TOP_WORK(&interp->operatorStack)) >= precedence)
+        {
+            reduceOperator();
+        }
+        pushWork(&interp->operatorStack, interp->currentToken.type);
+        match(interp->currentToken.type);
+    }
+
+    if (openParens > 0)
+    {
+        match(Rparen); // Reports the missing ')'
+    }
+    while (interp->operatorStack.count > operatorBase)
+    {
+        reduceOperator();
+    }
+    return POP_WORK(&interp->operandStack);
+}
+
+// Number, identifier or string literal pushed on the operand stack. An element a[i], a call f(a)
+// or a builtin with a key opens the expression inside it instead and returns 0.
+static int parseFactor(uint32_t *openParens, uint32_t *context)
+{
+    TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_FACTOR, 0, 0);
+    NodeRef node = NULL_NODE;
+
+    if (interp->currentToken.type == Number)
+    {
+        node = allocNode(NumberNode, sizeof(NumberRecord));
+        NODE(node, NumberRecord)->value = interp->currentToken.intValue;
+        match(Number);
+    }
+    else if (interp->currentToken.type == Identifier)
+    {
+        InternId name = interp->currentToken.name;
+        match(Identifier);
+        if (interp->currentToken.type == Lbracket)
+        {
+            match(Lbracket);
+            openNested(NESTED_INDEX, name, 0, openParens, context);
+            return 0;
+        }
+        else if (interp->currentToken.type == Lparen &&
+                 builtinNamed(name) == BUILTIN_NONE && functionNamed(name) != NULL_NODE)
+        {
+            TRACE(TRACE_PARSER, TRACE_DETAIL, EV_PARSE_RULE, RULE_CALL, 0, 0);
+            match(Lparen);
+            if (interp->currentToken.type != Rparen)
+            {
+                openNested(NESTED_CALL, functionNamed(name), interp->operandStack.count, openParens, context);
+                return 0;
+            }
+            match(Rparen);
+            node = createCall(functionNamed(name), interp->operandStack.count);
+        }
+        else if (interp->currentToken.type == Lparen)
+        {
+            ArrayBuiltin builtin = parseBuiltinName(name, 1);
+            InternId array = parseArrayArgument();
+            if (builtinTakesKey(builtin))
+            {
+                match(Comma);
+                openNested(NESTED_KEY, builtin, array, openParens, context);
+                return 0;
+            }
+            match(Rparen);
+            node = createArrayCall(builtin, array, NULL_NODE);
+        }
+        else if (localSlot(name) >= 0)
+        {
+            node = allocNode(LocalNode, sizeof(LocalRecord));
+            NODE(node, LocalRecord)->slot = (uint32_t)localSlot(name);
+        }
+        else
+        {
+            node = allocNode(IdentifierNode, sizeof(IdentifierRecord));
+            NODE(node, IdentifierRecord)->name = name;
+        }
+    }
+    else if (interp->currentToken.type == StringLiteral)
+    {
+        node = createCharLiteral(tokenText(interp->currentToken), interp->currentToken.length);
+        match(StringLiteral);
+    }
+    else
+    {
+        reportError("Syntax Error: Unexpected token '%.*s'\n", TOKEN_TEXT_ARGS(interp->currentToken));
+        failInterpreter();
+    }
+
+    pushWork(&interp->operandStack, node);
+    return 1;
+}
+
+const char *tokenTypeToString(TokenType type)
+{
+    switch (type)
+    {
+    case Semicolon:
+        return ";";
+    case Lparen:
+        return "(";
     case Rparen:
         return ")";
     case Identifier:
@@ -486,262 +1518,973 @@ const char *tokenTypeToString(TokenType type)
     }
 }
 
-int evaluateAST(ASTNode *node)
+static int compareCounted(TokenType compare, int value, int bound)
+{
+    switch (compare)
+    {
+    case Lt:
+        return value < bound;
+    case Le:
+        return value <= bound;
+    case Gt:
+        return value > bound;
+    case Ge:
+        return value >= bound;
+    default:
+        return value != bound;
+    }
+}
+
+static int applyBinaryOp(TokenType op, int leftValue, int rightValue)
+{
+    switch (op)
+    {
+    case Add:
+        return (int32_t)((uint32_t)leftValue + (uint32_t)rightValue);
+    case Sub:
+        return (int32_t)((uint32_t)leftValue - (uint32_t)rightValue);
+    case Mul:
+        return (int32_t)((uint32_t)leftValue * (uint32_t)rightValue);
+    case Div:
+    case Mod:
+        if (divisionFails(leftValue, rightValue))
+        {
+            failDivision(rightValue);
+        }
+        return op == Div ? leftValue / rightValue : leftValue % rightValue;
+    case Lt:
+        return leftValue < rightValue;
+    case Le:
+        return leftValue <= rightValue;
+    case Gt:
+        return leftValue > rightValue;
+    case Ge:
+        return leftValue >= rightValue;
+    case Ne:
+        return leftValue != rightValue;
+    default:
+        reportError("Runtime Error: Unknown binary operator '%d'\n", op);
+        failInterpreter();
+    }
+}
+
+// Key written as a number, a string or a variable, 0 for the other expressions
+static inline int namedKey(NodeRef node, DictKey *key)
+{
+    if (NODE_TYPE(node) == NumberNode)
+    {
+        makeIntKey(key, NODE(node, NumberRecord)->value);
+        return 1;
+    }
+    if (NODE_TYPE(node) == CharLiteralNode || NODE_TYPE(node) == IdentifierNode || IS_CONCATENATION(node))
+    {
+        keyFromNode(node, key);
+        return 1;
+    }
+    return 0;
+}
+
+// Value of a number, identifier or literal, 0 for an operator
+static inline int evaluateLeaf(NodeRef node, int *value)
+{
+    switch (NODE_TYPE(node))
+    {
+    case NumberNode:
+        *value = NODE(node, NumberRecord)->value;
+        return 1;
+
+    case IdentifierNode:
+    {
+        InternId name = NODE(node, IdentifierRecord)->name;
+        *value = lookupVariableHashed(internedText(name), internedHash(name));
+        TRACE(TRACE_EVAL, TRACE_DETAIL, EV_EVAL_IDENTIFIER, name, *value, 0);
+        return 1;
+    }
+
+    case CharLiteralNode:
+        *value = NODE(node, CharLiteralRecord)->text[0];
+        return 1;
+
+    case LocalNode:
+        *value = (int)interp->localStack.items[interp->localBase + NODE(node, LocalRecord)->slot];
+        return 1;
+
+    case ArrayCallNode:
+    {
+        // has is only a leaf when its key is one too
+        ArrayCallRecord *record = NODE(node, ArrayCallRecord);
+        DictKey key;
+        if (record->key != NULL_NODE && !namedKey(record->key, &key))
+        {
+            return 0;
+        }
+        *value = callArrayBuiltin(record->builtin, record->name, &key);
+        return 1;
+    }
+
+    case IndexNode:
+    {
+        // Only a leaf when the index is one too, the others go through the stacks
+        IndexRecord *record = NODE(node, IndexRecord);
+        DictKey key;
+        if (!namedKey(record->index, &key))
+        {
+            return 0;
+        }
+        *value = readElement(record->name, &key);
+        return 1;
+    }
+
+    default:
+        return 0;
+    }
+}
+
+static void enterCall(NodeRef node, uint32_t pendingBase);
+
+// Post-order walk with heap stacks: an operator is pushed back under a NULL_NODE
+// marker and applied once both operands are on the value stack, an element once its index
+// (or has once its key) is, a call once its arguments are. Operands that are leaves may be read twice.
+// A call is never a leaf: its body is pushed as frames and the walk stops with 0, to go on
+// from the same pending work once the call returns.
+static int runExpressions(uint32_t base)
+{
+    WorkStack *pending = &interp->expressionStack;
+    WorkStack *values = &interp->valueStack;
+    int value;
+
+    while (pending->count > base)
+    {
+        NodeRef node = POP_WORK(pending);
+        int leftValue, rightValue;
+
+        if (node == NULL_NODE)
+        {
+            node = POP_WORK(pending);
+            if (NODE_TYPE(node) == CallNode)
+            {
+                enterCall(node, base);
+                return 0;
+            }
+            if (NODE_TYPE(node) == IndexNode || NODE_TYPE(node) == ArrayCallNode)
+            {
+                DictKey key;
+                makeIntKey(&key, (int32_t)TOP_WORK(values));
+                TOP_WORK(values) = NODE_TYPE(node) == IndexNode
+                                       ? (uint32_t)readElement(NODE(node, IndexRecord)->name, &key)
+                                       : (uint32_t)callArrayBuiltin(NODE(node, ArrayCallRecord)->builtin,
+                                                                    NODE(node, ArrayCallRecord)->name, &key);
+                continue;
+            }
+            rightValue = (int)POP_WORK(values);
+            leftValue = (int)POP_WORK(values);
+        }
+        else
+        {
+            TRACE(TRACE_EVAL, TRACE_DETAIL, EV_EVAL_NODE, node, NODE_TYPE(node), 0);
+            if (evaluateLeaf(node, &value))
+            {
+                pushWork(values, (uint32_t)value);
+                continue;
+            }
+            if (NODE_TYPE(node) == CallNode)
+            {
+                CallRecord *call = NODE(node, CallRecord);
+                pushWork(pending, node);
+                pushWork(pending, NULL_NODE);
+                for (uint32_t i = call->count; i > 0; i--)
+                {
+                    pushWork(pending, call->arguments[i - 1]);
+                }
+                continue;
+            }
+            if (NODE_TYPE(node) == IndexNode || NODE_TYPE(node) == ArrayCallNode)
+            {
+                pushWork(pending, node);
+                pushWork(pending, NULL_NODE);
+                pushWork(pending, NODE_TYPE(node) == IndexNode ? NODE(node, IndexRecord)->index
+                                                               : NODE(node, ArrayCallRecord)->key);
+                continue;
+            }
+            if (NODE_TYPE(node) != BinaryOpNode)
+            {
+                reportError("Runtime Error: Unknown AST node type '%d'\n", NODE_TYPE(node));
+                failInterpreter();
+            }
+
+            // Operands that are leaves are read in place, the others wait on the stack
+            BinaryOpRecord *record = NODE(node, BinaryOpRecord);
+            if (NODE_TYPE(record->left) == BinaryOpNode || NODE_TYPE(record->right) == BinaryOpNode ||
+                !evaluateLeaf(record->left, &leftValue) || !evaluateLeaf(record->right, &rightValue))
+            {
+                pushWork(pending, node);
+                pushWork(pending, NULL_NODE);
+                pushWork(pending, record->right);
+                pushWork(pending, record->left);
+                continue;
+            }
+        }
+
+        TokenType op = NODE(node, BinaryOpRecord)->header.tokenType;
+        TRACE(TRACE_EVAL, TRACE_DETAIL, EV_EVAL_BINARY, op, leftValue, rightValue);
+        pushWork(values, (uint32_t)applyBinaryOp(op, leftValue, rightValue));
+    }
+    return 1;
+}
+
+// Push the values of count expressions in order, 0 when a call was entered first. The step that
+// asked for them runs again once the call returns, with interp->resuming set, and the walk goes
+// on where it stopped. Steps evaluate all their expressions at once, before changing anything.
+static int evaluateOperands(const NodeRef *roots, uint32_t count)
+{
+    WorkStack *pending = &interp->expressionStack;
+    uint32_t base = pending->count;
+    if (interp->resuming)
+    {
+        interp->resuming = 0;
+        base = interp->resumeBase;
+    }
+    else
+    {
+        for (uint32_t i = count; i > 0; i--)
+        {
+            pushWork(pending, roots[i - 1]);
+        }
+    }
+    return runExpressions(base);
+}
+
+// Value of one expression, 0 when a call was entered first like evaluateOperands
+static inline int evaluateValue(NodeRef root, int *value)
+{
+    if (!interp->resuming && evaluateLeaf(root, value))
+    {
+        return 1;
+    }
+    if (!evaluateOperands(&root, 1))
+    {
+        return 0;
+    }
+    *value = (int)POP_WORK(&interp->valueStack);
+    return 1;
+}
+
+// Statements waiting to run, a frame is its words followed by its kind on top
+typedef enum
+{
+    FRAME_LIST,          // statement (next to run)
+    FRAME_SINGLE,        // statement, run it without its successors
+    FRAME_WHILE,         // while node
+    FRAME_FOR,           // for node, test the condition
+    FRAME_FOR_STEP,      // for node, the body just ran
+    FRAME_COUNTED,       // value, bound, for node, test value against bound
+    FRAME_COUNTED_STEP,  // value, bound, for node, the body just ran
+    FRAME_EACH,          // position, for each node
+    FRAME_RETURN,        // pending base, local base and call base of the caller, frame base of the call
+} FrameKind;
+
+static void pushFrame(NodeRef node, FrameKind kind)
+{
+    pushWork(&interp->frameStack, node);
+    pushWork(&interp->frameStack, kind);
+}
+
+// Resolve an operand of a string expression, the text and length are returned
+static const char *stringOperand(NodeRef node, uint32_t *length)
+{
+    if (NODE_TYPE(node) == CharLiteralNode)
+    {
+        *length = NODE(node, CharLiteralRecord)->length;
+        return NODE(node, CharLiteralRecord)->text;
+    }
+    if (NODE_TYPE(node) == IdentifierNode)
+    {
+        InternId name = NODE(node, IdentifierRecord)->name;
+        SymbolTableEntry *entry = lookupSymbolHashed(internedText(name), internedHash(name));
+        if (entry == NULL)
+        {
+            reportError("Runtime Error: Undefined variable '%s'\n", internedText(name));
+            failInterpreter();
+        }
+        if (entry->type != TYPE_CHAR)
+        {
+            reportError("Type Error: Variable '%s' is not of type char\n", internedText(name));
+            failInterpreter();
+        }
+        *length = entry->stringValue.length;
+        return stringText(&entry->stringValue);
+    }
+    reportError("Type Error: Expected a string, but got an int\n");
+    failInterpreter();
+}
+
+// Operands of a string expression, literals and char variables joined by +, pushed on the value stack
+// in source order. Each one is checked before anything is changed.
+static void pushStringOperands(NodeRef value)
+{
+    WorkStack *pending = &interp->expressionStack;
+    uint32_t pendingBase = pending->count;
+
+    pushWork(pending, value);
+    while (pending->count > pendingBase)
+    {
+        NodeRef node = POP_WORK(pending);
+        if (NODE_TYPE(node) == BinaryOpNode && NODE(node, BinaryOpRecord)->header.tokenType == Add)
+        {
+            pushWork(pending, NODE(node, BinaryOpRecord)->right);
+            pushWork(pending, NODE(node, BinaryOpRecord)->left);
+            continue;
+        }
+        uint32_t length;
+        stringOperand(node, &length);
+        pushWork(&interp->valueStack, node);
+    }
+}
+
+// Append the operands from first to the top of the value stack to result, then drop them down to base
+static void appendStringOperands(StringValue *result, uint32_t first, uint32_t base)
 {
-    if (node == NULL)
+    WorkStack *operands = &interp->valueStack;
+    for (uint32_t i = first; i < operands->count; i++)
     {
-        return 0;
+        uint32_t length;
+        const char *text = stringOperand(operands->items[i], &length);
+        appendString(result, text, length);
+    }
+    operands->count = base;
+}
+
+// Start result with the operand at first, a variable is shared instead of copied. Returns the next operand.
+static uint32_t startString(StringValue *result, uint32_t first)
+{
+    NodeRef node = interp->valueStack.items[first];
+    result->length = 0;
+    result->small[0] = '\0';
+    if (NODE_TYPE(node) != IdentifierNode)
+    {
+        return first;
     }
+    InternId name = NODE(node, IdentifierRecord)->name;
+    shareString(result, &lookupSymbolHashed(internedText(name), internedHash(name))->stringValue);
+    return first + 1;
+}
+
+// Value of a string expression, released by the caller
+void joinStringExpression(NodeRef value, StringValue *result)
+{
+    uint32_t base = interp->valueStack.count;
+    pushStringOperands(value);
+    appendStringOperands(result, startString(result, base), base);
+}
+
+// Assign a string expression. When it starts with the variable itself and no other operand reads it,
+// its value is taken over, so that s = s + x appends in place while no other variable shares the text.
+void assignStringExpression(InternId name, NodeRef value)
+{
+    WorkStack *operands = &interp->valueStack;
+    uint32_t base = operands->count;
+    pushStringOperands(value);
 
-    // print all the nodes
-    if (DEBUG)
+    int reusesTarget = 1;
+    for (uint32_t i = base; i < operands->count; i++)
     {
-        switch (node->nodeType)
+        NodeRef node = operands->items[i];
+        int isTarget = NODE_TYPE(node) == IdentifierNode && NODE(node, IdentifierRecord)->name == name;
+        if (isTarget != (i == base))
         {
-        case NumberNode:
-            printf("Evaluator: Number node with value %d\n", node->value);
-            break;
-        case IdentifierNode:
-            printf("Evaluator: Identifier '%s'\n", node->identifier);
-            break;
-        case CharLiteralNode:
-            printf("Evaluator: Char literal with value '%c'\n", node->charValue);
-            break;
-        case BinaryOpNode:
-            printf("Evaluator: Binary operator '%d'\n", node->tokenType);
-            break;
-        case AssignmentNode:
-            printf("Evaluator: Assignment to '%s'\n", node->identifier);
-            break;
-        case PrintNode:
-            printf("Evaluator: Print statement\n");
-            break;
-        case IfNode:
-            printf("Evaluator: If statement\n");
-            break;
-        case ForNode:
-            printf("Evaluator: For loop\n");
-            break;
-        case WhileNode:
-            printf("Evaluator: While loop\n");
-            break;
-        default:
-            printf("Evaluator: Unknown node type: %d\n", node->nodeType);
-            exit(1);
-            break;
+            reusesTarget = 0;
         }
     }
 
-    switch (node->nodeType)
+    StringValue result;
+    uint32_t first = base;
+    if (reusesTarget)
     {
-    case NumberNode:
-        if (DEBUG)
-            printf("Evaluator: Number node with value %d\n", node->value);
-        return node->value;
+        SymbolTableEntry *entry = lookupSymbolHashed(internedText(name), internedHash(name));
+        result = entry->stringValue;
+        entry->stringValue.length = 0;
+        entry->stringValue.small[0] = '\0';
+        first++;
+    }
+    else
+    {
+        first = startString(&result, base);
+    }
+    appendStringOperands(&result, first, base);
 
-    case IdentifierNode:
+    assignVariableValueHashed(internedText(name), internedHash(name), &result);
+}
+
+// Run an assignment, 0 when its value entered a call first
+static int evaluateAssignment(NodeRef node)
+{
+    int value;
+    if (NODE_TYPE(node) == LocalAssignNode)
     {
-        int value = lookupVariable(node->identifier);
-        if (DEBUG)
-            printf("Evaluator: Identifier '%s' has value %d\n", node->identifier, value);
-        return value;
+        if (!evaluateValue(NODE(node, LocalAssignRecord)->value, &value))
+        {
+            return 0;
+        }
+        interp->localStack.items[interp->localBase + NODE(node, LocalAssignRecord)->slot] = (uint32_t)value;
+        return 1;
     }
-    case CharLiteralNode:
-        if (DEBUG)
-            printf("Evaluator: Char literal with value '%c'\n", node->charValue);
-        return node->charValue;
 
-    case BinaryOpNode:
+    AssignmentRecord *record = NODE(node, AssignmentRecord);
+    const char *identifier = internedText(record->name);
+    if (record->header.varType == TYPE_INT)
     {
-        int leftValue = evaluateAST(node->left);
-        int rightValue = evaluateAST(node->right);
-        int result;
-        if (DEBUG)
-            printf("Evaluator: Performing binary operation '%d' on %d and %d\n", node->tokenType, leftValue, rightValue);
-        switch (node->tokenType)
+        if (!evaluateValue(record->value, &value))
         {
-        case Add:
-            result = leftValue + rightValue;
-            break;
-        case Sub:
-            result = leftValue - rightValue;
-            break;
-        case Mul:
-            result = leftValue * rightValue;
-            break;
-        case Div:
-            result = leftValue / rightValue;
-            break;
-        case Mod:
-            result = leftValue % rightValue;
-            break;
-        case Lt:
-            result = leftValue < rightValue;
-            break;
-        case Le:
-            result = leftValue <= rightValue;
-            break;
-        case Gt:
-            result = leftValue > rightValue;
-            break;
-        case Ge:
-            result = leftValue >= rightValue;
-            break;
-        case Ne:
-            result = leftValue != rightValue;
-            break;
-        default:
-            printf("Runtime Error: Unknown binary operator '%d'\n", node->tokenType);
-            exit(1);
+            return 0;
+        }
+        assignVariableIntHashed(identifier, internedHash(record->name), TYPE_INT, value);
+        TRACE(TRACE_EVAL, TRACE_DETAIL, EV_EVAL_ASSIGN_INT, record->name, value, 0);
+    }
+    else if (record->header.varType == TYPE_CHAR)
+    {
+        if (NODE_TYPE(record->value) == CharLiteralNode)
+        {
+            const char *stringValue = NODE(record->value, CharLiteralRecord)->text;
+            assignVariableStringHashed(identifier, internedHash(record->name), TYPE_CHAR, stringValue);
+        }
+        else
+        {
+            assignStringExpression(record->name, record->value);
+        }
+        TRACE(TRACE_EVAL, TRACE_DETAIL, EV_EVAL_ASSIGN_CHAR, record->name, 0, 0);
+    }
+    else if (record->header.varType == TYPE_DICT)
+    {
+        if (NODE_TYPE(record->value) == DictLiteralNode)
+        {
+            assignEmptyDict(record->name);
+        }
+        else
+        {
+            assignDictCopy(record->name, NODE(record->value, IdentifierRecord)->name);
         }
-        return result;
     }
+    else if (NODE_TYPE(record->value) == ArrayLiteralNode)
+    {
+        // Elements are computed on the value stack, then copied in one piece
+        WorkStack *values = &interp->valueStack;
+        uint32_t count = NODE(record->value, ArrayLiteralRecord)->count;
+        if (!evaluateOperands(NODE(record->value, ArrayLiteralRecord)->elements, count))
+        {
+            return 0;
+        }
+        uint32_t base = values->count - count;
+        assignArrayElements(record->name, (const int32_t *)values->items + base, count);
+        values->count = base;
+    }
+    else
+    {
+        assignArrayCopy(record->name, NODE(record->value, IdentifierRecord)->name);
+    }
+    return 1;
+}
+
+// Values taken from the top of the value stack as the first slots of a frame, the other slots start at 0
+static void pushSlots(uint32_t count, uint32_t localCount)
+{
+    WorkStack *values = &interp->valueStack;
+    values->count -= count;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        pushWork(&interp->localStack, values->items[values->count + i]);
+    }
+    for (uint32_t i = count; i < localCount; i++)
+    {
+        pushWork(&interp->localStack, 0);
+    }
+}
+
+// Start a call whose arguments are on the value stack. The body runs on a new frame of interp->localStack
+// and on the frame stack like any block, nested calls only cost memory bounded by --stack-limit.
+// FRAME_RETURN keeps what the caller needs to go on.
+static void enterCall(NodeRef node, uint32_t pendingBase)
+{
+    CallRecord *call = NODE(node, CallRecord);
+    FunctionRecord *function = NODE(call->function, FunctionRecord);
+    uint32_t base = interp->localStack.count;
+    pushSlots(call->count, function->localCount);
+
+    pushWork(&interp->frameStack, pendingBase);
+    pushWork(&interp->frameStack, interp->localBase);
+    pushWork(&interp->frameStack, interp->callBase);
+    pushFrame(base, FRAME_RETURN);
+    interp->localBase = base;
+    interp->callBase = interp->frameStack.count;
+    pushFrame(function->body, FRAME_LIST);
+}
+
+// return f(...) replaces the frame of the running function instead of nesting a call,
+// the arguments are on the value stack
+static void enterTailCall(NodeRef node)
+{
+    CallRecord *call = NODE(node, CallRecord);
+    FunctionRecord *function = NODE(call->function, FunctionRecord);
+    interp->localStack.count = interp->localBase;
+    pushSlots(call->count, function->localCount);
+
+    interp->frameStack.count = interp->callBase;
+    pushFrame(function->body, FRAME_LIST);
+}
+
+// Run one statement, blocks and loops are pushed as frames instead of recursing.
+// 0 when an expression entered a call first, the statement then runs again once it returns.
+static int executeStatement(NodeRef node)
+{
+    TRACE(TRACE_EVAL, TRACE_DETAIL, EV_EVAL_NODE, node, NODE_TYPE(node), 0);
+    int value;
 
+    switch (NODE_TYPE(node))
+    {
     case AssignmentNode:
+    case LocalAssignNode:
+        return evaluateAssignment(node);
+
+    case PrintNode:
     {
-        if (node->varType == TYPE_INT)
+        NodeRef argument = NODE(node, PrintRecord)->argument;
+        if (NODE_TYPE(argument) == IdentifierNode)
+        {
+            printVariable(internedText(NODE(argument, IdentifierRecord)->name));
+        }
+        else if (NODE_TYPE(argument) == CharLiteralNode)
+        {
+            printString(NODE(argument, CharLiteralRecord)->text);
+        }
+        else if (IS_CONCATENATION(argument))
+        {
+            StringValue text;
+            joinStringExpression(argument, &text);
+            printString(stringText(&text));
+            releaseString(&text);
+        }
+        else
         {
-            int value = evaluateAST(node->right);
-            assignVariableInt(node->identifier, node->varType, value);
-            if (DEBUG)
-                printf("Evaluator: Assigned int value %d to variable '%s'\n", value, node->identifier);
-            return value;
+            if (!evaluateValue(argument, &value))
+            {
+                return 0;
+            }
+            printInt(value);
         }
-        else if (node->varType == TYPE_CHAR)
+        break;
+    }
+
+    case FlushNode:
+        flushOutput();
+        break;
+
+    case IndexAssignNode:
+    {
+        // A named key borrows the text of its variable, it is made once the value is known
+        IndexAssignRecord *record = NODE(node, IndexAssignRecord);
+        DictKey key;
+        if (NODE_TYPE(record->index) == CharLiteralNode || NODE_TYPE(record->index) == IdentifierNode ||
+            IS_CONCATENATION(record->index))
         {
-            if (node->right->nodeType == CharLiteralNode)
+            if (!evaluateValue(record->value, &value))
             {
-                const char *stringValue = node->right->stringValue;
-                assignVariableString(node->identifier, node->varType, stringValue);
-                if (DEBUG)
-                    printf("Evaluator: Assigned string value '%s' to variable '%s'\n", stringValue, node->identifier);
                 return 0;
             }
-            else
+            keyFromNode(record->index, &key);
+        }
+        else
+        {
+            NodeRef operands[2] = {record->index, record->value};
+            if (!evaluateOperands(operands, 2))
             {
-                printf("Runtime Error: Unexpected type for variable '%s'\n", node->identifier);
-                exit(1);
+                return 0;
             }
+            value = (int)POP_WORK(&interp->valueStack);
+            makeIntKey(&key, (int32_t)POP_WORK(&interp->valueStack));
         }
+        writeElement(record->name, &key, value);
+        break;
+    }
 
-        return 0;
+    case ArrayOpNode:
+    {
+        // Arguments in source order, add names its second array and remove gives a key instead
+        ArrayOpRecord *record = NODE(node, ArrayOpRecord);
+        int32_t arguments[2] = {0, 0};
+        InternId other = 0;
+        DictKey key;
+        if (record->builtin == BUILTIN_ADD)
+        {
+            other = NODE(record->first, IdentifierRecord)->name;
+        }
+        else if (record->builtin == BUILTIN_REMOVE)
+        {
+            if (!namedKey(record->first, &key))
+            {
+                if (!evaluateValue(record->first, &value))
+                {
+                    return 0;
+                }
+                makeIntKey(&key, value);
+            }
+        }
+        else
+        {
+            NodeRef operands[2] = {record->first, record->second};
+            int count = builtinArguments(record->builtin);
+            if (!evaluateOperands(operands, (uint32_t)count))
+            {
+                return 0;
+            }
+            interp->valueStack.count -= (uint32_t)count;
+            for (int i = 0; i < count; i++)
+            {
+                arguments[i] = (int32_t)interp->valueStack.items[interp->valueStack.count + (uint32_t)i];
+            }
+        }
+        runArrayBuiltin(record->builtin, record->name, other, &key, arguments);
+        break;
     }
 
     case IfNode:
     {
-        int conditionResult = evaluateAST(node->condition);
-        if (DEBUG)
-            printf("Evaluator: If condition evaluated to %d\n", conditionResult);
-        if (conditionResult)
+        IfRecord *record = NODE(node, IfRecord);
+        if (!evaluateValue(record->condition, &value))
         {
-            if (DEBUG)
-                printf("Evaluator: Executing 'then' branch\n");
-            evaluateAST(node->thenBranch);
+            return 0;
         }
-        else if (node->elseBranch != NULL)
+        TRACE(TRACE_EVAL, TRACE_DETAIL, EV_EVAL_BRANCH, value, value ? 0 : record->elseBranch != NULL_NODE ? 1 : 2, 0);
+        NodeRef branch = value ? record->thenBranch : record->elseBranch;
+        if (branch != NULL_NODE)
         {
-            if (DEBUG)
-                printf("Evaluator: Executing 'else' branch\n");
-            evaluateAST(node->elseBranch);
+            pushFrame(branch, FRAME_LIST);
         }
-        return 0;
+        break;
     }
 
     case ForNode:
     {
-        if (DEBUG)
-            printf("Evaluator: Evaluating a for loop\n");
-        for (
-            evaluateAST(node->init);
-            evaluateAST(node->condition);
-            evaluateAST(node->increment))
+        ForRecord *record = NODE(node, ForRecord);
+        if (record->header.flags & FOR_COUNTED)
+        {
+            // The induction variable lives in the frame, the symbol table sees it only when the body reads it
+            NodeRef operands[2] = {NODE(record->init, AssignmentRecord)->value,
+                                   NODE(record->condition, BinaryOpRecord)->right};
+            if (!evaluateOperands(operands, 2))
+            {
+                return 0;
+            }
+            TRACE(TRACE_EVAL, TRACE_DETAIL, EV_EVAL_LOOP, ForNode, record->header.flags, 0);
+            uint32_t bound = POP_WORK(&interp->valueStack);
+            pushWork(&interp->frameStack, POP_WORK(&interp->valueStack));
+            pushWork(&interp->frameStack, bound);
+            pushFrame(node, FRAME_COUNTED);
+        }
+        else
         {
-            evaluateAST(node->body);
+            if (!evaluateAssignment(record->init))
+            {
+                return 0;
+            }
+            TRACE(TRACE_EVAL, TRACE_DETAIL, EV_EVAL_LOOP, ForNode, record->header.flags, 0);
+            pushFrame(node, FRAME_FOR);
         }
-        return 0;
+        break;
     }
 
     case WhileNode:
+        TRACE(TRACE_EVAL, TRACE_DETAIL, EV_EVAL_LOOP, WhileNode, 0, 0);
+        pushFrame(node, FRAME_WHILE);
+        break;
+
+    case ForEachNode:
+        TRACE(TRACE_EVAL, TRACE_DETAIL, EV_EVAL_LOOP, ForEachNode, 0, 0);
+        pushWork(&interp->frameStack, 0);
+        pushFrame(node, FRAME_EACH);
+        break;
+
+    case FunctionNode:
+        // Calls refer to the declaration, it does nothing when it runs
+        break;
+
+    case CallNode:
+        // The result is left on the value stack when the call returns
+        return evaluateValue(node, &value);
+
+    case ReturnNode:
     {
-        if (DEBUG)
-            printf("Evaluator: Evaluating a while loop\n");
-        while (evaluateAST(node->condition))
+        // The frames of the function are dropped, FRAME_RETURN then gives the value to the caller
+        NodeRef result = NODE(node, ReturnRecord)->value;
+        if (result != NULL_NODE && NODE_TYPE(result) == CallNode)
         {
-            ASTNode *bodyNode = node->body;
-            while (bodyNode != NULL)
+            if (!evaluateOperands(NODE(result, CallRecord)->arguments, NODE(result, CallRecord)->count))
             {
-                evaluateAST(bodyNode);
-                bodyNode = bodyNode->next;
+                return 0;
             }
+            enterTailCall(result);
+            break;
+        }
+        value = 0;
+        if (result != NULL_NODE && !evaluateValue(result, &value))
+        {
+            return 0;
         }
+        interp->returnValue = value;
+        interp->frameStack.count = interp->callBase;
         break;
     }
 
-    case PrintNode:
+    default:
+        reportError("Runtime Error: Unknown AST node type '%d'\n", NODE_TYPE(node));
+        failInterpreter();
+    }
+    return 1;
+}
+
+// Run frames until the stack is back to base, nesting only costs frame stack entries.
+// Specialized with and without profiling so that the plain walker pays nothing for it.
+static inline __attribute__((always_inline)) void runFramesWith(uint32_t base, const int profiled)
+{
+    WorkStack *frames = &interp->frameStack;
+    while (frames->count > base)
     {
-        SymbolTableEntry *entry = lookupSymbol(node->left->identifier);
-        if (entry != NULL)
+        uint32_t *top = frames->items + frames->count;
+        FrameKind kind = (FrameKind)top[-1];
+        NodeRef node = top[-2];
+
+        int value;
+
+        switch (kind)
+        {
+        case FRAME_LIST:
+        case FRAME_SINGLE:
+        {
+            if (node == NULL_NODE)
+            {
+                frames->count -= 2;
+                break;
+            }
+            // The frame moves on first, the statement may push frames above it. A single statement
+            // leaves an empty list that ends once they are done.
+            uint32_t at = frames->count - 2;
+            top[-2] = kind == FRAME_LIST ? NEXT_NODE(node) : NULL_NODE;
+            top[-1] = FRAME_LIST;
+            if (profiled && !interp->resuming)
+            {
+                enterProfile(node, frames->count);
+            }
+            if (!executeStatement(node))
+            {
+                // Waiting for a call, the statement runs again when it returns
+                frames->items[at] = node;
+                frames->items[at + 1] = kind;
+            }
+            break;
+        }
+
+        case FRAME_WHILE:
+            if (!evaluateValue(NODE(node, WhileRecord)->condition, &value))
+            {
+                break;
+            }
+            if (value)
+            {
+                if (profiled)
+                {
+                    countIteration(node);
+                }
+                pushFrame(NODE(node, WhileRecord)->body, FRAME_LIST);
+            }
+            else
+            {
+                frames->count -= 2;
+            }
+            break;
+
+        case FRAME_FOR_STEP:
+            if (evaluateAssignment(NODE(node, ForRecord)->increment))
+            {
+                top[-1] = FRAME_FOR;
+            }
+            break;
+
+        case FRAME_FOR:
+            if (!evaluateValue(NODE(node, ForRecord)->condition, &value))
+            {
+                break;
+            }
+            if (value)
+            {
+                if (profiled)
+                {
+                    countIteration(node);
+                }
+                top[-1] = FRAME_FOR_STEP;
+                pushFrame(NODE(node, ForRecord)->body, FRAME_LIST);
+            }
+            else
+            {
+                frames->count -= 2;
+            }
+            break;
+
+        case FRAME_COUNTED_STEP:
+            top[-1] = FRAME_COUNTED;
+            top[-4] = top[-4] + (uint32_t)NODE(node, ForRecord)->step;
+            break;
+
+        case FRAME_COUNTED:
         {
-            if (entry->type == TYPE_INT)
+            ForRecord *record = NODE(node, ForRecord);
+            InternId name = NODE(record->init, AssignmentRecord)->name;
+            int value = (int)top[-4];
+            if (compareCounted(NODE(record->condition, BinaryOpRecord)->header.tokenType, value, (int)top[-3]))
             {
-                printf("%d\n", entry->intValue);
+                if (record->header.flags & FOR_OBSERVED)
+                {
+                    assignVariableIntHashed(internedText(name), internedHash(name), TYPE_INT, value);
+                }
+                if (profiled)
+                {
+                    countIteration(node);
+                }
+                top[-1] = FRAME_COUNTED_STEP;
+                pushFrame(record->body, FRAME_LIST);
             }
             else
             {
-                printf("%s\n", entry->charValue);
+                assignVariableIntHashed(internedText(name), internedHash(name), TYPE_INT, value);
+                frames->count -= 4;
             }
+            break;
+        }
+
+        case FRAME_EACH:
+        {
+            ForEachRecord *record = NODE(node, ForEachRecord);
+            if (nextElement(record->container, record->variable, &top[-3]))
+            {
+                if (profiled)
+                {
+                    countIteration(node);
+                }
+                pushFrame(record->body, FRAME_LIST);
+            }
+            else
+            {
+                frames->count -= 3;
+            }
+            break;
+        }
+
+        case FRAME_RETURN:
+            // Back in the caller, its step runs again and finds the result on the value stack
+            interp->localStack.count = node;
+            interp->callBase = top[-3];
+            interp->localBase = top[-4];
+            interp->resumeBase = top[-5];
+            interp->resuming = 1;
+            frames->count -= 5;
+            pushWork(&interp->valueStack, (uint32_t)interp->returnValue);
+            interp->returnValue = 0;
+            break;
+        }
+
+        if (profiled)
+        {
+            leaveProfiles(frames->count);
         }
-        return 0;
     }
+}
 
-    default:
+static void runFrames(uint32_t base)
+{
+    if (useProfiler)
     {
-        printf("Runtime Error: Unknown AST node type '%d'\n", node->nodeType);
-        exit(1);
+        runFramesWith(base, 1);
     }
+    else
+    {
+        runFramesWith(base, 0);
     }
+}
 
-    // Evaluate the next statement unless, it's a loop
-    if (node->nodeType != WhileNode && node->nodeType != ForNode && node->next != NULL)
+// Evaluate a statement list in order
+void evaluateBlock(NodeRef node)
+{
+    interp->localStack.count = 0;
+    interp->localBase = 0;
+    for (uint32_t slots = topLevelSlots(node); slots > 0; slots--)
     {
-        evaluateAST(node->next);
+        pushWork(&interp->localStack, 0);
     }
-
-    return 0;
+    uint32_t base = interp->frameStack.count;
+    pushFrame(node, FRAME_LIST);
+    runFrames(base);
 }
 
-int lookupVariable(const char *name)
+// Value of an expression, statements run and return 0
+int evaluateAST(NodeRef node)
 {
-    for (int i = 0; i < symbolCount; i++)
+    if (node == NULL_NODE)
     {
-        if (strcmp(symbolTable[i].identifier, name) == 0)
+        return 0;
+    }
+
+    switch (NODE_TYPE(node))
+    {
+    case NumberNode:
+    case IdentifierNode:
+    case CharLiteralNode:
+    case BinaryOpNode:
+    case IndexNode:
+    case ArrayCallNode:
+    case CallNode:
+    case LocalNode:
+    {
+        // A call runs its body on the frame stack, then the evaluation goes on where it stopped
+        uint32_t base = interp->frameStack.count;
+        int value;
+        while (!evaluateValue(node, &value))
         {
-            if (symbolTable[i].type != TYPE_INT)
-            {
-                printf("Type Error: Variable '%s' is not of type int\n", name);
-                exit(1);
-            }
-            return symbolTable[i].intValue;
+            runFrames(base);
         }
+        return value;
+    }
+
+    default:
+    {
+        uint32_t base = interp->frameStack.count;
+        pushFrame(node, FRAME_SINGLE);
+        runFrames(base);
+        return 0;
+    }
     }
-    printf("Runtime Error: Undefined variable '%s'\n", name);
-    exit(1);
 }
 
-void freeAST(ASTNode *node)
+// Print a variable according to its type, unknown variables print nothing
+void printVariable(const char *name)
 {
-    if (node == NULL)
-        return;
-
-    freeAST(node->left);
-    freeAST(node->right);
-    freeAST(node->condition);
-    freeAST(node->thenBranch);
-    freeAST(node->elseBranch);
-    freeAST(node->body);
-    freeAST(node->init);
-    freeAST(node->increment);
-    freeAST(node->next);
-
-    free(node);
-}
\ No newline at end of file
+    SymbolTableEntry *entry = lookupSymbol(name);
+    if (entry != NULL)
+    {
+        if (entry->type == TYPE_INT)
+        {
+            printInt(entry->intValue);
+        }
+        else if (entry->type == TYPE_ARRAY)
+        {
+            writeArray(&entry->arrayValue);
+            writeText("\n", 1);
+        }
+        else if (entry->type == TYPE_DICT)
+        {
+            writeDict(entry->dictValue);
+            writeText("\n", 1);
+        }
+        else
+        {
+            writeText(stringText(&entry->stringValue), entry->stringValue.length);
+            writeText("\n", 1);
+        }
+    }
+}
@@ -1,76 +1,35 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include "ast.h"
 #include "lexer.h"
+#include "symtab.h"
 
-typedef enum
-{
-    TYPE_INT,
-    TYPE_CHAR
-} VariableType;
-
-// Types of AST nodes
-typedef enum
-{
-    NumberNode,
-    IdentifierNode,
-    BinaryOpNode,
-    AssignmentNode,
-    PrintNode,
-    IfNode,
-    ForNode,
-    WhileNode,
-    BlockNode,
-    CharLiteralNode,
-} ASTNodeType;
-
-// Structure of an AST node
-typedef struct ASTNode
-{
-    ASTNodeType nodeType; // Type of AST node
-    TokenType tokenType;  // For operators
-    VariableType varType;
-    int value;            // For numbers
-    char identifier[256]; // For variables
-    char charValue;
-    char *stringValue;
-    struct ASTNode *left;
-    struct ASTNode *right;
-    struct ASTNode *condition;
-    struct ASTNode *thenBranch;
-    struct ASTNode *elseBranch;
-    struct ASTNode *body;      // For loops
-    struct ASTNode *init;      // 'for' loop
-    struct ASTNode *increment; // 'for' loop
-    struct ASTNode *next;
-} ASTNode;
+// + of string literals and char variables, the parser types it TYPE_CHAR
+#define IS_CONCATENATION(ref) \
+    (NODE_TYPE(ref) == BinaryOpNode && NODE(ref, BinaryOpRecord)->header.varType == TYPE_CHAR)
 
 // Parser functions
-ASTNode *parseProgram();
-void freeAST(ASTNode *node);
-int evaluateAST(ASTNode *node);
-void evaluateProgram(ASTNode *node);
-
-// Assign Variable
-void assignVariableString(const char *name, VariableType type, const char *value);
-void assignVariableInt(const char *name, VariableType type, int intValue);
-
-// Symbol table
-typedef struct
-{
-    char identifier[256];
-    VariableType type;
-
-    union
-    {
-        int intValue;
-        char charValue[256];
-        float floatValue;
-    };
-} SymbolTableEntry;
-
-SymbolTableEntry *lookupSymbol(const char *name);
-extern SymbolTableEntry symbolTable[100];
-extern int symbolCount;
+NodeRef parseProgram();
+void beginParse();
+NodeRef parseTopLevelStatement();
+NodeRef createBinaryOp(TokenType op, NodeRef left, NodeRef right);
+NodeRef createCharLiteral(const char *text, size_t length);
+int evaluateAST(NodeRef node);
+void evaluateBlock(NodeRef node);
+void evaluateProgram(NodeRef node);
+void executeProgram(NodeRef node);
+void streamProgram();
+uint32_t topLevelSlots(NodeRef program);
+
+// Evaluate with evaluateAST instead of compiling to bytecode
+extern int useTreeWalker;
+
+// Parse, run and free one top-level statement at a time
+extern int streamStatements;
+
+void printVariable(const char *name);
+void assignStringExpression(InternId name, NodeRef value);
+void joinStringExpression(NodeRef value, StringValue *result);
 
 #endif
\ No newline at end of file
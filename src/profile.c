@@ -0,0 +1,228 @@
+#include "profile.h"
+#include "trace.h"
+#include "interpreter.h"
+#include <stdlib.h>
+#include <string.h>
+
+int useProfiler = 0;
+
+// Entries outlive the arena, a program run from the REPL keeps its statistics
+static ProfileEntry *entries;
+static uint32_t entryCount = 0;
+static uint32_t entryCapacity = 0;
+
+// Entry of each statement node plus one, 0 when the node is not profiled
+static uint32_t *entryOf;
+static uint32_t entryOfCapacity = 0;
+
+// Statements started and not finished yet, innermost on top
+typedef struct
+{
+    uint32_t entry;
+    uint32_t depth;      // Frame stack size when the statement started
+    uint64_t start;
+    uint64_t childTime;  // Total time of the statements nested in it
+} OpenStatement;
+
+static OpenStatement *openStack;
+static uint32_t openCount = 0;
+static uint32_t openCapacity = 0;
+
+static void *growArray(void *array, uint32_t *capacity, uint32_t needed, size_t size)
+{
+    uint32_t newCapacity = *capacity == 0 ? 256 : *capacity;
+    while (newCapacity < needed)
+    {
+        newCapacity *= 2;
+    }
+    array = realloc(array, newCapacity * size);
+    if (array == NULL)
+    {
+        printf("Profile Error: Out of memory\n");
+        exit(1);
+    }
+    *capacity = newCapacity;
+    return array;
+}
+
+// Node references are reused once the arena is freed
+void resetProfileNodes()
+{
+    if (entryOf != NULL)
+    {
+        memset(entryOf, 0, entryOfCapacity * sizeof(uint32_t));
+    }
+}
+
+void profileStatement(NodeRef node, uint32_t line, uint32_t column)
+{
+    if (node >= entryOfCapacity)
+    {
+        uint32_t oldCapacity = entryOfCapacity;
+        entryOf = growArray(entryOf, &entryOfCapacity, node + 1, sizeof(uint32_t));
+        memset(entryOf + oldCapacity, 0, (entryOfCapacity - oldCapacity) * sizeof(uint32_t));
+    }
+    if (entryCount == entryCapacity)
+    {
+        entries = growArray(entries, &entryCapacity, entryCount + 1, sizeof(ProfileEntry));
+    }
+    ProfileEntry *entry = &entries[entryCount];
+    memset(entry, 0, sizeof(ProfileEntry));
+    entry->line = line;
+    entry->column = column;
+    entry->nodeType = NODE_TYPE(node);
+    entryOf[node] = ++entryCount;
+}
+
+static uint32_t lookupEntry(NodeRef node)
+{
+    return node < entryOfCapacity ? entryOf[node] : 0;
+}
+
+// The statement ends once the frame stack is back to depth
+void enterProfile(NodeRef node, uint32_t depth)
+{
+    uint32_t entry = lookupEntry(node);
+    if (entry == 0)
+    {
+        return;
+    }
+    if (openCount == openCapacity)
+    {
+        openStack = growArray(openStack, &openCapacity, openCount + 1, sizeof(OpenStatement));
+    }
+    entries[entry - 1].count++;
+    OpenStatement *open = &openStack[openCount++];
+    open->entry = entry;
+    open->depth = depth;
+    open->childTime = 0;
+    open->start = readTimestamp();
+}
+
+// Finish the statements whose frames are gone
+void leaveProfiles(uint32_t depth)
+{
+    while (openCount > 0 && openStack[openCount - 1].depth >= depth)
+    {
+        OpenStatement *open = &openStack[--openCount];
+        uint64_t total = readTimestamp() - open->start;
+        ProfileEntry *entry = &entries[open->entry - 1];
+        entry->totalTime += total;
+        entry->selfTime += total - open->childTime;
+        if (openCount > 0)
+        {
+            openStack[openCount - 1].childTime += total;
+        }
+    }
+}
+
+void countIteration(NodeRef node)
+{
+    uint32_t entry = lookupEntry(node);
+    if (entry != 0)
+    {
+        entries[entry - 1].iterations++;
+    }
+}
+
+static const char *statementName(uint8_t nodeType)
+{
+    switch (nodeType)
+    {
+    case AssignmentNode:
+        return "assignment";
+    case PrintNode:
+        return "print";
+    case FlushNode:
+        return "flush";
+    case IndexAssignNode:
+        return "element";
+    case ArrayOpNode:
+        return "array";
+    case IfNode:
+        return "if";
+    case ForNode:
+    case ForEachNode:
+        return "for";
+    case WhileNode:
+        return "while";
+    case FunctionNode:
+        return "function";
+    case CallNode:
+        return "call";
+    case ReturnNode:
+        return "return";
+    case LocalAssignNode:
+        return "assignment";
+    default:
+        return "statement";
+    }
+}
+
+static int compareSelf(const void *a, const void *b)
+{
+    uint64_t left = entries[*(const uint32_t *)a].selfTime;
+    uint64_t right = entries[*(const uint32_t *)b].selfTime;
+    return left < right ? 1 : left > right ? -1 : 0;
+}
+
+static int compareTotal(const void *a, const void *b)
+{
+    uint64_t left = entries[*(const uint32_t *)a].totalTime;
+    uint64_t right = entries[*(const uint32_t *)b].totalTime;
+    return left < right ? 1 : left > right ? -1 : 0;
+}
+
+#define PROFILE_ROWS 20
+
+static void printRanking(FILE *out, const char *title, uint32_t *order, uint64_t allTime)
+{
+    uint32_t rows = entryCount < PROFILE_ROWS ? entryCount : PROFILE_ROWS;
+    fprintf(out, "\n%s\n", title);
+    fprintf(out, "%-12s %-10s %12s %12s %16s %7s %16s %7s\n",
+            "line:col", "statement", "count", "iterations", "self", "self%", "total", "total%");
+    for (uint32_t i = 0; i < rows; i++)
+    {
+        ProfileEntry *entry = &entries[order[i]];
+        if (entry->count == 0)
+        {
+            break;
+        }
+        char position[32];
+        snprintf(position, sizeof(position), "%u:%u", entry->line, entry->column);
+        fprintf(out, "%-12s %-10s %12llu %12llu %16llu %6.2f%% %16llu %6.2f%%\n",
+                position, statementName(entry->nodeType),
+                (unsigned long long)entry->count, (unsigned long long)entry->iterations,
+                (unsigned long long)entry->selfTime, allTime ? 100.0 * entry->selfTime / allTime : 0.0,
+                (unsigned long long)entry->totalTime, allTime ? 100.0 * entry->totalTime / allTime : 0.0);
+    }
+}
+
+// Statements ranked by self time then by total time
+void printProfile(FILE *out)
+{
+    uint64_t allTime = 0;
+    uint32_t *order = malloc((entryCount + 1) * sizeof(uint32_t));
+    if (order == NULL)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < entryCount; i++)
+    {
+        order[i] = i;
+        allTime += entries[i].selfTime;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    const char *unit = "cycles";
+#else
+    const char *unit = "nanoseconds";
+#endif
+    fprintf(out, "\nProfile: %u statements, %llu %s\n", entryCount, (unsigned long long)allTime, unit);
+
+    qsort(order, entryCount, sizeof(uint32_t), compareSelf);
+    printRanking(out, "By self time", order, allTime);
+    qsort(order, entryCount, sizeof(uint32_t), compareTotal);
+    printRanking(out, "By total time", order, allTime);
+    free(order);
+}
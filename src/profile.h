@@ -0,0 +1,31 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "ast.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Count and time every statement run by the tree walker, set with --profile
+extern int useProfiler;
+
+// Statistics of one statement of the source
+typedef struct
+{
+    uint32_t line;
+    uint32_t column;
+    uint8_t nodeType;
+    uint64_t count;       // Times the statement ran
+    uint64_t iterations;  // Loop bodies entered
+    uint64_t selfTime;    // Spent outside the statements nested in it
+    uint64_t totalTime;   // Spent from the start of the statement to its end
+} ProfileEntry;
+
+// Profiler functions, only called when useProfiler is set
+void resetProfileNodes();
+void profileStatement(NodeRef node, uint32_t line, uint32_t column);
+void enterProfile(NodeRef node, uint32_t depth);
+void leaveProfiles(uint32_t depth);
+void countIteration(NodeRef node);
+void printProfile(FILE *out);
+
+#endif
@@ -0,0 +1,161 @@
+#include "program.h"
+#include "optimizer.h"
+#include "vm.h"
+#include "jit.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The tree is kept for the tree walker and the JIT, the VM only needs the chunk.
+// String constants of the chunk point into the arena, so both live as long as the program.
+struct Program
+{
+    ASTArena arena;
+    NodeRef root;
+    Chunk chunk; // Empty unless the program runs on the VM
+};
+
+typedef struct
+{
+    const char *buffer;
+    size_t length;
+    Program *program;
+} Compilation;
+
+static void compileSource(void *context)
+{
+    Compilation *compilation = context;
+    Program *program = compilation->program;
+    uint32_t removed;
+
+    setInputBuffer(compilation->buffer, compilation->length);
+    program->root = parseProgram();
+    if (useOptimizer)
+    {
+        program->root = optimizeProgram(program->root, &removed);
+    }
+    if (!useTreeWalker && !useJit)
+    {
+        compileProgram(program->root, &program->chunk);
+    }
+
+    // The program takes the nodes, the interpreter starts a new arena
+    program->arena = interp->arena;
+    memset(&interp->arena, 0, sizeof(ASTArena));
+}
+
+// Parse, optimize and compile with the engine options, NULL when the script has an error
+Program *compileScript(Interpreter *interpreter, const char *buffer, size_t length)
+{
+    Program *program = calloc(1, sizeof(Program));
+    if (program == NULL)
+    {
+        fprintf(interpreter->out, "Compiler Error: Out of memory\n");
+        return NULL;
+    }
+    initChunk(&program->chunk);
+
+    Compilation compilation = {buffer, length, program};
+    if (guardInterpreter(interpreter, compileSource, &compilation) != 0)
+    {
+        freeProgram(program);
+        return NULL;
+    }
+    return program;
+}
+
+static void runCompiled(void *context)
+{
+    Program *program = context;
+    TRACE(TRACE_EVAL, TRACE_INFO, EV_EVAL_BEGIN, program->chunk.count == 0 && !useJit, 0, 0);
+    if (program->chunk.count > 0)
+    {
+        runChunk(&program->chunk);
+    }
+    else if (useJit)
+    {
+        resetChunk(&interp->chunk);
+        runJitProgram(program->root, &interp->chunk);
+    }
+    else
+    {
+        evaluateBlock(program->root);
+    }
+    TRACE(TRACE_EVAL, TRACE_INFO, EV_EVAL_END, 0, 0, 0);
+}
+
+// Run against the current variables, 1 when the run failed
+int runProgram(Interpreter *interpreter, Program *program)
+{
+    // The nodes are lent to the interpreter for the run, its own arena is put back after
+    ASTArena scratch = interpreter->arena;
+    interpreter->arena = program->arena;
+    int failed = guardInterpreter(interpreter, runCompiled, program);
+    interpreter->arena = scratch;
+    return failed;
+}
+
+void freeProgram(Program *program)
+{
+    if (program == NULL)
+    {
+        return;
+    }
+    free(program->arena.words);
+    freeChunk(&program->chunk);
+    free(program);
+}
+
+// The symbol table functions work on the bound interpreter
+static Interpreter *bindInterpreter(Interpreter *interpreter)
+{
+    Interpreter *previous = interp;
+    interp = interpreter;
+    return previous;
+}
+
+void bindInt(Interpreter *interpreter, const char *name, int value)
+{
+    Interpreter *previous = bindInterpreter(interpreter);
+    assignVariableInt(name, TYPE_INT, value);
+    interp = previous;
+}
+
+// The text is copied
+void bindString(Interpreter *interpreter, const char *name, const char *value)
+{
+    Interpreter *previous = bindInterpreter(interpreter);
+    assignVariableString(name, TYPE_CHAR, value);
+    interp = previous;
+}
+
+// 0 when name holds an int, stored in value
+int readInt(Interpreter *interpreter, const char *name, int *value)
+{
+    Interpreter *previous = bindInterpreter(interpreter);
+    SymbolTableEntry *entry = lookupSymbol(name);
+    interp = previous;
+    if (entry == NULL || entry->type != TYPE_INT)
+    {
+        return 1;
+    }
+    *value = entry->intValue;
+    return 0;
+}
+
+// Text of a char variable, NULL for an int or a missing variable.
+// The text is owned by the interpreter and valid until the next assignment.
+const char *readString(Interpreter *interpreter, const char *name)
+{
+    Interpreter *previous = bindInterpreter(interpreter);
+    SymbolTableEntry *entry = lookupSymbol(name);
+    interp = previous;
+    return entry != NULL && entry->type == TYPE_CHAR ? stringText(&entry->stringValue) : NULL;
+}
+
+// Forget every variable, so that a run does not see the results of the previous one
+void clearVariables(Interpreter *interpreter)
+{
+    Interpreter *previous = bindInterpreter(interpreter);
+    freeSymbolTable();
+    interp = previous;
+}
@@ -0,0 +1,22 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include "interpreter.h"
+
+// Script parsed, optimized and compiled once, then run any number of times.
+// Names are interned by the interpreter that compiled it, the program only runs on that interpreter.
+typedef struct Program Program;
+
+// Program functions
+Program *compileScript(Interpreter *interpreter, const char *buffer, size_t length);
+int runProgram(Interpreter *interpreter, Program *program);
+void freeProgram(Program *program);
+
+// Variables set before a run and read back after it
+void bindInt(Interpreter *interpreter, const char *name, int value);
+void bindString(Interpreter *interpreter, const char *name, const char *value);
+int readInt(Interpreter *interpreter, const char *name, int *value);
+const char *readString(Interpreter *interpreter, const char *name);
+void clearVariables(Interpreter *interpreter);
+
+#endif
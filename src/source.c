@@ -0,0 +1,125 @@
+#include "source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// First read size for pipes and terminals, doubled while the input keeps coming
+#define STREAM_CHUNK (1u << 20)
+
+// The lexer stores offsets on 32 bits
+#define MAX_SOURCE_LENGTH UINT32_MAX
+
+// Read a non-seekable descriptor with large reads into one growing buffer
+int loadSourceStream(int fd, SourceBuffer *source)
+{
+    size_t capacity = STREAM_CHUNK;
+    size_t length = 0;
+    char *buffer = malloc(capacity);
+
+    while (buffer != NULL)
+    {
+        if (length == capacity)
+        {
+            capacity *= 2;
+            char *grown = realloc(buffer, capacity);
+            if (grown == NULL)
+            {
+                break;
+            }
+            buffer = grown;
+        }
+
+        ssize_t count = read(fd, buffer + length, capacity - length);
+        if (count == 0)
+        {
+            source->data = buffer;
+            source->length = length;
+            source->mapped = 0;
+            return 0;
+        }
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Erreur lors de la lecture du fichier");
+            free(buffer);
+            return -1;
+        }
+        length += (size_t)count;
+        if (length > MAX_SOURCE_LENGTH)
+        {
+            printf("Input Error: Source larger than 4 GB\n");
+            free(buffer);
+            return -1;
+        }
+    }
+
+    printf("Input Error: Out of memory\n");
+    free(buffer);
+    return -1;
+}
+
+// Map a regular file read-only, anything else goes through loadSourceStream
+int loadSourceFile(const char *fileName, SourceBuffer *source)
+{
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Erreur lors de l'ouverture du fichier");
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+    {
+        int result = loadSourceStream(fd, source);
+        close(fd);
+        return result;
+    }
+    if ((uint64_t)info.st_size > MAX_SOURCE_LENGTH)
+    {
+        printf("Input Error: Source larger than 4 GB\n");
+        close(fd);
+        return -1;
+    }
+
+    void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        int result = loadSourceStream(fd, source);
+        close(fd);
+        return result;
+    }
+    close(fd); // The mapping keeps the file alive
+
+    // The lexer reads front to back once, let the kernel read ahead and drop pages behind
+    madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+    madvise(data, (size_t)info.st_size, MADV_WILLNEED);
+
+    source->data = data;
+    source->length = (size_t)info.st_size;
+    source->mapped = 1;
+    return 0;
+}
+
+void releaseSource(SourceBuffer *source)
+{
+    if (source->mapped)
+    {
+        munmap((void *)source->data, source->length);
+    }
+    else
+    {
+        free((void *)source->data);
+    }
+    source->data = NULL;
+    source->length = 0;
+    source->mapped = 0;
+}
@@ -0,0 +1,19 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+
+// Bytes of a script, either mapped from the file or read into the heap
+typedef struct
+{
+    const char *data;
+    size_t length;
+    int mapped;
+} SourceBuffer;
+
+// Source functions
+int loadSourceFile(const char *fileName, SourceBuffer *source);
+int loadSourceStream(int fd, SourceBuffer *source);
+void releaseSource(SourceBuffer *source);
+
+#endif
@@ -0,0 +1,101 @@
+#include "stringval.h"
+#include "interpreter.h"
+#include "output.h"
+#include <stdlib.h>
+#include <string.h>
+
+static StringBuffer *allocBuffer(StringBuffer *buffer, size_t capacity)
+{
+    buffer = realloc(buffer, sizeof(StringBuffer) + capacity);
+    if (buffer == NULL)
+    {
+        reportError("Runtime Error: Out of memory\n");
+        failInterpreter();
+    }
+    buffer->capacity = (uint32_t)capacity;
+    return buffer;
+}
+
+static void checkLength(size_t length)
+{
+    if (length >= UINT32_MAX)
+    {
+        reportError("Runtime Error: String longer than 4 GB\n");
+        failInterpreter();
+    }
+}
+
+// Copy length bytes of text into a new value
+void makeString(StringValue *string, const char *text, size_t length)
+{
+    checkLength(length);
+    string->length = (uint32_t)length;
+    if (length <= STRING_INLINE)
+    {
+        memcpy(string->small, text, length);
+        string->small[length] = '\0';
+        return;
+    }
+    string->buffer = allocBuffer(NULL, length + 1);
+    string->buffer->refCount = 1;
+    memcpy(string->buffer->text, text, length);
+    string->buffer->text[length] = '\0';
+}
+
+// Make target a new value equal to source, without copying the text of long strings
+void shareString(StringValue *target, const StringValue *source)
+{
+    *target = *source;
+    if (source->length > STRING_INLINE)
+    {
+        source->buffer->refCount++;
+    }
+}
+
+// Add text at the end. A buffer held only by this value grows in place, doubling its capacity
+// so that a string built piece by piece is copied a constant number of times on average.
+// A shared buffer is left to its other holders and the value gets a copy.
+void appendString(StringValue *string, const char *text, size_t length)
+{
+    size_t total = (size_t)string->length + length;
+    checkLength(total);
+
+    if (total <= STRING_INLINE)
+    {
+        memcpy(string->small + string->length, text, length);
+        string->small[total] = '\0';
+    }
+    else if (string->length > STRING_INLINE && string->buffer->refCount == 1)
+    {
+        StringBuffer *buffer = string->buffer;
+        if (total + 1 > buffer->capacity)
+        {
+            size_t capacity = (size_t)buffer->capacity * 2;
+            buffer = allocBuffer(buffer, capacity > total + 1 ? capacity : total + 1);
+        }
+        memcpy(buffer->text + string->length, text, length);
+        buffer->text[total] = '\0';
+        string->buffer = buffer;
+    }
+    else
+    {
+        StringBuffer *buffer = allocBuffer(NULL, total + 1);
+        buffer->refCount = 1;
+        memcpy(buffer->text, stringText(string), string->length);
+        memcpy(buffer->text + string->length, text, length);
+        buffer->text[total] = '\0';
+        releaseString(string);
+        string->buffer = buffer;
+    }
+    string->length = (uint32_t)total;
+}
+
+void releaseString(StringValue *string)
+{
+    if (string->length > STRING_INLINE && --string->buffer->refCount == 0)
+    {
+        free(string->buffer);
+    }
+    string->length = 0;
+    string->small[0] = '\0';
+}
@@ -0,0 +1,40 @@
+#ifndef STRINGVAL_H
+#define STRINGVAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Strings up to STRING_INLINE bytes are stored in the value itself, without allocation
+#define STRING_INLINE 15
+
+// Text of a longer string. It is shared by every value holding it and never changes while shared.
+typedef struct
+{
+    uint32_t refCount;
+    uint32_t capacity; // Bytes of text, the null terminator included
+    char text[];
+} StringBuffer;
+
+// Value of a char variable, copying it shares the buffer
+typedef struct
+{
+    uint32_t length;
+    union
+    {
+        char small[STRING_INLINE + 1]; // length <= STRING_INLINE, null terminated
+        StringBuffer *buffer;          // Longer strings
+    };
+} StringValue;
+
+static inline const char *stringText(const StringValue *string)
+{
+    return string->length <= STRING_INLINE ? string->small : string->buffer->text;
+}
+
+// String functions
+void makeString(StringValue *string, const char *text, size_t length);
+void shareString(StringValue *target, const StringValue *source);
+void appendString(StringValue *string, const char *text, size_t length);
+void releaseString(StringValue *string);
+
+#endif
@@ -0,0 +1,229 @@
+#include "symtab.h"
+#include "intern.h"
+#include "interpreter.h"
+#include "output.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Hash of a variable name, identical to the hash kept by the interner
+uint32_t hashName(const char *name)
+{
+    return hashBytes(name, strlen(name));
+}
+
+static void *allocOrDie(void *pointer)
+{
+    if (pointer == NULL)
+    {
+        reportError("Runtime Error: Out of memory\n");
+        failInterpreter();
+    }
+    return pointer;
+}
+
+// Rebuild the index with twice as many slots, entries do not move
+static void growSlots(SymbolTable *table)
+{
+    uint32_t slotCount = table->slots == NULL ? 64 : (table->slotMask + 1) * 2;
+    SymbolSlot *slots = allocOrDie(calloc(slotCount, sizeof(SymbolSlot)));
+    uint32_t mask = slotCount - 1;
+
+    for (int i = 0; i < table->count; i++)
+    {
+        uint32_t slot = table->entries[i].hash & mask;
+        while (slots[slot].index != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot].hash = table->entries[i].hash;
+        slots[slot].index = i + 1;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->slotMask = mask;
+}
+
+// Find the slot holding name, or the empty slot where it would be inserted
+static inline SymbolSlot *findSlot(SymbolTable *table, const char *name, uint32_t hash)
+{
+    uint32_t slot = hash & table->slotMask;
+    while (1)
+    {
+        SymbolSlot *candidate = &table->slots[slot];
+        if (candidate->index == 0)
+        {
+            return candidate;
+        }
+        if (candidate->hash == hash &&
+            strcmp(table->entries[candidate->index - 1].identifier, name) == 0)
+        {
+            return candidate;
+        }
+        slot = (slot + 1) & table->slotMask;
+    }
+}
+
+SymbolTableEntry *lookupSymbolHashed(const char *name, uint32_t hash)
+{
+    SymbolTable *table = &interp->symbols;
+    if (table->count == 0)
+    {
+        return NULL;
+    }
+    SymbolSlot *slot = findSlot(table, name, hash);
+    return slot->index == 0 ? NULL : &table->entries[slot->index - 1];
+}
+
+// Look up a symbol in the symbol table
+SymbolTableEntry *lookupSymbol(const char *name)
+{
+    return lookupSymbolHashed(name, hashName(name));
+}
+
+// Free the string, the items or the dict held by an entry before it gets another value
+static void releaseValue(SymbolTableEntry *entry)
+{
+    if (entry->type == TYPE_CHAR)
+    {
+        releaseString(&entry->stringValue);
+    }
+    else if (entry->type == TYPE_ARRAY)
+    {
+        freeArray(&entry->arrayValue);
+    }
+    else if (entry->type == TYPE_DICT)
+    {
+        freeDict(entry->dictValue);
+    }
+}
+
+// Return the entry for name, creating it when missing
+static SymbolTableEntry *defineSymbol(const char *name, uint32_t hash)
+{
+    SymbolTable *table = &interp->symbols;
+    // Keep the load factor under 1/2 so probe sequences stay short
+    if (table->slots == NULL || (uint32_t)(table->count + 1) * 2 > table->slotMask + 1)
+    {
+        growSlots(table);
+    }
+
+    SymbolSlot *slot = findSlot(table, name, hash);
+    if (slot->index != 0)
+    {
+        return &table->entries[slot->index - 1];
+    }
+
+    if (table->count == table->capacity)
+    {
+        table->capacity = table->capacity == 0 ? 32 : table->capacity * 2;
+        table->entries = allocOrDie(realloc(table->entries, table->capacity * sizeof(SymbolTableEntry)));
+    }
+
+    SymbolTableEntry *entry = &table->entries[table->count];
+    entry->identifier = allocOrDie(strdup(name));
+    entry->hash = hash;
+    entry->type = TYPE_INT;
+    entry->intValue = 0;
+    slot->hash = hash;
+    slot->index = ++table->count;
+    return entry;
+}
+
+int lookupVariableHashed(const char *name, uint32_t hash)
+{
+    SymbolTableEntry *entry = lookupSymbolHashed(name, hash);
+    if (entry == NULL)
+    {
+        reportError("Runtime Error: Undefined variable '%s'\n", name);
+        failInterpreter();
+    }
+    if (entry->type != TYPE_INT)
+    {
+        reportError("Type Error: Variable '%s' is not of type int\n", name);
+        failInterpreter();
+    }
+    return entry->intValue;
+}
+
+int lookupVariable(const char *name)
+{
+    return lookupVariableHashed(name, hashName(name));
+}
+
+void assignVariableIntHashed(const char *name, uint32_t hash, VariableType type, int intValue)
+{
+    SymbolTableEntry *entry = defineSymbol(name, hash);
+    releaseValue(entry);
+    entry->type = type;
+    entry->intValue = intValue;
+}
+
+// Assignation for int
+void assignVariableInt(const char *name, VariableType type, int intValue)
+{
+    assignVariableIntHashed(name, hashName(name), type, intValue);
+}
+
+// The text is copied, strings up to STRING_INLINE bytes without allocating
+void assignVariableStringHashed(const char *name, uint32_t hash, VariableType type, const char *value)
+{
+    StringValue string;
+    makeString(&string, value, strlen(value));
+    SymbolTableEntry *entry = defineSymbol(name, hash);
+    releaseValue(entry);
+    entry->type = type;
+    entry->stringValue = string;
+}
+
+// The variable takes over value, which is left empty
+void assignVariableValueHashed(const char *name, uint32_t hash, StringValue *value)
+{
+    SymbolTableEntry *entry = defineSymbol(name, hash);
+    releaseValue(entry);
+    entry->type = TYPE_CHAR;
+    entry->stringValue = *value;
+    value->length = 0;
+    value->small[0] = '\0';
+}
+
+// The variable takes over the items of value, which is left empty
+void assignVariableArrayHashed(const char *name, uint32_t hash, IntArray *value)
+{
+    SymbolTableEntry *entry = defineSymbol(name, hash);
+    releaseValue(entry);
+    entry->type = TYPE_ARRAY;
+    entry->arrayValue = *value;
+    value->items = NULL;
+    value->length = 0;
+    value->capacity = 0;
+}
+
+// The variable takes over value
+void assignVariableDictHashed(const char *name, uint32_t hash, Dict *value)
+{
+    SymbolTableEntry *entry = defineSymbol(name, hash);
+    releaseValue(entry);
+    entry->type = TYPE_DICT;
+    entry->dictValue = value;
+}
+
+//  Assignation for string
+void assignVariableString(const char *name, VariableType type, const char *value)
+{
+    assignVariableStringHashed(name, hashName(name), type, value);
+}
+
+void freeSymbolTable()
+{
+    SymbolTable *table = &interp->symbols;
+    for (int i = 0; i < table->count; i++)
+    {
+        releaseValue(&table->entries[i]);
+        free(table->entries[i].identifier);
+    }
+    free(table->entries);
+    free(table->slots);
+    memset(table, 0, sizeof(SymbolTable));
+}
@@ -0,0 +1,66 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "array.h"
+#include "dict.h"
+#include "stringval.h"
+#include <stdint.h>
+
+typedef enum
+{
+    TYPE_INT,
+    TYPE_CHAR,
+    TYPE_ARRAY,
+    TYPE_DICT
+} VariableType;
+
+// Symbol table entry, the name lives on the heap
+typedef struct
+{
+    char *identifier;
+    uint32_t hash; // Hash of identifier
+    VariableType type;
+
+    union
+    {
+        int intValue;
+        StringValue stringValue;
+        IntArray arrayValue;
+        Dict *dictValue;
+        float floatValue;
+    };
+} SymbolTableEntry;
+
+// Probe slot of the hash index, index is the entry position + 1 (0 = empty)
+typedef struct
+{
+    uint32_t hash;
+    uint32_t index;
+} SymbolSlot;
+
+// Open addressing index over a dense array of entries
+typedef struct
+{
+    SymbolTableEntry *entries;
+    int count;
+    int capacity;
+    SymbolSlot *slots;
+    uint32_t slotMask; // Slot count - 1, the slot count is a power of two
+} SymbolTable;
+
+// Symbol table functions
+uint32_t hashName(const char *name);
+SymbolTableEntry *lookupSymbol(const char *name);
+SymbolTableEntry *lookupSymbolHashed(const char *name, uint32_t hash);
+int lookupVariable(const char *name);
+int lookupVariableHashed(const char *name, uint32_t hash);
+void assignVariableInt(const char *name, VariableType type, int intValue);
+void assignVariableIntHashed(const char *name, uint32_t hash, VariableType type, int intValue);
+void assignVariableString(const char *name, VariableType type, const char *value);
+void assignVariableStringHashed(const char *name, uint32_t hash, VariableType type, const char *value);
+void assignVariableValueHashed(const char *name, uint32_t hash, StringValue *value);
+void assignVariableArrayHashed(const char *name, uint32_t hash, IntArray *value);
+void assignVariableDictHashed(const char *name, uint32_t hash, Dict *value);
+void freeSymbolTable();
+
+#endif
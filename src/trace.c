@@ -0,0 +1,271 @@
+#include "trace.h"
+#include "interpreter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define DEFAULT_TRACE_CAPACITY (1u << 16)
+
+// Level of each subsystem, all off by default
+uint8_t traceLevels[TRACE_SUBSYSTEM_COUNT];
+
+// Ring buffer, the oldest events are overwritten once it is full
+static TraceRecord *traceBuffer = NULL;
+static uint32_t traceMask = 0;
+static uint64_t traceCount = 0;
+static uint32_t traceCapacity = DEFAULT_TRACE_CAPACITY;
+
+static const char *subsystemNames[TRACE_SUBSYSTEM_COUNT] = {
+    [TRACE_LEXER] = "lexer",
+    [TRACE_PARSER] = "parser",
+    [TRACE_OPTIMIZER] = "optimizer",
+    [TRACE_COMPILER] = "compiler",
+    [TRACE_VM] = "vm",
+    [TRACE_EVAL] = "eval",
+};
+
+static const char *ruleNames[] = {
+    [RULE_STATEMENT] = "a statement",
+    [RULE_IF] = "an if statement",
+    [RULE_ELSE_IF] = "else if clause",
+    [RULE_ELSE] = "else clause",
+    [RULE_FOR] = "a for statement",
+    [RULE_WHILE] = "a while statement",
+    [RULE_BLOCK] = "a block",
+    [RULE_PRINT] = "a print statement",
+    [RULE_FLUSH] = "a flush statement",
+    [RULE_EXPRESSION] = "an expression",
+    [RULE_FACTOR] = "a factor",
+    [RULE_ARRAY] = "an array literal",
+    [RULE_CALL] = "a function call",
+    [RULE_FUNCTION] = "a function declaration",
+    [RULE_RETURN] = "a return statement",
+};
+
+// Cycle counter where there is one, nanoseconds otherwise
+uint64_t readTimestamp()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Number of events kept, rounded up to a power of two
+void setTraceCapacity(uint32_t events)
+{
+    uint32_t capacity = 64;
+    while (capacity < events && capacity < (1u << 30))
+    {
+        capacity *= 2;
+    }
+    free(traceBuffer);
+    traceBuffer = NULL;
+    traceCount = 0;
+    traceCapacity = capacity;
+}
+
+void traceRecord(TraceSubsystem subsystem, TraceLevel level, TraceEvent event,
+                 uint32_t a, uint32_t b, uint32_t c)
+{
+    if (traceBuffer == NULL)
+    {
+        traceBuffer = malloc(traceCapacity * sizeof(TraceRecord));
+        if (traceBuffer == NULL)
+        {
+            memset(traceLevels, 0, sizeof(traceLevels));
+            return;
+        }
+        traceMask = traceCapacity - 1;
+    }
+
+    TraceRecord *record = &traceBuffer[traceCount++ & traceMask];
+    record->timestamp = readTimestamp();
+    record->event = (uint16_t)event;
+    record->subsystem = (uint8_t)subsystem;
+    record->level = (uint8_t)level;
+    record->args[0] = a;
+    record->args[1] = b;
+    record->args[2] = c;
+}
+
+// Name of an interned string, the trace may outlive the interpreter that recorded it
+static const char *tracedName(uint32_t id)
+{
+    return interp != NULL && id < interp->interner.count ? internedText(id) : "?";
+}
+
+static void formatRecord(FILE *out, const TraceRecord *record)
+{
+    const uint32_t *args = record->args;
+
+    switch (record->event)
+    {
+    case EV_LEX_TOKEN:
+        fprintf(out, "Recognized token of type %u at %u (%u bytes)", args[0], args[1], args[2]);
+        break;
+    case EV_PARSE_BEGIN:
+        fprintf(out, "Starting to parse program");
+        break;
+    case EV_PARSE_END:
+        fprintf(out, "Finished parsing program (%u arena words)", args[0]);
+        break;
+    case EV_PARSE_TOKEN:
+        fprintf(out, "Next token is of type %u at %u (%u bytes)", args[0], args[1], args[2]);
+        break;
+    case EV_PARSE_MATCH:
+        fprintf(out, "Matched token of type %u at %u (%u bytes)", args[0], args[1], args[2]);
+        break;
+    case EV_PARSE_RULE:
+        fprintf(out, "Parsing %s", args[0] < sizeof(ruleNames) / sizeof(ruleNames[0]) ? ruleNames[args[0]] : "?");
+        break;
+    case EV_PARSE_OPERATOR:
+        fprintf(out, "Parsing binary operator of type %u", args[0]);
+        break;
+    case EV_OPTIMIZE_END:
+        fprintf(out, "Removed %u nodes, %u left", args[0], args[1]);
+        break;
+    case EV_COMPILE_END:
+        fprintf(out, "Compiled %u words, stack depth %u", args[0], args[1]);
+        break;
+    case EV_COMPILE_OP:
+        fprintf(out, "%04u opcode %u operand %d", args[0], args[1], (int32_t)args[2]);
+        break;
+    case EV_JIT_LOOP:
+        if (args[1] == 0)
+        {
+            fprintf(out, "Loop at node %u left to the VM (%u variables)", args[0], args[2]);
+        }
+        else
+        {
+            fprintf(out, "Loop at node %u compiled to %u bytes of machine code (%u variables)", args[0], args[1], args[2]);
+        }
+        break;
+    case EV_VM_BEGIN:
+        fprintf(out, "Running %u words", args[0]);
+        break;
+    case EV_VM_OP:
+        fprintf(out, "%04u opcode %u", args[0], args[1]);
+        break;
+    case EV_VM_END:
+        fprintf(out, "Halted");
+        break;
+    case EV_EVAL_BEGIN:
+        fprintf(out, "Evaluating program with the %s", args[0] ? "tree-walker" : "VM");
+        break;
+    case EV_EVAL_END:
+        fprintf(out, "Evaluated program successfully");
+        break;
+    case EV_EVAL_NODE:
+        fprintf(out, "Node %u of type %u", args[0], args[1]);
+        break;
+    case EV_EVAL_IDENTIFIER:
+        fprintf(out, "Identifier '%s' has value %d", tracedName(args[0]), (int32_t)args[1]);
+        break;
+    case EV_EVAL_BINARY:
+        fprintf(out, "Performing binary operation '%u' on %d and %d", args[0], (int32_t)args[1], (int32_t)args[2]);
+        break;
+    case EV_EVAL_ASSIGN_INT:
+        fprintf(out, "Assigned int value %d to variable '%s'", (int32_t)args[1], tracedName(args[0]));
+        break;
+    case EV_EVAL_ASSIGN_CHAR:
+        fprintf(out, "Assigned string value to variable '%s'", tracedName(args[0]));
+        break;
+    case EV_EVAL_BRANCH:
+        fprintf(out, "If condition evaluated to %d, %s", (int32_t)args[0],
+                args[1] == 0 ? "executing 'then' branch" : args[1] == 1 ? "executing 'else' branch" : "no branch taken");
+        break;
+    case EV_EVAL_LOOP:
+        fprintf(out, "Evaluating a %sloop of node type %u", args[1] & 1 ? "counted " : "", args[0]);
+        break;
+    default:
+        fprintf(out, "Unknown event %u", record->event);
+        break;
+    }
+}
+
+// Format the buffered events, oldest first
+void dumpTrace(FILE *out)
+{
+    if (traceBuffer == NULL || traceCount == 0)
+    {
+        return;
+    }
+
+    uint64_t first = traceCount > traceCapacity ? traceCount - traceCapacity : 0;
+    uint64_t start = traceBuffer[first & traceMask].timestamp;
+    if (first > 0)
+    {
+        fprintf(out, "Trace: %llu older events were overwritten\n", (unsigned long long)first);
+    }
+    for (uint64_t i = first; i < traceCount; i++)
+    {
+        const TraceRecord *record = &traceBuffer[i & traceMask];
+        fprintf(out, "[%10llu] %s: ", (unsigned long long)(record->timestamp - start), subsystemNames[record->subsystem]);
+        formatRecord(out, record);
+        fputc('\n', out);
+    }
+    traceCount = 0;
+}
+
+static void dumpTraceAtExit()
+{
+    const char *fileName = getenv("INTERP_TRACE_FILE");
+    FILE *out = fileName != NULL ? fopen(fileName, "w") : NULL;
+    dumpTrace(out != NULL ? out : stderr);
+    if (out != NULL)
+    {
+        fclose(out);
+    }
+}
+
+// Enable tracing from a list like "lexer=2,eval" (level 2 when omitted) or "all=1"
+int configureTrace(const char *spec)
+{
+    static int dumpRegistered = 0;
+    const char *cursor = spec;
+
+    while (*cursor != '\0')
+    {
+        size_t length = strcspn(cursor, ",=");
+        int level = TRACE_DETAIL;
+        const char *next = cursor + length;
+        if (*next == '=')
+        {
+            level = atoi(next + 1);
+            next += 1 + strcspn(next + 1, ",");
+        }
+
+        int found = 0;
+        for (int i = 0; i < TRACE_SUBSYSTEM_COUNT; i++)
+        {
+            if ((length == 3 && strncmp(cursor, "all", 3) == 0) ||
+                (strlen(subsystemNames[i]) == length && strncmp(cursor, subsystemNames[i], length) == 0))
+            {
+                traceLevels[i] = (uint8_t)level;
+                found = 1;
+            }
+        }
+        if (!found)
+        {
+            printf("Trace Error: Unknown subsystem '%.*s'\n", (int)length, cursor);
+            return -1;
+        }
+
+        cursor = *next == ',' ? next + 1 : next;
+    }
+
+    if (!dumpRegistered)
+    {
+        atexit(dumpTraceAtExit);
+        dumpRegistered = 1;
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Subsystems that can be traced independently
+typedef enum
+{
+    TRACE_LEXER,
+    TRACE_PARSER,
+    TRACE_OPTIMIZER,
+    TRACE_COMPILER,
+    TRACE_VM,
+    TRACE_EVAL,
+    TRACE_SUBSYSTEM_COUNT
+} TraceSubsystem;
+
+// Trace levels, a subsystem records the events at or below its level
+typedef enum
+{
+    TRACE_OFF = 0,
+    TRACE_INFO = 1,   // Phases: program parsed, chunk compiled, ...
+    TRACE_DETAIL = 2, // Every token, grammar rule, node or instruction
+} TraceLevel;
+
+// Events, their arguments are described next to each one
+typedef enum
+{
+    EV_LEX_TOKEN,         // token type, offset, length
+    EV_PARSE_BEGIN,       //
+    EV_PARSE_END,         // arena words
+    EV_PARSE_TOKEN,       // token type, offset, length
+    EV_PARSE_MATCH,       // token type, offset, length
+    EV_PARSE_RULE,        // ParseRule
+    EV_PARSE_OPERATOR,    // token type
+    EV_OPTIMIZE_END,      // removed nodes, remaining nodes
+    EV_COMPILE_END,       // words, stack depth
+    EV_COMPILE_OP,        // position, opcode, first operand
+    EV_JIT_LOOP,          // node, machine code bytes (0 = left to the VM), variables
+    EV_VM_BEGIN,          // words
+    EV_VM_OP,             // position, opcode
+    EV_VM_END,            //
+    EV_EVAL_BEGIN,        // engine (0 = VM, 1 = tree-walker)
+    EV_EVAL_END,          //
+    EV_EVAL_NODE,         // node, node type
+    EV_EVAL_IDENTIFIER,   // interned name, value
+    EV_EVAL_BINARY,       // operator token type, left, right
+    EV_EVAL_ASSIGN_INT,   // interned name, value
+    EV_EVAL_ASSIGN_CHAR,  // interned name
+    EV_EVAL_BRANCH,       // condition, taken branch (0 = then, 1 = else, 2 = none)
+    EV_EVAL_LOOP,         // node type, ForRecord flags
+    EV_COUNT
+} TraceEvent;
+
+// Grammar rules reported by EV_PARSE_RULE
+typedef enum
+{
+    RULE_STATEMENT,
+    RULE_IF,
+    RULE_ELSE_IF,
+    RULE_ELSE,
+    RULE_FOR,
+    RULE_WHILE,
+    RULE_BLOCK,
+    RULE_PRINT,
+    RULE_FLUSH,
+    RULE_EXPRESSION,
+    RULE_FACTOR,
+    RULE_ARRAY,
+    RULE_CALL,
+    RULE_FUNCTION,
+    RULE_RETURN,
+} ParseRule;
+
+// Binary event stored in the ring buffer, formatted only by dumpTrace
+typedef struct
+{
+    uint64_t timestamp;
+    uint16_t event;
+    uint8_t subsystem;
+    uint8_t level;
+    uint32_t args[3];
+} TraceRecord;
+
+extern uint8_t traceLevels[TRACE_SUBSYSTEM_COUNT];
+
+// Trace functions
+int configureTrace(const char *spec);
+void setTraceCapacity(uint32_t events);
+void traceRecord(TraceSubsystem subsystem, TraceLevel level, TraceEvent event,
+                 uint32_t a, uint32_t b, uint32_t c);
+void dumpTrace(FILE *out);
+uint64_t readTimestamp();
+
+// Release builds define NTRACE and every trace point disappears
+#ifdef NTRACE
+#define TRACE_ENABLED(subsystem, level) 0
+#define TRACE(subsystem, level, event, a, b, c) ((void)0)
+#else
+#define TRACE_ENABLED(subsystem, level) __builtin_expect(traceLevels[subsystem] >= (level), 0)
+#define TRACE(subsystem, level, event, a, b, c)                                              \
+    do                                                                                       \
+    {                                                                                        \
+        if (TRACE_ENABLED(subsystem, level))                                                 \
+            traceRecord(subsystem, level, event, (uint32_t)(a), (uint32_t)(b), (uint32_t)(c)); \
+    } while (0)
+#endif
+
+#endif
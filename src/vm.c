@@ -0,0 +1,451 @@
+#include "vm.h"
+#include "interpreter.h"
+#include "output.h"
+#include "array.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// Comparison of a counted loop, op is one of OP_LT .. OP_NE
+static inline int compareCounted(int32_t op, int value, int bound)
+{
+    switch (op)
+    {
+    case OP_LT:
+        return value < bound;
+    case OP_LE:
+        return value <= bound;
+    case OP_GT:
+        return value > bound;
+    case OP_GE:
+        return value >= bound;
+    default:
+        return value != bound;
+    }
+}
+
+// Computed goto keeps one indirect branch per instruction instead of a shared switch
+#if defined(__GNUC__) || defined(__clang__)
+#define USE_COMPUTED_GOTO 1
+#else
+#define USE_COMPUTED_GOTO 0
+#endif
+
+#if USE_COMPUTED_GOTO
+#define DISPATCH() goto *table[*ip++]
+#define CASE(op) label_##op
+#else
+#define DISPATCH() goto dispatch
+#define CASE(op) case op
+#endif
+
+// Make room for size words of the operand stack, the slots of the top level come first and
+// the frames of calls are stacked above them. Like the work stacks, it is bounded by --stack-limit.
+int *reserveStack(int size)
+{
+    if (interp->vmStackCapacity < size)
+    {
+        if ((uint32_t)size > workStackLimit)
+        {
+            reportError("Runtime Error: Program nested deeper than %u levels, see --stack-limit\n", workStackLimit);
+            failInterpreter();
+        }
+        int capacity = interp->vmStackCapacity * 2 > size ? interp->vmStackCapacity * 2 : size;
+        if ((uint32_t)capacity > workStackLimit)
+        {
+            capacity = (int)workStackLimit;
+        }
+        int *stack = realloc(interp->vmStack, capacity * sizeof(int));
+        if (stack == NULL)
+        {
+            reportError("Runtime Error: Out of memory\n");
+            failInterpreter();
+        }
+        interp->vmStack = stack;
+        interp->vmStackCapacity = capacity;
+    }
+    return interp->vmStack;
+}
+
+// A zero divisor, or -1 dividing INT_MIN whose quotient does not fit
+void failDivision(int32_t divisor)
+{
+    if (divisor == 0)
+    {
+        reportError("Runtime Error: Division by zero\n");
+    }
+    else
+    {
+        reportError("Runtime Error: Integer overflow in division\n");
+    }
+    failInterpreter();
+}
+
+// Run a compiled chunk against the symbol table of the bound interpreter
+void runChunk(Chunk *chunk)
+{
+    const int32_t *code = chunk->code;
+    const int32_t *ip = code;
+    int a, b;
+    DictKey key;
+    uint32_t position;
+
+    // The operand stack is kept by the interpreter, a failing script does not leak it
+    int *stack = reserveStack(chunk->maxStack + 1);
+    int *sp = stack + chunk->slotCount; // Next free slot
+    int *fp = stack;                    // Slots of the running function
+
+#if USE_COMPUTED_GOTO
+    static void *dispatchTable[OP_COUNT] = {
+        [OP_CONST] = &&label_OP_CONST,
+        [OP_LOAD] = &&label_OP_LOAD,
+        [OP_STORE_INT] = &&label_OP_STORE_INT,
+        [OP_STORE_STRING] = &&label_OP_STORE_STRING,
+        [OP_ADD] = &&label_OP_ADD,
+        [OP_SUB] = &&label_OP_SUB,
+        [OP_MUL] = &&label_OP_MUL,
+        [OP_DIV] = &&label_OP_DIV,
+        [OP_MOD] = &&label_OP_MOD,
+        [OP_LT] = &&label_OP_LT,
+        [OP_LE] = &&label_OP_LE,
+        [OP_GT] = &&label_OP_GT,
+        [OP_GE] = &&label_OP_GE,
+        [OP_NE] = &&label_OP_NE,
+        [OP_JUMP] = &&label_OP_JUMP,
+        [OP_JUMP_IF_FALSE] = &&label_OP_JUMP_IF_FALSE,
+        [OP_PRINT] = &&label_OP_PRINT,
+        [OP_PRINT_INT] = &&label_OP_PRINT_INT,
+        [OP_PRINT_STRING] = &&label_OP_PRINT_STRING,
+        [OP_FLUSH] = &&label_OP_FLUSH,
+        [OP_STORE_CONCAT] = &&label_OP_STORE_CONCAT,
+        [OP_PRINT_CONCAT] = &&label_OP_PRINT_CONCAT,
+        [OP_LOAD_SLOT] = &&label_OP_LOAD_SLOT,
+        [OP_FOR_ENTER] = &&label_OP_FOR_ENTER,
+        [OP_FOR_STEP] = &&label_OP_FOR_STEP,
+        [OP_LOAD_INDEX] = &&label_OP_LOAD_INDEX,
+        [OP_STORE_INDEX] = &&label_OP_STORE_INDEX,
+        [OP_ARRAY_CALL] = &&label_OP_ARRAY_CALL,
+        [OP_ARRAY_OP] = &&label_OP_ARRAY_OP,
+        [OP_STORE_ARRAY] = &&label_OP_STORE_ARRAY,
+        [OP_COPY_ARRAY] = &&label_OP_COPY_ARRAY,
+        [OP_LOAD_KEYED] = &&label_OP_LOAD_KEYED,
+        [OP_STORE_KEYED] = &&label_OP_STORE_KEYED,
+        [OP_STORE_DICT] = &&label_OP_STORE_DICT,
+        [OP_COPY_DICT] = &&label_OP_COPY_DICT,
+        [OP_EACH] = &&label_OP_EACH,
+        [OP_LOAD_LOCAL] = &&label_OP_LOAD_LOCAL,
+        [OP_STORE_LOCAL] = &&label_OP_STORE_LOCAL,
+        [OP_POP] = &&label_OP_POP,
+        [OP_CALL] = &&label_OP_CALL,
+        [OP_TAIL_CALL] = &&label_OP_TAIL_CALL,
+        [OP_RETURN] = &&label_OP_RETURN,
+        [OP_HALT] = &&label_OP_HALT,
+    };
+    // Every entry of the traced table records the instruction, then jumps to the real handler
+    static void *tracedTable[OP_COUNT];
+    void **table = dispatchTable;
+    if (TRACE_ENABLED(TRACE_VM, TRACE_DETAIL))
+    {
+        for (int i = 0; i < OP_COUNT; i++)
+        {
+            tracedTable[i] = &&trace_instruction;
+        }
+        table = tracedTable;
+    }
+    TRACE(TRACE_VM, TRACE_INFO, EV_VM_BEGIN, chunk->count, 0, 0);
+    DISPATCH();
+
+trace_instruction:
+    traceRecord(TRACE_VM, TRACE_DETAIL, EV_VM_OP, (uint32_t)(ip - 1 - code), (uint32_t)ip[-1], 0);
+    goto *dispatchTable[ip[-1]];
+#else
+    TRACE(TRACE_VM, TRACE_INFO, EV_VM_BEGIN, chunk->count, 0, 0);
+dispatch:
+    TRACE(TRACE_VM, TRACE_DETAIL, EV_VM_OP, ip - code, *ip, 0);
+    switch (*ip++)
+    {
+#endif
+
+    CASE(OP_CONST):
+        *sp++ = *ip++;
+        DISPATCH();
+
+    CASE(OP_LOAD):
+        *sp++ = lookupVariableHashed(internedText(*ip), internedHash(*ip));
+        ip++;
+        DISPATCH();
+
+    CASE(OP_STORE_INT):
+        assignVariableIntHashed(internedText(*ip), internedHash(*ip), TYPE_INT, *--sp);
+        ip++;
+        DISPATCH();
+
+    CASE(OP_STORE_STRING):
+        assignVariableStringHashed(internedText(ip[0]), internedHash(ip[0]), TYPE_CHAR, chunk->strings[ip[1]]);
+        ip += 2;
+        DISPATCH();
+
+#define BINARY_OP(op, expr) \
+    CASE(op):               \
+        b = *--sp;          \
+        a = sp[-1];         \
+        sp[-1] = (expr);    \
+        DISPATCH();
+
+    BINARY_OP(OP_ADD, (int32_t)((uint32_t)a + (uint32_t)b))
+    BINARY_OP(OP_SUB, (int32_t)((uint32_t)a - (uint32_t)b))
+    BINARY_OP(OP_MUL, (int32_t)((uint32_t)a * (uint32_t)b))
+    BINARY_OP(OP_LT, a < b)
+    BINARY_OP(OP_LE, a <= b)
+    BINARY_OP(OP_GT, a > b)
+    BINARY_OP(OP_GE, a >= b)
+    BINARY_OP(OP_NE, a != b)
+#undef BINARY_OP
+
+#define DIVISION_OP(op, expr)    \
+    CASE(op):                    \
+        b = *--sp;               \
+        a = sp[-1];              \
+        if (divisionFails(a, b)) \
+        {                        \
+            failDivision(b);     \
+        }                        \
+        sp[-1] = (expr);         \
+        DISPATCH();
+
+    DIVISION_OP(OP_DIV, a / b)
+    DIVISION_OP(OP_MOD, a % b)
+#undef DIVISION_OP
+
+    CASE(OP_JUMP):
+        ip = code + *ip;
+        DISPATCH();
+
+    CASE(OP_JUMP_IF_FALSE):
+        if (*--sp == 0)
+        {
+            ip = code + *ip;
+        }
+        else
+        {
+            ip++;
+        }
+        DISPATCH();
+
+    CASE(OP_PRINT):
+        printVariable(internedText(*ip++));
+        DISPATCH();
+
+    CASE(OP_PRINT_INT):
+        printInt(*--sp);
+        DISPATCH();
+
+    CASE(OP_PRINT_STRING):
+        printString(chunk->strings[*ip++]);
+        DISPATCH();
+
+    CASE(OP_FLUSH):
+        flushOutput();
+        DISPATCH();
+
+    CASE(OP_STORE_CONCAT):
+        assignStringExpression(ip[0], ip[1]);
+        ip += 2;
+        DISPATCH();
+
+    CASE(OP_PRINT_CONCAT):
+    {
+        StringValue text;
+        joinStringExpression(*ip++, &text);
+        printString(stringText(&text));
+        releaseString(&text);
+        DISPATCH();
+    }
+
+    CASE(OP_LOAD_SLOT):
+        *sp++ = stack[*ip++];
+        DISPATCH();
+
+    CASE(OP_FOR_ENTER):
+        if (compareCounted(ip[0], sp[-2], sp[-1]))
+        {
+            ip += 3;
+            DISPATCH();
+        }
+        assignVariableIntHashed(internedText(ip[1]), internedHash(ip[1]), TYPE_INT, sp[-2]);
+        sp -= 2;
+        ip = code + ip[2];
+        DISPATCH();
+
+    CASE(OP_FOR_STEP):
+        sp[-2] = (int)((uint32_t)sp[-2] + (uint32_t)ip[2]);
+        if (compareCounted(ip[0], sp[-2], sp[-1]))
+        {
+            ip = code + ip[3];
+            DISPATCH();
+        }
+        assignVariableIntHashed(internedText(ip[1]), internedHash(ip[1]), TYPE_INT, sp[-2]);
+        sp -= 2;
+        ip += 4;
+        DISPATCH();
+
+    CASE(OP_LOAD_INDEX):
+        makeIntKey(&key, sp[-1]);
+        sp[-1] = readElement(*ip++, &key);
+        DISPATCH();
+
+    CASE(OP_STORE_INDEX):
+        sp -= 2;
+        makeIntKey(&key, sp[0]);
+        writeElement(*ip++, &key, sp[1]);
+        DISPATCH();
+
+    CASE(OP_ARRAY_CALL):
+        if (ip[2] != NULL_NODE)
+        {
+            keyFromNode(ip[2], &key);
+        }
+        else if (builtinTakesKey(ip[0]))
+        {
+            makeIntKey(&key, *--sp);
+        }
+        *sp++ = callArrayBuiltin(ip[0], ip[1], &key);
+        ip += 3;
+        DISPATCH();
+
+    CASE(OP_ARRAY_OP):
+        if (ip[3] != NULL_NODE)
+        {
+            keyFromNode(ip[3], &key);
+        }
+        else if (builtinTakesKey(ip[0]))
+        {
+            makeIntKey(&key, *--sp);
+        }
+        sp -= builtinArguments(ip[0]);
+        runArrayBuiltin(ip[0], ip[1], ip[2], &key, sp);
+        ip += 4;
+        DISPATCH();
+
+    CASE(OP_STORE_ARRAY):
+        sp -= ip[1];
+        assignArrayElements(ip[0], sp, ip[1]);
+        ip += 2;
+        DISPATCH();
+
+    CASE(OP_COPY_ARRAY):
+        assignArrayCopy(ip[0], ip[1]);
+        ip += 2;
+        DISPATCH();
+
+    CASE(OP_LOAD_KEYED):
+        keyFromNode(ip[1], &key);
+        *sp++ = readElement(ip[0], &key);
+        ip += 2;
+        DISPATCH();
+
+    CASE(OP_STORE_KEYED):
+        keyFromNode(ip[1], &key);
+        writeElement(ip[0], &key, *--sp);
+        ip += 2;
+        DISPATCH();
+
+    CASE(OP_STORE_DICT):
+        assignEmptyDict(*ip++);
+        DISPATCH();
+
+    CASE(OP_COPY_DICT):
+        assignDictCopy(ip[0], ip[1]);
+        ip += 2;
+        DISPATCH();
+
+    CASE(OP_EACH):
+        position = (uint32_t)sp[-1];
+        if (nextElement(ip[0], ip[1], &position))
+        {
+            sp[-1] = (int)position;
+            ip += 3;
+            DISPATCH();
+        }
+        sp--;
+        ip = code + ip[2];
+        DISPATCH();
+
+    CASE(OP_LOAD_LOCAL):
+        *sp++ = fp[*ip++];
+        DISPATCH();
+
+    CASE(OP_STORE_LOCAL):
+        fp[*ip++] = *--sp;
+        DISPATCH();
+
+    CASE(OP_POP):
+        sp--;
+        DISPATCH();
+
+    CASE(OP_CALL):
+        if (sp - stack + ip[3] > interp->vmStackCapacity)
+        {
+            a = (int)(sp - stack);
+            b = (int)(fp - stack);
+            stack = reserveStack(a + ip[3]);
+            sp = stack + a;
+            fp = stack + b;
+        }
+        // The arguments move up two words for the return address and the caller frame
+        sp -= ip[1];
+        for (a = ip[1] - 1; a >= 0; a--)
+        {
+            sp[a + 2] = sp[a];
+        }
+        sp[0] = (int)(ip + 4 - code);
+        sp[1] = (int)(fp - stack);
+        fp = sp + 2;
+        for (a = ip[1]; a < ip[2]; a++)
+        {
+            fp[a] = 0;
+        }
+        sp = fp + ip[2];
+        ip = code + ip[0];
+        DISPATCH();
+
+    CASE(OP_TAIL_CALL):
+        if (fp - stack + ip[3] > interp->vmStackCapacity)
+        {
+            a = (int)(sp - stack);
+            b = (int)(fp - stack);
+            stack = reserveStack(b + ip[3]);
+            sp = stack + a;
+            fp = stack + b;
+        }
+        sp -= ip[1];
+        for (a = 0; a < ip[1]; a++)
+        {
+            fp[a] = sp[a];
+        }
+        for (; a < ip[2]; a++)
+        {
+            fp[a] = 0;
+        }
+        sp = fp + ip[2];
+        ip = code + ip[0];
+        DISPATCH();
+
+    CASE(OP_RETURN):
+        a = sp[-1];
+        sp = fp - 2;
+        ip = code + sp[0];
+        fp = stack + sp[1];
+        *sp++ = a;
+        DISPATCH();
+
+    CASE(OP_HALT):
+        TRACE(TRACE_VM, TRACE_INFO, EV_VM_END, 0, 0, 0);
+        return;
+
+#if !USE_COMPUTED_GOTO
+    default:
+        reportError("Runtime Error: Unknown opcode '%d'\n", ip[-1]);
+        failInterpreter();
+    }
+#endif
+}
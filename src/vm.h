@@ -0,0 +1,18 @@
+#ifndef VM_H
+#define VM_H
+
+#include "compiler.h"
+#include <stdint.h>
+
+// Integer division traps on these operands, every engine fails with failDivision instead
+static inline int divisionFails(int32_t dividend, int32_t divisor)
+{
+    return divisor == 0 || (dividend == INT32_MIN && divisor == -1);
+}
+
+// Virtual machine functions
+void runChunk(Chunk *chunk);
+int *reserveStack(int size);
+void failDivision(int32_t divisor) __attribute__((noreturn));
+
+#endif